@@ -11,6 +11,7 @@
 #include <sstream>
 #include <set>
 #include "fixrgraphiso/proto_acdfg.pb.h"
+#include "fixrgraphiso/compression.h"
 
 namespace fixrgraphiso {
   using std::ostringstream;
@@ -1000,7 +1001,7 @@ namespace fixrgraphiso {
     }
 
     {
-      if (! acdfg->SerializeToOstream(&out)) {
+      if (! serializeToStream(*acdfg, out)) {
         std::cerr << "Failed to write acdfg." << endl;
       }
     }
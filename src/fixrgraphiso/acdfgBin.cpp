@@ -7,6 +7,7 @@
 #include "acdfgBin.h"
 #include "fixrgraphiso/isomorphismClass.h"
 #include "fixrgraphiso/collectStats.h"
+#include "fixrgraphiso/serialization.h"
 #include "fixrgraphiso/serializationLattice.h"
 
 namespace fixrgraphiso {
@@ -121,6 +122,92 @@ namespace fixrgraphiso {
       return AcdfgBin::NONE;
   }
 
+  /**
+   * True if iso is the identity on the representative.
+   *
+   * Used to find the representative in the bins that do not store its
+   * name: the acdfgs of the isomorphisms read from the format v1 are
+   * copies, so they are compared by content.
+   */
+  bool AcdfgBin::isReprIso(const IsoRepr* iso) const {
+    for (const id_pair_t & nodes : iso->getNodesRel())
+      if (nodes.first != nodes.second)
+        return false;
+    for (const id_pair_t & edges : iso->getEdgesRel())
+      if (edges.first != edges.second)
+        return false;
+
+    const Acdfg* repr = getRepresentative();
+    if (iso->getAcdfg1Ptr() == repr)
+      return true;
+
+    AcdfgSerializer serializer;
+    acdfg_protobuf::Acdfg protoRepr;
+    acdfg_protobuf::Acdfg protoMember;
+    serializer.fill_proto_from_acdfg(*repr, &protoRepr);
+    serializer.fill_proto_from_acdfg(iso->getAcdfg1(), &protoMember);
+    return protoRepr.SerializeAsString() == protoMember.SerializeAsString();
+  }
+
+  /**
+   * Remove the acdfg name from the bin.
+   *
+   * If the acdfg is the representative of the bin another member
+   * becomes the representative and the isomorphisms of the remaining
+   * members are updated accordingly.
+   *
+   * Return false if name is not in the bin.
+   */
+  bool AcdfgBin::removeAcdfg(const string & name) {
+    auto isoIt = acdfgNameToIso.find(name);
+    if (isoIt == acdfgNameToIso.end())
+      return false;
+
+    IsoRepr* removedIso = isoIt->second;
+    bool isRepr = reprName.empty() ? isReprIso(removedIso) : reprName == name;
+
+    acdfgNameToIso.erase(isoIt);
+    acdfgNames.erase(std::remove(acdfgNames.begin(), acdfgNames.end(), name),
+                     acdfgNames.end());
+    changed = true;
+
+    if (isRepr && acdfgNames.size() > 0) {
+      const string newReprName = acdfgNames.front();
+      IsoRepr* promotedIso = acdfgNameToIso[newReprName];
+
+      // The acdfg of the member may be shared (e.g., with the old
+      // representative in the format v2), rename a copy
+      AcdfgSerializer serializer;
+      acdfg_protobuf::Acdfg protoPromoted;
+      serializer.fill_proto_from_acdfg(promotedIso->getAcdfg1(),
+                                       &protoPromoted);
+      Acdfg* newRepr = serializer.create_acdfg(protoPromoted);
+      newRepr->setName(newReprName);
+
+      // from the old to the new representative (the copy keeps the ids)
+      IsoRepr toPromoted(*promotedIso, true);
+      IsoRepr toNewRepr(toPromoted.getAcdfg1Ptr(), newRepr);
+      for (const id_pair_t & nodes : toPromoted.getNodesRel())
+        toNewRepr.addNodeRel(nodes.first, nodes.second);
+      for (const id_pair_t & edges : toPromoted.getEdgesRel())
+        toNewRepr.addEdgeRel(edges.first, edges.second);
+
+      for (const string & member : acdfgNames) {
+        IsoRepr* oldIso = acdfgNameToIso[member];
+        if (member == newReprName)
+          acdfgNameToIso[member] = new IsoRepr(newRepr);
+        else
+          acdfgNameToIso[member] = new IsoRepr(*oldIso, toNewRepr);
+        delete oldIso;
+      }
+      acdfgRepr = newRepr;
+      reprName = newReprName;
+    }
+
+    delete removedIso;
+    return true;
+  }
+
   int AcdfgBin::getPopularity() const {
     int f = getFrequency();
     for (const AcdfgBin* a : subsumingBins){
@@ -148,14 +235,14 @@ namespace fixrgraphiso {
 
   void AcdfgBin::dumpToDot(string fileName) const{
     std::ofstream dot_out (fileName.c_str());
-    acdfgRepr -> dumpToDot(dot_out);
+    getRepresentative() -> dumpToDot(dot_out);
     dot_out.close();
   }
 
   void AcdfgBin::dumpToProtobuf(string fileName) const{
     std::fstream output(fileName, std::ios::out | std::ios::trunc | std::ios::binary);
 
-    acdfgRepr -> dumpToAcdfgProto(output);
+    getRepresentative() -> dumpToAcdfgProto(output);
     output.close();
   }
 
@@ -186,6 +273,23 @@ namespace fixrgraphiso {
     isImmediateSubsumingUpdate = true;
   }
 
+  /**
+   * Set the bins subsuming this bin, that must be already closed and
+   * sorted, and the immediately subsuming ones (e.g., when the lattice is
+   * loaded).
+   */
+  void AcdfgBin::setSubsumingBins(const vector<AcdfgBin*> & subsuming,
+                                  const vector<AcdfgBin*> & immediateSubsuming) {
+    subsumingBins = set<AcdfgBin*>(subsuming.begin(), subsuming.end());
+    for (AcdfgBin* b : subsumingBins)
+      b->incomingEdges.insert(this);
+
+    immediateSubsumingBins = set<AcdfgBin*>(immediateSubsuming.begin(),
+                                            immediateSubsuming.end());
+    isImmediateSubsumingUpdate = true;
+    changed = true;
+  }
+
   /**
    * Returns true is the bin popularity is over the treshold,
    * and there are no bin subsuming this one such that
@@ -275,15 +379,18 @@ namespace fixrgraphiso {
 
 
   void Lattice::addBin(AcdfgBin* bin) {
+    bin->setId(allBins.size());
     allBins.push_back(bin);
   }
 
   void Lattice::addPopular(AcdfgBin* popular) {
     popularBins.push_back(popular);
+    subsumingAnomalousBuilt = false;
   }
 
   void Lattice::addAnomalous(AcdfgBin* anomalous) {
     anomalousBins.push_back(anomalous);
+    subsumingAnomalousBuilt = false;
   }
 
   void Lattice::addIsolated(AcdfgBin* isolated) {
@@ -298,18 +405,21 @@ namespace fixrgraphiso {
 
   }
 
-  void sortHelp(vector<AcdfgBin*> &binVector) {
-    std::sort(binVector.begin(), binVector.end(),
-              [](const AcdfgBin  * bin1, const AcdfgBin * bin2){
-                return bin1 -> getFrequency() > bin2 -> getFrequency();
-              });
+  /* Does not modify binVector if it is already sorted, so that
+     concurrent searches can "sort" a lattice sorted in advance */
+  void Lattice::sortBinsByFrequency(vector<AcdfgBin*> &binVector) {
+    auto moreFrequent = [](const AcdfgBin  * bin1, const AcdfgBin * bin2){
+      return bin1 -> getFrequency() > bin2 -> getFrequency();
+    };
+    if (! std::is_sorted(binVector.begin(), binVector.end(), moreFrequent))
+      std::sort(binVector.begin(), binVector.end(), moreFrequent);
   }
 
   void Lattice::sortAllByFrequency() {
-    sortHelp(allBins);
-    sortHelp(popularBins);
-    sortHelp(anomalousBins);
-    sortHelp(isolatedBins);
+    sortBinsByFrequency(allBins);
+    sortBinsByFrequency(popularBins);
+    sortBinsByFrequency(anomalousBins);
+    sortBinsByFrequency(isolatedBins);
   }
 
 
@@ -321,14 +431,91 @@ namespace fixrgraphiso {
     for (AcdfgBin * acdfgBin : allBins){
       acdfgBin->resetClassification();
     }
+    classified = false;
+    subsumingAnomalousBuilt = false;
+  }
+
+  /**
+   * Fill the popular, anomalous and isolated lists from the
+   * classification of the bins.
+   */
+  void Lattice::rebuildClassifiedBins(bool skipSubsuming) {
+    popularBins.clear();
+    anomalousBins.clear();
+    isolatedBins.clear();
+
+    for (AcdfgBin * a : allBins) {
+      if (skipSubsuming && a->isSubsuming()) continue;
+      if (a->isPopular())
+        popularBins.push_back(a);
+      else if (a->isAnomalous())
+        anomalousBins.push_back(a);
+      else if (a->isIsolated())
+        isolatedBins.push_back(a);
+    }
+    subsumingAnomalousBuilt = false;
+  }
+
+  /**
+   * Find the anomalous bins subsuming the popular bin, sorted from the
+   * most specific one (i.e., the ones with fewer subsuming bins come
+   * first, so a bin always comes before the bins it subsumes).
+   */
+  void Lattice::computeSubsumingAnomalous(const AcdfgBin* popular,
+                                          vector<AcdfgBin*> & anomalous) {
+    anomalous.clear();
+    for (AcdfgBin* subsuming : popular->getSubsumingBins())
+      if (subsuming->isAnomalous())
+        anomalous.push_back(subsuming);
+
+    std::sort(anomalous.begin(), anomalous.end(),
+              [](const AcdfgBin* a, const AcdfgBin* b) {
+                if (a->getSubsumingBins().size() != b->getSubsumingBins().size())
+                  return a->getSubsumingBins().size() < b->getSubsumingBins().size();
+                return a->getId() < b->getId();
+              });
+  }
+
+  void Lattice::buildSubsumingAnomalous() {
+    vector<AcdfgBin*> anomalous;
+    for (AcdfgBin* popular : popularBins) {
+      computeSubsumingAnomalous(popular, anomalous);
+      popular->setSubsumingAnomalous(anomalous);
+    }
+    subsumingAnomalousBuilt = true;
+  }
+
+  /* Set the anomalous bins of the popular bins (e.g., read from a file) */
+  void Lattice::setSubsumingAnomalous(const map<AcdfgBin*, vector<AcdfgBin*>> & popularToAnomalous) {
+    for (AcdfgBin* popular : popularBins) {
+      auto it = popularToAnomalous.find(popular);
+      popular->setSubsumingAnomalous(it == popularToAnomalous.end() ?
+                                     vector<AcdfgBin*>() : it->second);
+    }
+    subsumingAnomalousBuilt = true;
+  }
+
+  void Lattice::clearChanged() {
+    for (AcdfgBin * acdfgBin : allBins)
+      acdfgBin->setChanged(false);
+  }
+
+  bool Lattice::hasChangedBins() const {
+    for (AcdfgBin * acdfgBin : allBins)
+      if (acdfgBin->isChanged())
+        return true;
+    return false;
   }
 
   void Lattice::dumpAllBins(std::chrono::seconds time_taken,
                             const string & output_prefix,
                             const string & infoFileName,
-                            const string & latticeFileName) {
+                            const string & latticeFileName,
+                            int formatVersion,
+                            bool reducedRelations) {
 
-    fixrgraphiso::writeLattice((const Lattice&) *this, latticeFileName);
+    fixrgraphiso::writeLattice((const Lattice&) *this, latticeFileName,
+                               formatVersion, reducedRelations);
 
     ofstream out_file(infoFileName.c_str());
     int count = 1;
@@ -486,77 +673,76 @@ namespace fixrgraphiso {
   }
 
   /**
-   * Compute the topological order of the lattice using the reverse
-   * transition relation (i.e., starting from the nodes that are not
-   * subsumed by any other nodes and going backward).
+   * Compute the topological levels of the lattice, starting from the
+   * nodes that are not subsumed by any other node and going backward.
+   *
+   * Each level is an antichain and all the bins immediately subsuming
+   * a bin are in the previous levels.
    */
-  void Lattice::computeTopologicalOrder(vector<AcdfgBin*> &order) const {
-    map<AcdfgBin*, set<AcdfgBin*>*> tr;
-    map<AcdfgBin*, set<AcdfgBin*>*> inverseTr;
-    vector<AcdfgBin*> to_process;
+  void Lattice::computeTopologicalLevels(vector<vector<AcdfgBin*>> &levels) const {
+    const int binsCount = allBins.size();
+    // number of bins immediately subsuming a bin that are not visited yet
+    vector<int> pendingUpper(binsCount, 0);
+    // bins immediately subsumed by the bin i are in
+    // lower[lowerStart[i]..lowerStart[i+1]-1]
+    vector<int> lowerStart(binsCount + 1, 0);
+    vector<AcdfgBin*> level;
 
-    // Build the non-transitive transition relation
-    // Note that the algorithm visits the DAG backward
-    buildTr(tr);
-    reverseTr(tr, inverseTr);
-
-    // Find all the top elements of the lattice
     for (auto bin : allBins) {
-      if (tr[bin]->empty())
-        to_process.push_back(bin);
+      assert(bin->getId() >= 0 && bin->getId() < binsCount);
+      const set<AcdfgBin*> & immediateSubsuming =
+        bin->getImmediateSubsumingBins();
+      pendingUpper[bin->getId()] = immediateSubsuming.size();
+      for (auto upper : immediateSubsuming)
+        lowerStart[upper->getId() + 1] += 1;
+
+      // top elements of the lattice
+      if (immediateSubsuming.empty())
+        level.push_back(bin);
     }
 
-    while (! to_process.empty()) {
-      AcdfgBin* bin = to_process.back();
-      to_process.pop_back();
-
-      // Add bin to the topological order
-      order.push_back(bin);
-
-      set<AcdfgBin*>* succBins = inverseTr[bin];
-      for (auto succ : (*succBins)) {
-        set<AcdfgBin*>* predOfSucc = tr[succ];
-        if (predOfSucc->empty()) // already visited
-          continue;
+    for (int i = 0; i < binsCount; i++)
+      lowerStart[i + 1] += lowerStart[i];
 
-        /* remove (succ, bin) from tr */
-        predOfSucc->erase(bin);
+    vector<AcdfgBin*> lower(lowerStart[binsCount]);
+    vector<int> lowerEnd(lowerStart.begin(), lowerStart.end() - 1);
+    for (auto bin : allBins) {
+      for (auto upper : bin->getImmediateSubsumingBins())
+        lower[lowerEnd[upper->getId()]++] = bin;
+    }
 
-        /* if succ has no other incoming edges then add succ to to_process.
-           At this point it's "safe" to process succ.
-         */
-        if (predOfSucc->empty()) {
-          to_process.push_back(succ);
+    int visited = 0;
+    while (! level.empty()) {
+      vector<AcdfgBin*> nextLevel;
+
+      for (auto bin : level) {
+        const int binId = bin->getId();
+        for (int i = lowerStart[binId]; i < lowerStart[binId + 1]; i++) {
+          AcdfgBin* lowerBin = lower[i];
+          pendingUpper[lowerBin->getId()] -= 1;
+          if (0 == pendingUpper[lowerBin->getId()])
+            nextLevel.push_back(lowerBin);
         }
-      } // End of loop on successors
-    } // End of loop on nodes
-
-    assert(order.size() == allBins.size());
-
-    // // Check topological order -- DEBUG
-    // Lattice::deleteTr(tr);
-    // buildTr(tr);
-    // {
-    //   set<AcdfgBin*> visited;
-
-    //   for (auto bin : order) {
-    //     visited.insert(bin);
+      }
 
-    //     cout << "map is " << tr[bin] << 
-    //       " " << tr[bin]->size() << endl;
-    //     for(AcdfgBin* bin2 : bin->getImmediateSubsumingBins()) {
+      visited += level.size();
+      levels.push_back(level);
+      level.swap(nextLevel);
+    }
 
-    //       cout << "TR FIND " << bin << " " << bin2 << endl;
+    assert(visited == binsCount);
+  }
 
-    //       assert(tr[bin]->find(bin2) != tr[bin]->end());
-    //       assert(inverseTr[bin2]->find(bin) != inverseTr[bin2]->end());
-    //       assert(visited.find(bin2) != visited.end());
-    //     }
-    //   }
-    // }
+  /**
+   * Compute a topological order of the lattice (the bins not subsumed
+   * by any other bin come first).
+   */
+  void Lattice::computeTopologicalOrder(vector<AcdfgBin*> &order) const {
+    vector<vector<AcdfgBin*>> levels;
+    computeTopologicalLevels(levels);
 
-    Lattice::deleteTr(tr);
-    Lattice::deleteTr(inverseTr);
+    for (const auto & level : levels)
+      order.insert(order.end(), level.begin(), level.end());
   }
 
   /**
@@ -575,6 +761,146 @@ namespace fixrgraphiso {
         a->addSubsumingBin(b);
       }
     }
+    subsumingAnomalousBuilt = false;
+  }
+
+  /**
+   * Build the transitively closed relations of the lattice from the
+   * immediately subsuming bins of each bin (indexed by the bin id).
+   *
+   * The bins are visited in topological order, so the closure of a bin
+   * is the union of the closures of the bins immediately above it.
+   */
+  void Lattice::buildFromImmediate(const vector<vector<AcdfgBin*>> & immediateSubsuming) {
+    const int binsCount = allBins.size();
+    vector<int> pendingUpper(binsCount, 0);
+    vector<vector<AcdfgBin*>> immediateLower(binsCount);
+    vector<AcdfgBin*> toProcess;
+
+    assert(immediateSubsuming.size() == binsCount);
+    for (auto bin : allBins) {
+      pendingUpper[bin->getId()] = immediateSubsuming[bin->getId()].size();
+      for (auto upper : immediateSubsuming[bin->getId()])
+        immediateLower[upper->getId()].push_back(bin);
+      if (0 == pendingUpper[bin->getId()])
+        toProcess.push_back(bin);
+    }
+
+    vector<AcdfgBin*> closure;
+    while (! toProcess.empty()) {
+      AcdfgBin* bin = toProcess.back();
+      toProcess.pop_back();
+
+      closure.clear();
+      for (auto upper : immediateSubsuming[bin->getId()]) {
+        closure.push_back(upper);
+        closure.insert(closure.end(), upper->getSubsumingBins().begin(),
+                       upper->getSubsumingBins().end());
+      }
+      std::sort(closure.begin(), closure.end());
+      closure.erase(std::unique(closure.begin(), closure.end()),
+                    closure.end());
+      bin->setSubsumingBins(closure, immediateSubsuming[bin->getId()]);
+
+      for (auto lower : immediateLower[bin->getId()]) {
+        pendingUpper[lower->getId()] -= 1;
+        if (0 == pendingUpper[lower->getId()])
+          toProcess.push_back(lower);
+      }
+    }
+    subsumingAnomalousBuilt = false;
+  }
+
+  /**
+   * Add the relation lower <= upper, keeping the relation closed.
+   *
+   * Assumes the relation is already transitively closed.
+   */
+  void Lattice::addSubsumption(AcdfgBin* lower, AcdfgBin* upper) {
+    if (lower->hasSubsumingBin(upper))
+      return;
+
+    vector<AcdfgBin*> lowers(lower->getIncomingEdges().begin(),
+                             lower->getIncomingEdges().end());
+    lowers.push_back(lower);
+    vector<AcdfgBin*> uppers(upper->getSubsumingBins().begin(),
+                             upper->getSubsumingBins().end());
+    uppers.push_back(upper);
+
+    for (AcdfgBin* l : lowers)
+      for (AcdfgBin* u : uppers)
+        l->addSubsumingBin(u);
+    subsumingAnomalousBuilt = false;
+  }
+
+  void removeFromBins(vector<AcdfgBin*> & bins, AcdfgBin* bin) {
+    bins.erase(std::remove(bins.begin(), bins.end(), bin), bins.end());
+  }
+
+  /**
+   * Remove the bin from the lattice and delete it.
+   *
+   * The relations are transitively closed, so the bins below the removed
+   * bin are already related to the bins above it.
+   */
+  void Lattice::removeBin(AcdfgBin* bin) {
+    vector<AcdfgBin*> lower(bin->getIncomingEdges().begin(),
+                            bin->getIncomingEdges().end());
+    for (AcdfgBin* lowerBin : lower)
+      lowerBin->removeSubsumingBin(bin);
+
+    vector<AcdfgBin*> upper(bin->getSubsumingBins().begin(),
+                            bin->getSubsumingBins().end());
+    for (AcdfgBin* upperBin : upper)
+      bin->removeSubsumingBin(upperBin);
+
+    // the bins above may have lost a popular bin below them
+    for (AcdfgBin* upperBin : upper)
+      upperBin->setChanged(true);
+
+    removeFromBins(allBins, bin);
+    // keep the ids dense
+    for (AcdfgBin* other : allBins) {
+      if (other->getId() == allBins.size()) {
+        other->setId(bin->getId());
+        break;
+      }
+    }
+    removeFromBins(popularBins, bin);
+    removeFromBins(anomalousBins, bin);
+    removeFromBins(isolatedBins, bin);
+    subsumingAnomalousBuilt = false;
+
+    delete bin;
+  }
+
+  /**
+   * Remove the acdfgs from the lattice, deleting the bins left empty.
+   *
+   * Return the number of acdfgs removed.
+   */
+  int Lattice::removeAcdfgs(const vector<string> & acdfgNames) {
+    map<string, AcdfgBin*> nameToBin;
+    for (AcdfgBin* bin : allBins)
+      for (const string & name : bin->getAcdfgNames())
+        nameToBin[name] = bin;
+
+    int removed = 0;
+    for (const string & name : acdfgNames) {
+      auto binIt = nameToBin.find(name);
+      if (binIt == nameToBin.end())
+        continue;
+
+      AcdfgBin* bin = binIt->second;
+      nameToBin.erase(binIt);
+      if (bin->removeAcdfg(name))
+        removed++;
+
+      if (bin->getFrequency() == 0)
+        removeBin(bin);
+    }
+
+    return removed;
   }
 
   int Lattice::countCommonMethods(const Lattice &other) const {
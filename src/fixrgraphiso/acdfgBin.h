@@ -14,6 +14,8 @@
 #include <iostream>
 #include <set>
 #include <chrono>
+#include <algorithm>
+#include <atomic>
 #include "fixrgraphiso/acdfg.h"
 #include "fixrgraphiso/isomorphismClass.h"
 #include "fixrgraphiso/collectStats.h"
@@ -25,6 +27,17 @@ namespace fixrgraphiso {
   using std::cout;
   using std::set;
 
+  class AcdfgBin;
+
+  /**
+   * Decodes the acdfgs of the bins on demand (see LatticeIndex)
+   */
+  class AcdfgLoader {
+  public:
+    virtual ~AcdfgLoader() {}
+    virtual Acdfg* loadRepresentative(const AcdfgBin* bin) = 0;
+  };
+
   class AcdfgBin {
   public:
 
@@ -36,11 +49,22 @@ namespace fixrgraphiso {
     NONE
   };
 
-  AcdfgBin(Acdfg* a, Stats* stats) : subsuming(false),
-      anomalous(false), popular(false), isolated(false) {
+  AcdfgBin(Acdfg* a, Stats* stats) : AcdfgBin(a, stats, true) {}
+
+  /**
+   * When insertRepr is false the representative is not added to the
+   * members of the bin (e.g., the members are filled by the caller).
+   */
+  AcdfgBin(Acdfg* a, Stats* stats, bool insertRepr) : id(-1), subsuming(false),
+      anomalous(false), popular(false), isolated(false), changed(true),
+      loader(NULL) {
     acdfgRepr = a;
-    IsoRepr* iso = new IsoRepr(a);
-    insertEquivalentACDFG(a, iso);
+    if (NULL != a)
+      reprName = a->getName();
+    if (insertRepr) {
+      IsoRepr* iso = new IsoRepr(a);
+      insertEquivalentACDFG(a, iso);
+    }
     isImmediateSubsumingUpdate = true;
     this->stats = stats;
   }
@@ -64,6 +88,7 @@ namespace fixrgraphiso {
     /*   " -- SIZE: " << (iso->getNodesRel()).size() << endl; */
     acdfgNames.push_back(b);
     acdfgNameToIso[b] = iso;
+    changed = true;
   }
 
   void insertEquivalentACDFG(Acdfg * b, IsoRepr* iso){
@@ -77,13 +102,30 @@ namespace fixrgraphiso {
   int getPopularity() const;
 
   const Acdfg* getRepresentative() const{
+    if (NULL == acdfgRepr && NULL != loader)
+      acdfgRepr = loader->loadRepresentative(this);
     return acdfgRepr;
   }
 
   Acdfg * getRepresentative(){
+    if (NULL == acdfgRepr && NULL != loader)
+      acdfgRepr = loader->loadRepresentative(this);
     return acdfgRepr;
   }
 
+  /* Name of the member that is the representative, empty if unknown
+     (e.g., lattices written before it was stored) */
+  const string & getRepresentativeName() const { return reprName; }
+  void setRepresentativeName(const string & name) { reprName = name; }
+
+  /* The representative is decoded by loader on its first access */
+  void setLoader(AcdfgLoader* loader) { this->loader = loader; }
+
+  /* Set the isomorphism of a member of the bin loaded later */
+  void setIso(const string & name, IsoRepr* iso) {
+    acdfgNameToIso[name] = iso;
+  }
+
   void printInfo(std::ostream & out, bool printAbove = true) const;
   void dumpToDot(string fileName) const;
   void dumpToProtobuf(string fileName) const;
@@ -97,10 +139,19 @@ namespace fixrgraphiso {
     return (subsumingBins.find(b) != subsumingBins.end());
   }
   void addSubsumingBin(AcdfgBin * b){
-    subsumingBins.insert(b);
+    if (subsumingBins.insert(b).second)
+      changed = true;
     b->insertIncomingEdge(this);
     isImmediateSubsumingUpdate = false;
   }
+  void setSubsumingBins(const vector<AcdfgBin*> & subsuming,
+                        const vector<AcdfgBin*> & immediateSubsuming);
+  void removeSubsumingBin(AcdfgBin * b){
+    subsumingBins.erase(b);
+    b->incomingEdges.erase(this);
+    isImmediateSubsumingUpdate = false;
+    changed = true;
+  }
 
   void computeImmediatelySubsumingBins();
 
@@ -144,10 +195,25 @@ namespace fixrgraphiso {
     return incomingEdges;
   }
 
+  /* Anomalous bins subsuming a popular bin, most specific first (see
+     Lattice::buildSubsumingAnomalous) */
+  const vector<AcdfgBin*> & getSubsumingAnomalous() const {
+    return subsumingAnomalous;
+  }
+  void setSubsumingAnomalous(const vector<AcdfgBin*> & anomalous) {
+    subsumingAnomalous = anomalous;
+  }
+
   const map<string, IsoRepr*> & getAcdfgNameToIso() const {
     return acdfgNameToIso;
   }
 
+  bool hasAcdfg(const string & name) const {
+    return acdfgNameToIso.find(name) != acdfgNameToIso.end();
+  }
+
+  bool removeAcdfg(const string & name);
+
   void getRepr(std::ostream& out) const {
     out << this <<
       ", " << this->getCumulativeFrequency() <<
@@ -163,11 +229,25 @@ namespace fixrgraphiso {
 
   Stats* getStats() { return stats; }
 
+  /* True if the frequency or the subsuming bins changed since the
+     last classification */
+  bool isChanged() const { return changed; }
+  void setChanged(bool changed) { this->changed = changed; }
+
+  /* Dense id of the bin in the lattice, in [0, number of bins) */
+  int getId() const { return id; }
+  void setId(int id) { this->id = id; }
+
   protected:
   void addSubsumingBinsToSet(set<AcdfgBin*> & what) ;
+  bool isReprIso(const IsoRepr* iso) const;
+
+  int id;
 
   /* List of acdfgs contained in the Bin */
-  Acdfg* acdfgRepr;
+  // atomic, since concurrent searches may decode it with the loader
+  mutable std::atomic<Acdfg*> acdfgRepr;
+  string reprName;
   vector<string> acdfgNames;
   map<string, IsoRepr*> acdfgNameToIso;
 
@@ -183,6 +263,8 @@ namespace fixrgraphiso {
   set<AcdfgBin*> immediateSubsumingBins;
   /* List of bins that are subsumed this bin */
   set<AcdfgBin*> incomingEdges;
+  /* Anomalous bins in subsumingBins, only for the popular bins */
+  vector<AcdfgBin*> subsumingAnomalous;
 
   /* True if the bin subsumes a popular bin */
   bool subsuming;
@@ -193,10 +275,64 @@ namespace fixrgraphiso {
   // store the cumulative frequency of the bin
   int cumulativeFrequency;
   bool isImmediateSubsumingUpdate;
+  bool changed;
+  AcdfgLoader* loader;
 
   Stats *stats;
   };
 
+  /**
+   * Set of bins of a lattice indexed by the bin id.
+   *
+   * The set is cleared in constant time incrementing the epoch: a bin is
+   * in the set iff its mark is the current epoch.
+   */
+  class BinSet {
+  public:
+    BinSet() : epoch(1) {}
+
+    void clear(int binsCount) {
+      if (marks.size() < binsCount)
+        marks.resize(binsCount, 0);
+      epoch++;
+      if (0 == epoch) {
+        std::fill(marks.begin(), marks.end(), 0);
+        epoch = 1;
+      }
+    }
+
+    bool contains(const AcdfgBin* bin) const {
+      int id = bin->getId();
+      return id < marks.size() && marks[id] == epoch;
+    }
+
+    void insert(const AcdfgBin* bin) {
+      assert(bin->getId() >= 0 && bin->getId() < marks.size());
+      marks[bin->getId()] = epoch;
+    }
+
+  private:
+    vector<unsigned int> marks;
+    unsigned int epoch;
+  };
+
+  /**
+   * Parameters used to classify the bins of a lattice
+   */
+  struct ClassificationParams {
+    bool relative;
+    int freqCutoff;
+    double relativeThreshold;
+    int anomalyCutOff;
+
+    bool operator==(const ClassificationParams & other) const {
+      return relative == other.relative &&
+        freqCutoff == other.freqCutoff &&
+        relativeThreshold == other.relativeThreshold &&
+        anomalyCutOff == other.anomalyCutOff;
+    }
+  };
+
   class Lattice {
   public:
     Lattice() {};
@@ -233,19 +369,50 @@ namespace fixrgraphiso {
                    map<AcdfgBin*, set<AcdfgBin*>*> & inverse) const;
     static void deleteTr(map<AcdfgBin*, set<AcdfgBin*>*> & tr);
     void computeTopologicalOrder(vector<AcdfgBin*> &order) const;
+    void computeTopologicalLevels(vector<vector<AcdfgBin*>> &levels) const;
 
     void makeClosure();
+    void buildFromImmediate(const vector<vector<AcdfgBin*>> & immediateSubsuming);
+
+    void addSubsumption(AcdfgBin* lower, AcdfgBin* upper);
+
+    void removeBin(AcdfgBin* bin);
+    int removeAcdfgs(const vector<string> & acdfgNames);
 
     void sortByFrequency();
 
     void sortAllByFrequency();
+    static void sortBinsByFrequency(vector<AcdfgBin*> &binVector);
 
     void resetClassification();
 
+    void rebuildClassifiedBins(bool skipSubsuming);
+
+    static void computeSubsumingAnomalous(const AcdfgBin* popular,
+                                          vector<AcdfgBin*> & anomalous);
+    void buildSubsumingAnomalous();
+    void setSubsumingAnomalous(const map<AcdfgBin*, vector<AcdfgBin*>> & popularToAnomalous);
+    /* True if the anomalous bins of the popular bins are up to date */
+    bool hasSubsumingAnomalous() const { return subsumingAnomalousBuilt; }
+
+    bool isClassified() const { return classified; }
+    const ClassificationParams & getClassification() const {
+      return classification;
+    }
+    void setClassification(const ClassificationParams & params) {
+      classification = params;
+      classified = true;
+    }
+
+    void clearChanged();
+    bool hasChangedBins() const;
+
     void dumpAllBins(std::chrono::seconds time_taken,
                      const string & output_prefix,
                      const string & infoFileName,
-                     const string & latticeFileName);
+                     const string & latticeFileName,
+                     int formatVersion,
+                     bool reducedRelations);
 
     void dumpToDot(const string & dotFile,
                    const bool onlyClassified);
@@ -266,6 +433,10 @@ namespace fixrgraphiso {
     vector<AcdfgBin*> anomalousBins;
     vector<AcdfgBin*> isolatedBins;
     Stats stats;
+
+    bool classified = false;
+    ClassificationParams classification;
+    bool subsumingAnomalousBuilt = false;
   };
 
 }
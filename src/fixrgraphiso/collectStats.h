@@ -50,6 +50,20 @@ namespace fixrgraphiso{
       }
     }
 
+    /** Accumulate the statistics collected in other */
+    void merge(const Stats & other){
+      this->numSATCalls += other.numSATCalls;
+      this->numSubsumptionChecks += other.numSubsumptionChecks;
+      this->totalGraphs += other.totalGraphs;
+      this->totalNodes += other.totalNodes;
+      this->totalEdges += other.totalEdges;
+      if (other.maxNodes > this->maxNodes) this->maxNodes = other.maxNodes;
+      if (other.maxEdges > this->maxEdges) this->maxEdges = other.maxEdges;
+      if (other.minNodes < this->minNodes) this->minNodes = other.minNodes;
+      if (other.minEdges < this->minEdges) this->minEdges = other.minEdges;
+      this->satSolverTime = this->satSolverTime + other.satSolverTime;
+    }
+
     void print(std::ostream & out){
       out << "# Graphs : " << this->totalGraphs << std::endl;
       if (this->totalGraphs > 0){
@@ -0,0 +1,98 @@
+// -*- C++ -*-
+//
+// Read and write protobuf files compressed with gzip
+//
+
+#include <google/protobuf/io/gzip_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl.h>
+#include "fixrgraphiso/compression.h"
+
+namespace fixrgraphiso {
+  using google::protobuf::io::GzipInputStream;
+  using google::protobuf::io::GzipOutputStream;
+  using google::protobuf::io::IstreamInputStream;
+  using google::protobuf::io::OstreamOutputStream;
+
+  static Compression outputCompression = COMPRESSION_NONE;
+
+  void setOutputCompression(Compression compression) {
+    outputCompression = compression;
+  }
+
+  Compression getOutputCompression() {
+    return outputCompression;
+  }
+
+  bool isGzipData(const char* data, size_t size) {
+    return size >= 2 &&
+      0x1f == (unsigned char) data[0] && 0x8b == (unsigned char) data[1];
+  }
+
+  bool isGzipStream(std::istream & in) {
+    char magic[2];
+    std::streampos start = in.tellg();
+    in.read(magic, 2);
+    bool res = in.gcount() == 2 && isGzipData(magic, 2);
+    in.clear();
+    in.seekg(start);
+    return res;
+  }
+
+  ProtoInputStream::ProtoInputStream(std::istream & in) {
+    bool compressed = isGzipStream(in);
+    raw = new IstreamInputStream(&in);
+    if (compressed)
+      input = new GzipInputStream(raw, GzipInputStream::GZIP);
+    else
+      input = raw;
+  }
+
+  ProtoInputStream::~ProtoInputStream() {
+    if (input != raw)
+      delete input;
+    delete raw;
+  }
+
+  ProtoOutputStream::ProtoOutputStream(std::ostream & out) : closed(false) {
+    raw = new OstreamOutputStream(&out);
+    if (COMPRESSION_GZIP == outputCompression) {
+      GzipOutputStream::Options options;
+      options.format = GzipOutputStream::GZIP;
+      output = new GzipOutputStream(raw, options);
+    } else {
+      output = raw;
+    }
+  }
+
+  ProtoOutputStream::~ProtoOutputStream() {
+    close();
+    if (output != raw)
+      delete output;
+    delete raw;
+  }
+
+  bool ProtoOutputStream::close() {
+    bool res = true;
+    if (! closed && output != raw)
+      res = ((GzipOutputStream*) output)->Close();
+    closed = true;
+    return res;
+  }
+
+  bool parseFromStream(std::istream & in,
+                       google::protobuf::MessageLite* message) {
+    ProtoInputStream input(in);
+    return message->ParseFromZeroCopyStream(input.get());
+  }
+
+  bool serializeToStream(const google::protobuf::MessageLite & message,
+                         std::ostream & out) {
+    bool res;
+    {
+      ProtoOutputStream output(out);
+      res = message.SerializeToZeroCopyStream(output.get()) && output.close();
+    }
+    return res && out.good();
+  }
+
+} // end fixrgraphiso namespace
@@ -0,0 +1,65 @@
+// -*- C++ -*-
+//
+// Read and write protobuf files compressed with gzip
+//
+
+#ifndef COMPRESSION_H_INCLUDED
+#define COMPRESSION_H_INCLUDED
+
+#include <iostream>
+#include <google/protobuf/message_lite.h>
+#include <google/protobuf/io/zero_copy_stream.h>
+
+namespace fixrgraphiso {
+
+  enum Compression { COMPRESSION_NONE, COMPRESSION_GZIP };
+
+  /* Compression of the protobuf files written by the tools (-Z) */
+  void setOutputCompression(Compression compression);
+  Compression getOutputCompression();
+
+  /* True if data starts with the gzip magic bytes */
+  bool isGzipData(const char* data, size_t size);
+  /* True if the stream starts with the gzip magic bytes (the stream
+     is rewound) */
+  bool isGzipStream(std::istream & in);
+
+  /**
+   * Input stream reading the bytes of in, decompressing them if in is
+   * compressed (detected from the first bytes)
+   */
+  class ProtoInputStream {
+  public:
+    ProtoInputStream(std::istream & in);
+    ~ProtoInputStream();
+    google::protobuf::io::ZeroCopyInputStream* get() { return input; }
+  private:
+    google::protobuf::io::ZeroCopyInputStream* raw;
+    google::protobuf::io::ZeroCopyInputStream* input;
+  };
+
+  /**
+   * Output stream writing to out, compressing the bytes with the
+   * output compression
+   */
+  class ProtoOutputStream {
+  public:
+    ProtoOutputStream(std::ostream & out);
+    ~ProtoOutputStream();
+    google::protobuf::io::ZeroCopyOutputStream* get() { return output; }
+    /* Flush the compressed data, return false on errors */
+    bool close();
+  private:
+    google::protobuf::io::ZeroCopyOutputStream* raw;
+    google::protobuf::io::ZeroCopyOutputStream* output;
+    bool closed;
+  };
+
+  bool parseFromStream(std::istream & in,
+                       google::protobuf::MessageLite* message);
+  bool serializeToStream(const google::protobuf::MessageLite & message,
+                         std::ostream & out);
+
+} // end fixrgraphiso namespace
+
+#endif // COMPRESSION_H_INCLUDED
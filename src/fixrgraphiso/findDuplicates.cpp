@@ -2,6 +2,7 @@
 #include "fixrgraphiso/serialization.h"
 #include "fixrgraphiso/serializationLattice.h"
 #include "fixrgraphiso/acdfgBin.h"
+#include "fixrgraphiso/parallel.h"
 
 #include <tuple>
 #include <fstream>
@@ -79,18 +80,40 @@ namespace fixrgraphiso {
   }
 
   int findDuplicatesList(const vector<pair<string,int>> &latticeNamesList,
-                         dup_tuple &identicalBins) {
+                         dup_tuple &identicalBins,
+                         int numThreads) {
 
     vector<tuple<int, Lattice*, map<AcdfgBin*,int>* >> all_lattices;
 
     cout << "Reading lattices..." << endl;
     for (auto i1 = latticeNamesList.begin();
          i1 != latticeNamesList.end(); ++i1) {
-      Lattice* lattice;
       map<AcdfgBin*,int>* acdfgBin2id = new map<AcdfgBin*,int>();
-      lattice = fixrgraphiso::readLattice(i1->first, *acdfgBin2id);
+      all_lattices.push_back(make_tuple(i1->second, (Lattice*) NULL,
+                                        acdfgBin2id));
+    }
 
-      all_lattices.push_back(make_tuple(i1->second, lattice, acdfgBin2id));
+    // The lattices are independent, read them concurrently
+    parallelFor(0, all_lattices.size(), numThreads, [&](int i) {
+        std::get<1>(all_lattices[i]) =
+          fixrgraphiso::readLattice(latticeNamesList[i].first,
+                                    *std::get<2>(all_lattices[i]));
+      }, 1);
+
+    int res = 0;
+    for (int i = 0; i < all_lattices.size(); i++) {
+      if (NULL == std::get<1>(all_lattices[i])) {
+        cerr << "Cannot read the lattice in " <<
+          latticeNamesList[i].first << endl;
+        res = 1;
+      }
+    }
+    if (0 != res) {
+      for (auto lattice : all_lattices) {
+        delete std::get<1>(lattice);
+        delete std::get<2>(lattice);
+      }
+      return res;
     }
 
     int i = 0;
@@ -175,9 +198,14 @@ namespace fixrgraphiso {
 
   int findDuplicatesList(const string &latticeListFileName,
                          dup_tuple &identicalBins) {
+    return findDuplicatesList(latticeListFileName, identicalBins, 1);
+  }
 
-    vector<pair<string,int>> latticeNamesList;
-
+  /**
+   * Read a list of lattices, one "<id> <lattice_file>" per line
+   */
+  int readLatticeList(const string &latticeListFileName,
+                      vector<pair<string,int>> &latticeNamesList) {
     std::ifstream listFile(latticeListFileName);
 
     if (listFile.is_open()) {
@@ -204,8 +232,19 @@ namespace fixrgraphiso {
       return 1;
     }
 
+    return 0;
+  }
+
+  int findDuplicatesList(const string &latticeListFileName,
+                         dup_tuple &identicalBins,
+                         int numThreads) {
+
+    vector<pair<string,int>> latticeNamesList;
+
+    if (0 != readLatticeList(latticeListFileName, latticeNamesList))
+      return 1;
 
-    return findDuplicatesList(latticeNamesList, identicalBins);
+    return findDuplicatesList(latticeNamesList, identicalBins, numThreads);
   }
 
   int writeDuplicateList(const dup_tuple &identicalBins,
@@ -1,6 +1,7 @@
 #include <string>
 #include <vector>
 #include <tuple>
+#include <utility>
 
 #ifndef D__FIND_DUPLICATES__H_
 #define D__FIND_DUPLICATES__H_
@@ -8,6 +9,7 @@
 using std::string;
 using std::vector;
 using std::tuple;
+using std::pair;
 
 namespace fixrgraphiso {
 
@@ -17,8 +19,14 @@ namespace fixrgraphiso {
                      const string &latticeFileName_2, const int id_2,
                      dup_tuple &identicalBins);
 
+  int readLatticeList(const string &latticeListFileName,
+                      vector<pair<string,int>> &latticeNamesList);
+
   int findDuplicatesList(const string &latticeListFileName,
                          dup_tuple &identicalBins);
+  int findDuplicatesList(const string &latticeListFileName,
+                         dup_tuple &identicalBins,
+                         int numThreads);
 
   int writeDuplicateList(const dup_tuple &identicalBins,
                          const string outFileName);
@@ -18,9 +18,10 @@ using std::pair;
 
 void printHelp() {
   cerr << "findDuplicates " <<
-    "-f <lattice_file_list>" << endl <<
+    "-f <lattice_file_list> -o <result_file> [-j <threads>]" << endl <<
     "\t <result_file>: path to the file containing patterns common to " <<
-    "lattice 1 and lattice 2" << endl;
+    "lattice 1 and lattice 2" << endl <<
+    "\t <threads>: number of threads reading the lattices (0 is one per core)" << endl;
 }
 
 int main(int argc, char * argv[]) {
@@ -31,10 +32,12 @@ int main(int argc, char * argv[]) {
   string* latticeFileList = NULL;
   string* outFileName = NULL;
 
+  int numThreads = 1;
+
   fixrgraphiso::dup_tuple identicalBins;
 
   char c;
-  while ((c = getopt(argc, argv, "f:o:")) != -1) {
+  while ((c = getopt(argc, argv, "f:o:j:")) != -1) {
     switch (c){
     case 'f': {
       latticeFileList = new string(optarg);
@@ -44,6 +47,10 @@ int main(int argc, char * argv[]) {
       outFileName = new string(optarg);
       break;
     }
+    case 'j': {
+      numThreads = strtol(optarg, NULL, 10);
+      break;
+    }
     default:
       printHelp();
       return 1;
@@ -57,7 +64,8 @@ int main(int argc, char * argv[]) {
   }
 
   int res = fixrgraphiso::findDuplicatesList(*latticeFileList,
-                                             identicalBins);
+                                             identicalBins,
+                                             numThreads);
 
   if (res == 0) {
     res = fixrgraphiso::writeDuplicateList(identicalBins, *outFileName);
@@ -0,0 +1,34 @@
+// -*- C++ -*-
+//
+// Fingerprint of the content of the files (e.g., the lattices)
+//
+
+#ifndef FINGERPRINT_H_INCLUDED
+#define FINGERPRINT_H_INCLUDED
+
+#include <cstddef>
+#include <stdint.h>
+
+namespace fixrgraphiso {
+
+  static const uint64_t FNV_OFFSET = 14695981039346656037ULL;
+
+  /**
+   * Update the 64 bits FNV-1a hash with the data: the hash of data split
+   * in chunks is the hash of the chunks, starting from FNV_OFFSET.
+   */
+  inline uint64_t fnvUpdate(uint64_t hash, const char* data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+      hash ^= (unsigned char) data[i];
+      hash *= 1099511628211ULL;
+    }
+    return hash;
+  }
+
+  inline uint64_t fnvHash(const char* data, size_t size) {
+    return fnvUpdate(FNV_OFFSET, data, size);
+  }
+
+} // end fixrgraphiso namespace
+
+#endif // FINGERPRINT_H_INCLUDED
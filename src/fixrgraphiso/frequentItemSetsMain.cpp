@@ -16,6 +16,7 @@
 #include "fixrgraphiso/proto_iso.pb.h"
 #include "fixrgraphiso/proto_acdfg.pb.h"
 #include "fixrgraphiso/itemSetDB.h"
+#include "fixrgraphiso/compression.h"
 
 
 namespace iso_protobuf = edu::colorado::plv::fixr::protobuf;
@@ -37,7 +38,7 @@ namespace fixrgraphiso{
     std::fstream inp_file(file_name.c_str(), std::ios::in | std::ios::binary);
     iso_protobuf::Acdfg * acdfg = new iso_protobuf::Acdfg();
     if (inp_file.is_open()){
-      acdfg -> ParseFromIstream(&inp_file);
+      parseFromStream(inp_file, acdfg);
     } else {
 
       assert(false);
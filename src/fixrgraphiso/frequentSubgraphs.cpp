@@ -6,7 +6,10 @@
 #include <algorithm>
 #include <string>
 #include <cctype>
+#include <sstream>
+#include <random>
 #include <stdlib.h>
+#include <stdint.h>
 #include <unistd.h>
 #include "fixrgraphiso/proto_iso.pb.h"
 #include "fixrgraphiso/proto_acdfg.pb.h"
@@ -16,6 +19,9 @@
 #include "fixrgraphiso/acdfgBin.h"
 #include "fixrgraphiso/frequentSubgraphs.h"
 #include "fixrgraphiso/serializationLattice.h"
+#include "fixrgraphiso/parallel.h"
+#include "fixrgraphiso/latticeIndex.h"
+#include "fixrgraphiso/compression.h"
 
 using std::cout;
 using std::endl;
@@ -92,10 +98,36 @@ namespace fixrgraphiso {
     }
   }
 
+  void splitList(const string & list, vector<string> & values) {
+    std::stringstream stream(list);
+    string value;
+    while (std::getline(stream, value, ',')) {
+      if (! value.empty())
+        values.push_back(value);
+    }
+  }
+
+  bool isValidInsertionOrder(const string & policy) {
+    return policy == "size-asc" || policy == "size-desc" ||
+      policy == "methods" || policy == "duplicates" ||
+      policy == "random" || policy.compare(0, 7, "random:") == 0;
+  }
+
   void FrequentSubgraphMiner::saveState(Lattice &lattice, bool toSave) {
     if (toSave) {
       cout << "Saving lattice... " << endl;
-      fixrgraphiso::writeLattice(lattice, lattice_filename);
+      fixrgraphiso::writeLattice(lattice, lattice_filename, format_version,
+                                 reduced_relations);
+      writeLatticeIndex();
+    }
+  }
+
+  void FrequentSubgraphMiner::writeLatticeIndex() {
+    if (write_index) {
+      string indexFileName = LatticeIndex::getIndexFileName(lattice_filename);
+      if (0 != LatticeIndex::write(lattice_filename, indexFileName))
+        std::cerr << "Cannot write the lattice index " << indexFileName <<
+          endl;
     }
   }
 
@@ -104,7 +136,7 @@ namespace fixrgraphiso {
                                                 vector<string> & methodNames) {
     char c;
     int index;
-    while ((c = getopt(argc, argv, "dm:f:t:o:i:zp:l:cr:sa"))!= -1) {
+    while ((c = getopt(argc, argv, "dm:f:t:o:i:zp:l:cr:sab:x:O:w:W:j:V:RIZ"))!= -1) {
       switch (c){
       case 'm': {
         string methodNamesFile = optarg;
@@ -152,6 +184,67 @@ namespace fixrgraphiso {
         output_prefix = string(optarg);
         cout << "Output patterns will be dumped in: " << output_prefix << endl;
         break;
+      case 'x':
+        {
+          string removeFileName = optarg;
+          cout << "Loading the ACDFGs to remove" << endl;
+          loadNamesFromFile(removeFileName, toRemove);
+          removeAcdfgs = true;
+        }
+        break;
+      case 'w':
+        {
+          vector<string> values;
+          splitList(optarg, values);
+          for (const string & value : values)
+            sweep_abs_cutoffs.push_back(strtol(value.c_str(), NULL, 10));
+        }
+        break;
+      case 'W':
+        {
+          vector<string> values;
+          splitList(optarg, values);
+          for (const string & value : values)
+            sweep_rel_thresholds.push_back(std::stod(value, NULL));
+        }
+        break;
+      case 'O':
+        insertion_order = string(optarg);
+        if (! isValidInsertionOrder(insertion_order)) {
+          std::cerr << "Unknown insertion order " << insertion_order <<
+            " (use size-asc, size-desc, methods, duplicates " <<
+            "or random[:seed])" << endl;
+          return 1;
+        }
+        std::cout << "Insertion order: " << insertion_order << endl;
+        break;
+      case 'b':
+        batch_size = strtol(optarg, NULL, 10);
+        std::cout << "Insert the acdfgs in batches of " << batch_size << endl;
+        break;
+      case 'j':
+        num_threads = strtol(optarg, NULL, 10);
+        std::cout << "Classify the bins using " <<
+          getNumThreads(num_threads) << " threads" << endl;
+        break;
+      case 'V':
+        format_version = strtol(optarg, NULL, 10);
+        if (LATTICE_FORMAT_V1 != format_version &&
+            LATTICE_FORMAT_V2 != format_version) {
+          std::cerr << "Unknown lattice format version " << format_version <<
+            " (use 1 or 2)" << endl;
+          return 1;
+        }
+        break;
+      case 'R':
+        reduced_relations = true;
+        break;
+      case 'I':
+        write_index = true;
+        break;
+      case 'Z':
+        setOutputCompression(COMPRESSION_GZIP);
+        break;
       case 'r':
         // Use relative popularity (comulative frequency) to mark the popular pattern
         use_relative_popularity = true;
@@ -163,25 +256,56 @@ namespace fixrgraphiso {
       }
     }
 
+    if (reduced_relations && LATTICE_FORMAT_V1 == format_version) {
+      std::cerr << "The reduced relations (-R) need the lattice format 2" <<
+        endl;
+      return 1;
+    }
+    if (write_index && COMPRESSION_GZIP == getOutputCompression()) {
+      std::cerr << "The lattice index (-I) needs an uncompressed lattice" <<
+        endl;
+      return 1;
+    }
+
     for (index = optind; index < argc; ++index){
       string fname(argv[index]);
       filenames.push_back(fname);
       std::cout << index <<  "--> " << fname << endl;
     }
 
-    if (filenames.size() <= 0 && (! rerunClassification) ){
+    bool sweep = sweep_abs_cutoffs.size() > 0 ||
+      sweep_rel_thresholds.size() > 0;
+    if (filenames.size() <= 0 && (! rerunClassification) &&
+        (! removeAcdfgs) && (! sweep)){
       cout << "Usage --- (default) mine frequent patterns: " << argv[0] <<
         " -f [frequency cutoff] -o [output info filename] " <<
         "-l [lattice file protobuf] " <<
         "-m [file with method names] -i [file with acdfg names] " <<
         "-p [output path for the found patterns] " <<
-        "-a " <<
+        "-a [-b batch size] " <<
+        "[-V lattice format version, 1 or 2] " <<
+        "[-R store the reduced relations] " <<
+        "[-I write the lattice index] " <<
+        "[-Z compress the output files with gzip] " <<
+        "[-O size-asc|size-desc|methods|duplicates|random[:seed]] " <<
         "[list of acdfg.bin files to mine]" << endl <<
         //
         "Usage --- classify bins, re-run the bin classification: " << argv[0] <<
         "-c " <<
         "-f [frequency cutoff] -o [output info filename] " <<
         "-l [lattice file protobuf] " <<
+        "-p [output path for the found patterns] " <<
+        "[-j number of threads, 0 for one per core] " << endl <<
+        //
+        "Usage --- classify the bins for many thresholds: " << argv[0] <<
+        " -l [lattice file protobuf] " <<
+        "-w [comma separated list of frequency cutoffs] " <<
+        "-W [comma separated list of relative thresholds]" << endl <<
+        //
+        "Usage --- remove acdfgs from the lattice: " << argv[0] <<
+        " -x [file with the acdfg names to remove] " <<
+        "-f [frequency cutoff] -o [output info filename] " <<
+        "-l [lattice file protobuf] " <<
         "-p [output path for the found patterns] " << endl <<
         //
         "Usage --- subsumption test:" << argv[0] <<
@@ -261,13 +385,24 @@ namespace fixrgraphiso {
    * This is the SANER2018 approach.
    */
   void FrequentSubgraphMiner::findPopularByAbsFrequency(Lattice &lattice) {
-    for (auto it = lattice.beginAllBins(); it != lattice.endAllBins(); ++it){
-      AcdfgBin * a = *it;
+    const vector<AcdfgBin*> & allBins = lattice.getAllBins();
+    vector<char> atFrontier(allBins.size(), 0);
 
-      a -> setCumulativeFrequency(a->getPopularity());
+    for (auto a : allBins)
       a -> computeImmediatelySubsumingBins();
+
+    // The frontier does not depend on the bins already marked as popular
+    parallelFor(0, allBins.size(), num_threads, [&](int i) {
+        AcdfgBin * a = allBins[i];
+        a -> setCumulativeFrequency(a->getPopularity());
+        atFrontier[i] = a -> isAtFrontierOfPopularity(freq_cutoff);
+      });
+
+    for (int i = 0; i < allBins.size(); i++) {
+      AcdfgBin * a = allBins[i];
+
       if (a -> isSubsuming()) continue;
-      if (a -> isAtFrontierOfPopularity(freq_cutoff)){
+      if (atFrontier[i]){
         a -> setPopular();
         if (debug){
           std::cout << "Found popular bin with frequency : " <<
@@ -284,95 +419,149 @@ namespace fixrgraphiso {
     }
   }
 
+  /**
+   * Row of bits indexed by the bin id
+   */
+  typedef vector<uint64_t> bin_row_t;
+
+  inline void setBit(bin_row_t & row, int id) {
+    row[id / 64] |= ((uint64_t) 1) << (id % 64);
+  }
+
+  inline void clearBit(bin_row_t & row, int id) {
+    row[id / 64] &= ~(((uint64_t) 1) << (id % 64));
+  }
+
   /**
    * Compute the popularity of the bins in the lattice, marking patterns
    * as popular.
    *
+   * For each bin we keep the set (a row of bits) of bins above it that
+   * are not already counted in a popular bin. The row of a bin is released
+   * as soon as all the bins immediately below it are processed.
+   *
+   * The bins in the same topological level are processed in parallel.
    */
   void FrequentSubgraphMiner::computePopularity(Lattice &lattice,
-                                                const vector<AcdfgBin*> &order,
+                                                const vector<vector<AcdfgBin*>> &levels,
                                                 const bool no_subsumed_popular,
                                                 const bool is_relative,
                                                 const double popularity_threshold) {
     int totalFrequency = 0; // total number of samples in the lattice
-    map<AcdfgBin*, int> cumulativeFrequency; // cumulativeFrequency for each bin
-    map<AcdfgBin*, set<AcdfgBin*>*> notCountedSubsumedBinsMap;
+    const int binsCount = lattice.getAllBins().size();
+    const int rowSize = (binsCount + 63) / 64;
+    vector<int> frequency(binsCount, 0);
+    vector<int> cumulativeFrequency(binsCount, 0);
+    // number of bins immediately below a bin still to process
+    vector<int> pendingLower(binsCount, 0);
+    vector<bin_row_t*> notCountedSubsumedBinsRows(binsCount, NULL);
 
     assert((! is_relative) || (popularity_threshold >= 0 && popularity_threshold <= 1));
 
     // Init data structures.
     for (auto it = lattice.beginAllBins(); it != lattice.endAllBins(); ++it) {
       AcdfgBin* bin = *it;
+      assert(bin->getId() >= 0 && bin->getId() < binsCount);
       totalFrequency += bin->getFrequency();
-      cumulativeFrequency[bin] = 0;
-    }
+      frequency[bin->getId()] = bin->getFrequency();
 
-    for (auto bin : order) {
-      assert(notCountedSubsumedBinsMap.find(bin) == notCountedSubsumedBinsMap.end());
-      notCountedSubsumedBinsMap[bin] = new set<AcdfgBin*>();
-
-      set<AcdfgBin*>* notCountedSubsumedBins = notCountedSubsumedBinsMap[bin];
-      set<AcdfgBin*> toRemove;
-
-      notCountedSubsumedBins->insert(bin);
+      for (auto toBin : bin->getImmediateSubsumingBins())
+        pendingLower[toBin->getId()] += 1;
+    }
 
-      for (auto toBin : bin->getImmediateSubsumingBins()) {
-        assert(notCountedSubsumedBinsMap.find(toBin) != notCountedSubsumedBinsMap.end());
+    for (const vector<AcdfgBin*> & level : levels) {
+      vector<char> popularInLevel(level.size(), 0);
+
+      // The bins immediately subsuming the ones in the level are in
+      // the previous levels, so their rows and popular flags are final
+      parallelFor(0, level.size(), num_threads, [&](int levelIndex) {
+          AcdfgBin* bin = level[levelIndex];
+          const int binId = bin->getId();
+          assert(NULL == notCountedSubsumedBinsRows[binId]);
+          bin_row_t* notCountedSubsumedBins = new bin_row_t(rowSize, 0);
+          notCountedSubsumedBinsRows[binId] = notCountedSubsumedBins;
+
+          setBit(*notCountedSubsumedBins, binId);
+
+          const set<AcdfgBin*> & immediateSubsuming =
+            bin->getImmediateSubsumingBins();
+          for (auto toBin : immediateSubsuming) {
+            if (! toBin->isPopular()) {
+              // "propagates" down in the lattice all the bins that are not popular
+              bin_row_t* toBinRow = notCountedSubsumedBinsRows[toBin->getId()];
+              assert(NULL != toBinRow);
+              for (int i = 0; i < rowSize; i++)
+                (*notCountedSubsumedBins)[i] |= (*toBinRow)[i];
+            }
+          }
 
-        for(auto toCount : (*notCountedSubsumedBinsMap[toBin])) {
-          if (! toBin->isPopular()) {
-            // "propagates" down in the lattice all the bins that are not popular
-            notCountedSubsumedBins->insert(toCount);
-          } else {
-            // Removes all the bins already accounted for in a previous popular bin
-            // Note: we remove them later from the notCountedSubsumedBins
-            toRemove.insert(toBin);
+          // Removes all the bins already accounted for in a previous popular bin
+          for (auto toBin : immediateSubsuming) {
+            if (toBin->isPopular())
+              clearBit(*notCountedSubsumedBins, toBin->getId());
           }
-        }
-      }
 
-      for (auto toCount : toRemove)
-        notCountedSubsumedBins->erase(toCount);
+          // Compute the popularity using the bins in notCountedSubsumedBins
+          int cumulativeFrequencyBin = 0;
+          for (int i = 0; i < rowSize; i++) {
+            uint64_t word = (*notCountedSubsumedBins)[i];
+            while (0 != word) {
+              int bit = __builtin_ctzll(word);
+              cumulativeFrequencyBin += frequency[i * 64 + bit];
+              word &= word - 1;
+            }
+          }
 
-      {
-        // Compute the popularity using the bins in notCountedSubsumedBins
-        int cumulativeFrequencyBin = 0;
-        for (auto toCount : *notCountedSubsumedBins) {
-          cumulativeFrequencyBin += toCount->getFrequency();
-        }
+          cumulativeFrequency[binId] = cumulativeFrequencyBin;
 
-        cumulativeFrequency[bin] = cumulativeFrequencyBin;
+          double to_compare = (double) cumulativeFrequencyBin;
+          if (is_relative)
+            to_compare = to_compare / totalFrequency;
 
-        double to_compare = (double) cumulativeFrequencyBin;
-        if (is_relative)
-          to_compare = to_compare / totalFrequency;
+          /* Popular if:
+           *   - to_compare > popularity_treshold
+           *   - if no_subsumed_popular is true, there are no
+           *     subsuming bins of bin that are popular
+           */
+          popularInLevel[levelIndex] = to_compare > popularity_threshold &&
+            ((! no_subsumed_popular) ||  (! bin->hasPopularAncestor()));
+        });
 
-        /* Popular if:
-         *   - to_compare > popularity_treshold
-         *   - if no_subsumed_popular is true, there are no
-         *     subsuming bins of bin that are popular
-         */
-        if (to_compare > popularity_threshold &&
-            ((! no_subsumed_popular) ||  (! bin->hasPopularAncestor()))) {
+      for (int levelIndex = 0; levelIndex < level.size(); levelIndex++) {
+        AcdfgBin* bin = level[levelIndex];
+        if (popularInLevel[levelIndex]) {
           if (debug){
             std::cout << "Found popular: " << bin << endl <<
-              "Cumulative frequency: " << cumulativeFrequencyBin << endl <<
-              "Compared with: " << to_compare << endl <<
+              "Cumulative frequency: " << cumulativeFrequency[bin->getId()] << endl <<
               "Frequency: " << bin->getFrequency() << endl;
           }
           bin->setPopular(true);
         }
       }
-    }
 
-    // delete the sets
-    // could free the memory earlier keeping track of the dependencies in the dag
-    for (auto pair : notCountedSubsumedBinsMap) {
-      delete pair.second;
+      // Release the rows that are not needed anymore
+      for (auto bin : level) {
+        for (auto toBin : bin->getImmediateSubsumingBins()) {
+          int toBinId = toBin->getId();
+          pendingLower[toBinId] -= 1;
+          if (0 == pendingLower[toBinId]) {
+            delete notCountedSubsumedBinsRows[toBinId];
+            notCountedSubsumedBinsRows[toBinId] = NULL;
+          }
+        }
+      }
+
+      // No bins below, the row is not needed anymore
+      for (auto bin : level) {
+        if (0 == pendingLower[bin->getId()]) {
+          delete notCountedSubsumedBinsRows[bin->getId()];
+          notCountedSubsumedBinsRows[bin->getId()] = NULL;
+        }
+      }
     }
 
-    for (auto elem : cumulativeFrequency)
-      (elem.first)->setCumulativeFrequency(elem.second);
+    for (auto bin : lattice.getAllBins())
+      bin->setCumulativeFrequency(cumulativeFrequency[bin->getId()]);
   }
 
   /**
@@ -415,13 +604,135 @@ namespace fixrgraphiso {
    *   about them.
    */
   void FrequentSubgraphMiner::findPopularByRelFrequency(Lattice &lattice) {
-    vector<AcdfgBin*> order;
-    lattice.computeTopologicalOrder(order);
-    computePopularity(lattice, order, false, true,
+    vector<vector<AcdfgBin*>> levels;
+    lattice.computeTopologicalLevels(levels);
+    computePopularity(lattice, levels, false, true,
                       relative_pop_threshold);
   }
 
+  /**
+   * \brief Classify the bins of the lattice.
+   *
+   * If the lattice was already classified with the same parameters only
+   * the bins affected by the changes since the last classification are
+   * classified again (see reclassifyChangedBins).
+   */
   void FrequentSubgraphMiner::classifyBins(Lattice &lattice) {
+    ClassificationParams params;
+    params.relative = use_relative_popularity;
+    params.freqCutoff = freq_cutoff;
+    params.relativeThreshold = relative_pop_threshold;
+    params.anomalyCutOff = anomalyCutOff;
+
+    // The relative popularity is normalized with the total frequency
+    // and depends on all the bins above, so it is always recomputed
+    if ((! use_relative_popularity) && lattice.isClassified() &&
+        lattice.getClassification() == params) {
+      reclassifyChangedBins(lattice);
+    } else {
+      lattice.resetClassification();
+      classifyAllBins(lattice);
+    }
+
+    lattice.setClassification(params);
+    lattice.clearChanged();
+  }
+
+  /**
+   * \brief Classify again the bins affected by the changed bins, using
+   * the absolute frequency.
+   *
+   * The popularity of a bin depends only on the frequencies of the bin
+   * and of the bins above it, so it changes only for the changed bins
+   * and the bins below them (D).
+   * A bin is popular iff it is at the frontier of popularity (and this
+   * does not depend on the order of the visit), so only the bins in D
+   * may become (not) popular. Then the bins that may have a different
+   * classification are the ones in D (popular ancestors, frequency) and
+   * the ones above D (popular bins below).
+   */
+  void FrequentSubgraphMiner::reclassifyChangedBins(Lattice &lattice) {
+    const int binsCount = lattice.getAllBins().size();
+    vector<char> inChanged(binsCount, 0);
+    vector<char> inAffected(binsCount, 0);
+    vector<AcdfgBin*> changed;
+    vector<AcdfgBin*> affected;
+
+    for (auto bin : lattice.getAllBins()) {
+      if (! bin->isChanged()) continue;
+      if (! inChanged[bin->getId()]) {
+        inChanged[bin->getId()] = true;
+        changed.push_back(bin);
+      }
+      for (auto lower : bin->getIncomingEdges()) {
+        if (! inChanged[lower->getId()]) {
+          inChanged[lower->getId()] = true;
+          changed.push_back(lower);
+        }
+      }
+    }
+
+    for (auto bin : changed) {
+      if (! inAffected[bin->getId()]) {
+        inAffected[bin->getId()] = true;
+        affected.push_back(bin);
+      }
+      for (auto upper : bin->getSubsumingBins()) {
+        if (! inAffected[upper->getId()]) {
+          inAffected[upper->getId()] = true;
+          affected.push_back(upper);
+        }
+      }
+    }
+
+    if (debug)
+      cout << "Classifying " << affected.size() << "/" << binsCount <<
+        " bins..." << endl;
+
+    // 1. Popular bins
+    vector<char> popular(binsCount, 0);
+    for (auto bin : affected) {
+      if (inChanged[bin->getId()])
+        popular[bin->getId()] = bin->isAtFrontierOfPopularity(freq_cutoff);
+      else
+        popular[bin->getId()] = bin->isPopular();
+    }
+
+    for (auto bin : affected) {
+      bin->resetClassification();
+      bin->setCumulativeFrequency(bin->getPopularity());
+    }
+
+    for (auto bin : affected) {
+      for (auto lower : bin->getIncomingEdges()) {
+        bool lowerPopular = inAffected[lower->getId()] ?
+          popular[lower->getId()] : lower->isPopular();
+        if (lowerPopular) {
+          bin->setSubsuming();
+          break;
+        }
+      }
+    }
+
+    for (auto bin : affected)
+      if (popular[bin->getId()])
+        bin->setPopular(true);
+
+    // 2. Anomalous and isolated bins
+    for (auto bin : affected) {
+      if (bin->isSubsuming() || bin->isPopular()) continue;
+      if (bin->getFrequency() <= anomalyCutOff &&
+          bin->hasPopularAncestor()) {
+        bin->setAnomalous();
+      } else if (bin->getFrequency() <= anomalyCutOff) {
+        bin->setIsolated();
+      }
+    }
+
+    lattice.rebuildClassifiedBins(true);
+  }
+
+  void FrequentSubgraphMiner::classifyAllBins(Lattice &lattice) {
     // 1. Calculate the transitive reduction for each bin in the
     //    lattice and use it to judge popularity
     if (! use_relative_popularity) {
@@ -435,20 +746,28 @@ namespace fixrgraphiso {
     }
 
     // 2. Now calculate the anomalous and isolated patterns
-    for (auto it = lattice.beginAllBins();
-         it != lattice.endAllBins(); ++it){
-      AcdfgBin * a = *it;
+    const vector<AcdfgBin*> & allBins = lattice.getAllBins();
+    parallelFor(0, allBins.size(), num_threads, [&](int i) {
+        AcdfgBin * a = allBins[i];
+
+        if ((! use_relative_popularity) && a -> isSubsuming()) return;
+        if (a -> isPopular()) return;
+        if (a -> getFrequency() <= anomalyCutOff &&
+            a -> hasPopularAncestor()){
+          a -> setAnomalous();
+        } else if ((! a -> isSubsuming()) &&
+                   a -> getFrequency() <= anomalyCutOff){
+          a->setIsolated();
+        }
+      });
 
+    for (auto a : allBins) {
       if ((! use_relative_popularity) && a -> isSubsuming()) continue;
       if (a -> isPopular()) {
         lattice.addPopular(a);
-      } else if (a -> getFrequency() <= anomalyCutOff &&
-                 a -> hasPopularAncestor()){
-        a -> setAnomalous();
+      } else if (a -> isAnomalous()) {
         lattice.addAnomalous(a);
-      } else if ((! a -> isSubsuming()) &&
-                 a -> getFrequency() <= anomalyCutOff){
-        a->setIsolated();
+      } else if (a -> isIsolated()) {
         lattice.addIsolated(a);
       }
     }
@@ -456,6 +775,205 @@ namespace fixrgraphiso {
     return;
   }
 
+  /**
+   * \brief Classify the bins for all the absolute cutoffs and relative
+   * thresholds, without changing the classification stored in the lattice.
+   *
+   * The result is the same of classifyBins with each threshold.
+   */
+  void FrequentSubgraphMiner::sweepThresholds(Lattice & lattice,
+                                              const vector<int> & absCutoffs,
+                                              const vector<double> & relThresholds,
+                                              vector<ThresholdClassification> & results) {
+    const int binsCount = lattice.getAllBins().size();
+    const int rowSize = (binsCount + 63) / 64;
+    const int absCount = absCutoffs.size();
+    const int thresholdsCount = absCutoffs.size() + relThresholds.size();
+    vector<AcdfgBin*> order;
+    lattice.computeTopologicalOrder(order);
+
+    // popular[k][id] is true if the bin is popular for the k-th threshold
+    vector<vector<char>> popular(thresholdsCount, vector<char>(binsCount, 0));
+    vector<int> frequency(binsCount, 0);
+    int totalFrequency = 0;
+    vector<int> pendingLower(binsCount, 0);
+
+    for (auto bin : lattice.getAllBins()) {
+      frequency[bin->getId()] = bin->getFrequency();
+      totalFrequency += bin->getFrequency();
+      for (auto toBin : bin->getImmediateSubsumingBins())
+        pendingLower[toBin->getId()] += 1;
+    }
+
+    // 1. Absolute cutoffs: popular bins are at the frontier of popularity
+    for (auto bin : lattice.getAllBins()) {
+      int popularity = bin->getPopularity();
+      int maxUpperPopularity = -1;
+      for (auto toBin : bin->getImmediateSubsumingBins())
+        maxUpperPopularity = std::max(maxUpperPopularity,
+                                      toBin->getPopularity());
+
+      for (int k = 0; k < absCount; k++) {
+        popular[k][bin->getId()] = popularity >= absCutoffs[k] &&
+          maxUpperPopularity < absCutoffs[k];
+      }
+    }
+
+    // 2. Relative thresholds: one visit of the topological order for all
+    // the thresholds (see computePopularity)
+    if (relThresholds.size() > 0) {
+      vector<vector<bin_row_t*>> rows(relThresholds.size(),
+                                      vector<bin_row_t*>(binsCount, NULL));
+
+      for (auto bin : order) {
+        const int binId = bin->getId();
+        const set<AcdfgBin*> & immediateSubsuming =
+          bin->getImmediateSubsumingBins();
+
+        for (int r = 0; r < relThresholds.size(); r++) {
+          vector<char> & popularK = popular[absCount + r];
+          bin_row_t* row = new bin_row_t(rowSize, 0);
+          rows[r][binId] = row;
+          setBit(*row, binId);
+
+          for (auto toBin : immediateSubsuming) {
+            if (! popularK[toBin->getId()]) {
+              bin_row_t* toBinRow = rows[r][toBin->getId()];
+              for (int i = 0; i < rowSize; i++)
+                (*row)[i] |= (*toBinRow)[i];
+            }
+          }
+          for (auto toBin : immediateSubsuming) {
+            if (popularK[toBin->getId()])
+              clearBit(*row, toBin->getId());
+          }
+
+          int cumulativeFrequencyBin = 0;
+          for (int i = 0; i < rowSize; i++) {
+            uint64_t word = (*row)[i];
+            while (0 != word) {
+              cumulativeFrequencyBin += frequency[i * 64 + __builtin_ctzll(word)];
+              word &= word - 1;
+            }
+          }
+          if (((double) cumulativeFrequencyBin) / totalFrequency >
+              relThresholds[r])
+            popularK[binId] = true;
+        }
+
+        // Release the rows that are not needed anymore
+        for (auto toBin : immediateSubsuming) {
+          int toBinId = toBin->getId();
+          pendingLower[toBinId] -= 1;
+          if (0 == pendingLower[toBinId]) {
+            for (int r = 0; r < relThresholds.size(); r++) {
+              delete rows[r][toBinId];
+              rows[r][toBinId] = NULL;
+            }
+          }
+        }
+        if (0 == pendingLower[binId]) {
+          for (int r = 0; r < relThresholds.size(); r++) {
+            delete rows[r][binId];
+            rows[r][binId] = NULL;
+          }
+        }
+      }
+    }
+
+    // 3. Bins with a popular bin above (popularAncestor) and below
+    // (subsuming) for each threshold
+    vector<vector<char>> popularAncestor(thresholdsCount,
+                                         vector<char>(binsCount, 0));
+    vector<vector<char>> subsuming(thresholdsCount,
+                                   vector<char>(binsCount, 0));
+    for (auto bin : order) {
+      for (auto toBin : bin->getImmediateSubsumingBins()) {
+        for (int k = 0; k < thresholdsCount; k++) {
+          int toId = toBin->getId();
+          if (popular[k][toId] || popularAncestor[k][toId])
+            popularAncestor[k][bin->getId()] = true;
+        }
+      }
+    }
+    for (auto it = order.rbegin(); it != order.rend(); ++it) {
+      AcdfgBin* bin = *it;
+      for (auto toBin : bin->getImmediateSubsumingBins()) {
+        for (int k = 0; k < thresholdsCount; k++) {
+          int id = bin->getId();
+          if (popular[k][id] || subsuming[k][id])
+            subsuming[k][toBin->getId()] = true;
+        }
+      }
+    }
+
+    // 4. Classify the bins as in classifyBins
+    for (int k = 0; k < thresholdsCount; k++) {
+      ThresholdClassification result;
+      result.isRelative = k >= absCount;
+      result.threshold = result.isRelative ?
+        relThresholds[k - absCount] : absCutoffs[k];
+
+      for (auto bin : lattice.getAllBins()) {
+        int id = bin->getId();
+        if ((! result.isRelative) && subsuming[k][id]) continue;
+        if (popular[k][id]) {
+          result.popular.push_back(bin);
+        } else if (bin->getFrequency() <= anomalyCutOff &&
+                   popularAncestor[k][id]) {
+          result.anomalous.push_back(bin);
+        } else if ((! subsuming[k][id]) &&
+                   bin->getFrequency() <= anomalyCutOff) {
+          result.isolated.push_back(bin);
+        }
+      }
+      results.push_back(result);
+    }
+  }
+
+  void printBinIds(std::ostream & out,
+                   const vector<AcdfgBin*> & bins,
+                   map<AcdfgBin*, int> & acdfgBin2id) {
+    for (int i = 0; i < bins.size(); i++)
+      out << (i == 0 ? "" : ",") << acdfgBin2id[bins[i]];
+  }
+
+  /**
+   * \brief Print the classification for all the thresholds of the sweep
+   */
+  int FrequentSubgraphMiner::sweepThresholds() {
+    map<AcdfgBin*, int> acdfgBin2id;
+    Lattice *lattice_ptr = fixrgraphiso::readLattice(lattice_filename,
+                                                     acdfgBin2id);
+    if (NULL == lattice_ptr) {
+      std::cerr << "Cannot read the lattice in " << lattice_filename << endl;
+      return 1;
+    }
+
+    vector<ThresholdClassification> results;
+    sweepThresholds(*lattice_ptr, sweep_abs_cutoffs, sweep_rel_thresholds,
+                    results);
+
+    cout << "mode\tthreshold\t#popular\t#anomalous\t#isolated\t" <<
+      "popular\tanomalous\tisolated" << endl;
+    for (ThresholdClassification & result : results) {
+      cout << (result.isRelative ? "rel" : "abs") << "\t" <<
+        result.threshold << "\t" <<
+        result.popular.size() << "\t" <<
+        result.anomalous.size() << "\t" <<
+        result.isolated.size() << "\t";
+      printBinIds(cout, result.popular, acdfgBin2id);
+      cout << "\t";
+      printBinIds(cout, result.anomalous, acdfgBin2id);
+      cout << "\t";
+      printBinIds(cout, result.isolated, acdfgBin2id);
+      cout << endl;
+    }
+
+    delete lattice_ptr;
+    return 0;
+  }
+
   std::chrono::seconds diff_times(std::chrono::time_point<std::chrono::steady_clock> start,
                                   std::chrono::time_point<std::chrono::steady_clock> end) {
     return std::chrono::duration_cast<std::chrono::seconds>(end -start);
@@ -472,8 +990,8 @@ namespace fixrgraphiso {
    */
   void FrequentSubgraphMiner::pruneFrontiers(Lattice &lattice,
                                              Acdfg* acdfgToInsert,
-                                             set<AcdfgBin*> &notSubsumedBins,
-                                             set<AcdfgBin*> &notSubsumingBins)
+                                             BinSet &notSubsumedBins,
+                                             BinSet &notSubsumingBins)
 
   {
     for (auto bin : lattice.getAllBins()) {
@@ -490,150 +1008,304 @@ namespace fixrgraphiso {
   }
 
   /**
-   * Add the Acdfg to the lattice.
+   * Compare the acdfg of the insertion with next_bin, updating the
+   * state of the insertion and adding to frontier the bins to visit next.
+   *
+   * Return true if next_bin is equivalent to the acdfg. In this case
+   * bin and isoToBin are set in the insertion.
    */
-  void FrequentSubgraphMiner::binAndSubs(Lattice &lattice, Acdfg* acdfgToInsert) {
-    vector<AcdfgBin*> frontier;
-    set<AcdfgBin*> visited;
-    vector<AcdfgBin*> subsumedBins;
-    vector<AcdfgBin*> subsumingBins;
+  bool FrequentSubgraphMiner::visitBin(PendingInsertion & insertion,
+                                       AcdfgBin* next_bin,
+                                       vector<AcdfgBin*> & frontier) {
+    Acdfg* acdfgToInsert = insertion.acdfg;
+    BinSet & visited = insertion.visited;
+    BinSet & notSubsumedBins = insertion.notSubsumedBins;
+    BinSet & notSubsumingBins = insertion.notSubsumingBins;
+
+    // avoid duplicates
+    if (visited.contains(next_bin))
+      return false;
+    visited.insert(next_bin);
+
+    IsoRepr* isoRepr = new IsoRepr(acdfgToInsert,
+                                   next_bin->getRepresentative());
+
+    bool canBeSubsumed;
+    bool canSubsume;
+
+    canBeSubsumed = ! notSubsumingBins.contains(next_bin);
+    canSubsume = ! notSubsumedBins.contains(next_bin);
+
+    AcdfgBin::SubsRel compareRes = next_bin->compareACDFG(acdfgToInsert,
+                                                          isoRepr,
+                                                          canSubsume,
+                                                          canBeSubsumed);
+    switch(compareRes) {
+    case AcdfgBin::EQUIVALENT:
+      // Do not visit any other bin, the search ends here
+      insertion.bin = next_bin;
+      insertion.isoToBin = isoRepr;
+      return true;
+    case AcdfgBin::SUBSUMED:
+      // acdfgToInsert is subsumed by bin
+      insertion.subsumingBins.push_back(next_bin);
+
+      // Removes all the bins subsuming next_bin from the visit
+      // (the relation is transitively closed)
+      for(auto upperBins : next_bin->getSubsumingBins()) {
+        insertion.subsumingBins.push_back(upperBins);
+        visited.insert(upperBins);
+      }
+      break;
+    case AcdfgBin::SUBSUMING:
+      // acdfgToInsert subsumes the bin
+      insertion.subsumedBins.push_back(next_bin);
+      for(auto lowerBins : next_bin->getIncomingEdges()) {
+        insertion.subsumedBins.push_back(lowerBins);
+        visited.insert(lowerBins);
+
+        for (auto bin : lowerBins->getImmediateSubsumingBins()) {
+          if (! visited.contains(bin)) {
+            frontier.push_back(bin);
+          }
+        }
+      }
+
+      for(auto upperBins : next_bin->getImmediateSubsumingBins())
+        if (! visited.contains(upperBins)) {
+          frontier.push_back(upperBins);
+        }
+
+      break;
+    case AcdfgBin::NONE:
+      /* From this result and transitivity we infer the following:
+       * 1. acdfgToInsert cannot subsume any bin subsumed by next_bin
+       *   - next_bin <= bin and bin <= acdfgToInsert implies
+       *     next_bin <= acdfgToInsert
+       *     This would contradict ! (next_bin <= acdfgToInsert)
+       *
+       * 2. acdfgToInsert cannot be subsumed by any bin that next_bin subsumes
+       *   - acdfgToInsert <= bin and bin <= next_bin implies
+       *     acdfgToInsert <= next_bin
+       *     This would contradict ! (acdfgToInsert <= next_bin)
+       */
+
+      {
+        // 1. set of bins acdfgToInsert cannot subsume
+        for (auto bin : next_bin->getSubsumingBins())
+          notSubsumedBins.insert(bin);
+
+        // 2. set of bins that cannot subsume acdfgToInsert
+        for (auto bin : next_bin->getIncomingEdges())
+          notSubsumingBins.insert(bin);
+
+        // Visit all the children, we enforce what we learned
+        // using the sets
+        for(auto upperBins : next_bin->getImmediateSubsumingBins())
+          frontier.push_back(upperBins);
+      }
+      break;
+    }
+
+    delete isoRepr;
+    return false;
+  }
+
+  /**
+   * Create a new bin for the acdfg of the insertion, linking it to the
+   * bins found in the visit of the lattice.
+   */
+  AcdfgBin* FrequentSubgraphMiner::createBin(Lattice &lattice,
+                                             const PendingInsertion & insertion) {
+    AcdfgBin * newbin = new AcdfgBin(insertion.acdfg, lattice.getStats(),
+                                     false);
+    lattice.addBin(newbin);
+
+    // newBin subsumes subsumed
+    for (auto subsumed : insertion.subsumedBins)
+      lattice.addSubsumption(subsumed, newbin);
+
+    // subsuming subsumes newBin
+    for (auto subsuming : insertion.subsumingBins)
+      lattice.addSubsumption(newbin, subsuming);
 
-    // set of bins acdfgToInsert cannot subsume
-    set<AcdfgBin*> notSubsumedBins;
-    // set of bins that cannot subsume acdfgToInsert
-    set<AcdfgBin*> notSubsumingBins;
+    return newbin;
+  }
+
+  /**
+   * Find the bin of acdfgToInsert in the lattice, creating a new bin if
+   * no bin is equivalent to acdfgToInsert.
+   *
+   * The acdfg is not added to the members of the bin: isoToBin is set to
+   * the isomorphism from acdfgToInsert to the representative of the bin
+   * and the caller is responsible to insert it.
+   */
+  AcdfgBin* FrequentSubgraphMiner::insertInLattice(Lattice &lattice,
+                                                   Acdfg* acdfgToInsert,
+                                                   IsoRepr* &isoToBin) {
+    if (insertions.size() < 1)
+      insertions.resize(1);
+    PendingInsertion & insertion = insertions[0];
+    insertion.reset(acdfgToInsert, lattice.getAllBins().size());
+    vector<AcdfgBin*> frontier;
 
     // Try to prune the bins that are "easily" not subsumed or subsuming
     pruneFrontiers(lattice, acdfgToInsert,
-                   notSubsumedBins, notSubsumingBins);
+                   insertion.notSubsumedBins, insertion.notSubsumingBins);
 
     // Get all non-subsumed bins
     for (auto bin : lattice.getAllBins())
       if (bin->getIncomingEdges().size() == 0)
         frontier.push_back(bin);
 
-    int i = 0;
     while (frontier.size() > 0) {
       AcdfgBin* next_bin = frontier.back();
-      IsoRepr* isoRepr = new IsoRepr(acdfgToInsert,
-                                     next_bin->getRepresentative());
-
       frontier.pop_back();
 
-      // avoid duplicates
-      if (visited.find(next_bin) != visited.end())
-        continue;
-      visited.insert(next_bin);
-
-      bool canBeSubsumed;
-      bool canSubsume;
-
-      canBeSubsumed = notSubsumingBins.find(next_bin) == notSubsumingBins.end();
-      canSubsume = notSubsumedBins.find(next_bin) == notSubsumedBins.end();
-
-      AcdfgBin::SubsRel compareRes = next_bin->compareACDFG(acdfgToInsert,
-                                                            isoRepr,
-                                                            canSubsume,
-                                                            canBeSubsumed);
-      switch(compareRes) {
-      case AcdfgBin::EQUIVALENT:
-        // Do not visit any other bin, the search ends here
-        next_bin->insertEquivalentACDFG(acdfgToInsert, isoRepr);
-        return;
-      case AcdfgBin::SUBSUMED:
-        // acdfgToInsert is subsumed by bin
-        subsumingBins.push_back(next_bin);
-
-        // Removes all the bins subsuming next_bin from the visit
-        {
-          set<AcdfgBin*> reachable;
-          next_bin->getReachable(next_bin->getSubsumingBins(),
-                                 reachable, false);
-          for(auto upperBins : reachable) {
-            subsumingBins.push_back(upperBins);
-            visited.insert(upperBins);
-          }
-        }
-        break;
-      case AcdfgBin::SUBSUMING:
-        // acdfgToInsert subsumes the bin
-        subsumedBins.push_back(next_bin);
-        {
-          set<AcdfgBin*> reachable_prev;
-          next_bin->getReachable(next_bin->getIncomingEdges(),
-                                 reachable_prev, true);
-          for(auto lowerBins : reachable_prev) {
-            subsumedBins.push_back(lowerBins);
-            visited.insert(lowerBins);
-
-            for (auto bin : lowerBins->getImmediateSubsumingBins()) {
-              if (visited.find(bin) == visited.end()) {
-                frontier.push_back(bin);
-              }
-            }
-          }
-        }
+      if (visitBin(insertion, next_bin, frontier)) {
+        isoToBin = insertion.isoToBin;
+        return insertion.bin;
+      }
+    } // end of reachability on lattice
 
-        for(auto upperBins : next_bin->getImmediateSubsumingBins())
-          if (visited.find(upperBins) == visited.end()) {
-            frontier.push_back(upperBins);
-          }
+    // we have to create a new bin
+    isoToBin = new IsoRepr(acdfgToInsert);
+    return createBin(lattice, insertion);
+  }
 
-        break;
-      case AcdfgBin::NONE:
-        /* From this result and transitivity we infer the following:
-         * 1. acdfgToInsert cannot subsume any bin subsumed by next_bin
-         *   - next_bin <= bin and bin <= acdfgToInsert implies
-         *     next_bin <= acdfgToInsert
-         *     This would contradict ! (next_bin <= acdfgToInsert)
-         *
-         * 2. acdfgToInsert cannot be subsumed by any bin that next_bin subsumes
-         *   - acdfgToInsert <= bin and bin <= next_bin implies
-         *     acdfgToInsert <= next_bin
-         *     This would contradict ! (acdfgToInsert <= next_bin)
-         */
+  /**
+   * Add the Acdfg to the lattice.
+   */
+  AcdfgBin* FrequentSubgraphMiner::binAndSubs(Lattice &lattice,
+                                              Acdfg* acdfgToInsert) {
+    IsoRepr* isoToBin;
+    AcdfgBin* bin = insertInLattice(lattice, acdfgToInsert, isoToBin);
+    bin->insertEquivalentACDFG(acdfgToInsert, isoToBin);
+    return bin;
+  }
 
-        {
-          // 1. set of bins acdfgToInsert cannot subsume
-          set<AcdfgBin*> reachable;
-          next_bin->getReachable(next_bin->getImmediateSubsumingBins(),
-                                 reachable, false);
-          for (auto bin : reachable)
-            notSubsumedBins.insert(bin);
-
-          // 2. set of bins that cannot subsume acdfgToInsert
-          set<AcdfgBin*> reachable_prev;
-          next_bin->getReachable(next_bin->getIncomingEdges(),
-                                 reachable_prev, true);
-          for (auto bin : reachable_prev)
-            notSubsumingBins.insert(bin);
-
-          // Visit all the children, we enforce what we learned
-          // using the sets
-          for(auto upperBins : next_bin->getImmediateSubsumingBins())
-            frontier.push_back(upperBins);
+
+  /**
+   * Add a batch of Acdfgs to the lattice.
+   *
+   * The lattice is visited once for all the acdfgs in the batch: each bin
+   * is compared with all the acdfgs that reach it in their own visit.
+   * Then the acdfgs that are not equivalent to a bin of the lattice are
+   * compared among themselves to find equivalent acdfgs and the
+   * relations between the new bins.
+   */
+  void FrequentSubgraphMiner::binAndSubsBatch(Lattice &lattice,
+                                              const vector<Acdfg*> & batch) {
+    if (insertions.size() < batch.size())
+      insertions.resize(batch.size());
+    for (int i = 0; i < batch.size(); i++)
+      insertions[i].reset(batch[i], lattice.getAllBins().size());
+
+    // 1. prune the frontiers of all the acdfgs
+    for (auto bin : lattice.getAllBins()) {
+      Acdfg* binAcdfg = bin->getRepresentative();
+
+      for (int i = 0; i < batch.size(); i++) {
+        PendingInsertion & insertion = insertions[i];
+        if (not insertion.acdfg->canSubsumeB(*binAcdfg))
+          insertion.notSubsumedBins.insert(bin);
+        if (not binAcdfg->canSubsumeB(*insertion.acdfg))
+          insertion.notSubsumingBins.insert(bin);
+      }
+    }
+
+    // 2. visit the lattice once for all the acdfgs
+    // pending[bin] is the set of acdfgs (position in the batch) that
+    // still have to visit bin
+    map<AcdfgBin*, set<int>> pending;
+    vector<AcdfgBin*> frontier;
+
+    for (auto bin : lattice.getAllBins()) {
+      if (bin->getIncomingEdges().size() == 0) {
+        frontier.push_back(bin);
+        for (int i = 0; i < batch.size(); i++)
+          pending[bin].insert(i);
+      }
+    }
+
+    while (frontier.size() > 0) {
+      AcdfgBin* next_bin = frontier.back();
+      frontier.pop_back();
+
+      set<int> toVisit;
+      toVisit.swap(pending[next_bin]);
+      pending.erase(next_bin);
+
+      for (int i : toVisit) {
+        PendingInsertion & insertion = insertions[i];
+        if (NULL != insertion.bin)
+          continue;
+
+        vector<AcdfgBin*> next;
+        visitBin(insertion, next_bin, next);
+
+        for (auto bin : next) {
+          if (insertion.visited.contains(bin))
+            continue;
+          set<int> & binPending = pending[bin];
+          if (binPending.empty())
+            frontier.push_back(bin);
+          binPending.insert(i);
         }
-        break;
       }
+    }
 
-      delete isoRepr;
-    } // end of reachability on lattice
+    // 3. insert the acdfgs, comparing the ones that need a new bin
+    // with the bins created for the previous acdfgs in the batch
+    vector<AcdfgBin*> newBins;
+    for (int i = 0; i < batch.size(); i++) {
+      PendingInsertion & insertion = insertions[i];
+      Acdfg* acdfgToInsert = insertion.acdfg;
+
+      if (NULL != insertion.bin) {
+        insertion.bin->insertEquivalentACDFG(acdfgToInsert, insertion.isoToBin);
+        continue;
+      }
 
+      vector<AcdfgBin*> subsumedBins;
+      vector<AcdfgBin*> subsumingBins;
+      bool inserted = false;
+      for (AcdfgBin* newBin : newBins) {
+        Acdfg* binAcdfg = newBin->getRepresentative();
+        IsoRepr* isoRepr = new IsoRepr(acdfgToInsert, binAcdfg);
+
+        AcdfgBin::SubsRel compareRes =
+          newBin->compareACDFG(acdfgToInsert, isoRepr,
+                               acdfgToInsert->canSubsumeB(*binAcdfg),
+                               binAcdfg->canSubsumeB(*acdfgToInsert));
+
+        if (AcdfgBin::EQUIVALENT == compareRes) {
+          newBin->insertEquivalentACDFG(acdfgToInsert, isoRepr);
+          inserted = true;
+          break;
+        } else if (AcdfgBin::SUBSUMED == compareRes) {
+          subsumingBins.push_back(newBin);
+        } else if (AcdfgBin::SUBSUMING == compareRes) {
+          subsumedBins.push_back(newBin);
+        }
+        delete isoRepr;
+      }
 
-    // we have to create a new bin
-    AcdfgBin * newbin = new AcdfgBin(acdfgToInsert, lattice.getStats());
-    lattice.addBin(newbin);
+      if (! inserted) {
+        AcdfgBin* newBin = createBin(lattice, insertion);
+        newBin->insertEquivalentACDFG(acdfgToInsert,
+                                      new IsoRepr(acdfgToInsert));
 
-    // newBin subsumes subsumed
-    for (auto subsumed : subsumedBins)
-      subsumed->addSubsumingBin(newbin);
+        for (auto subsumed : subsumedBins)
+          lattice.addSubsumption(subsumed, newBin);
+        for (auto subsuming : subsumingBins)
+          lattice.addSubsumption(newBin, subsuming);
 
-    // subsuming subsumes newBin
-    for (auto subsuming : subsumingBins)
-      newbin->addSubsumingBin(subsuming);
+        newBins.push_back(newBin);
+      }
+    }
   }
 
-
   int get_acdfg_counts(Acdfg* b) {
     return 
       b->node_count() +
@@ -651,28 +1323,129 @@ namespace fixrgraphiso {
     return get_acdfg_counts(b1) < get_acdfg_counts(b2);
   }
 
+  /**
+   * Sorted list of the methods called in the acdfg
+   */
+  string getMethodsKey(const Acdfg* a) {
+    vector<string> methods;
+    for (auto it = a->begin_nodes(); it != a->end_nodes(); ++it) {
+      if ((*it)->get_type() == METHOD_NODE)
+        methods.push_back(((const MethodNode*) *it)->get_name());
+    }
+    std::sort(methods.begin(), methods.end());
+
+    string key;
+    for (const string & method : methods)
+      key += method + ";";
+    return key;
+  }
+
+  /**
+   * Cheap signature of the acdfg: equivalent acdfgs have the same
+   * signature
+   */
+  string getSignature(const Acdfg* a) {
+    string signature = getMethodsKey(a);
+    for (auto count : a->all_counts())
+      signature += std::to_string(count.second) + ";";
+    return signature;
+  }
+
+  /**
+   * Sort the acdfgs according to the insertion order policy:
+   *  - size-asc: smaller acdfgs first
+   *  - size-desc: bigger acdfgs first
+   *  - methods: acdfgs calling the same methods together, smaller first
+   *  - duplicates: acdfgs with more (likely) duplicates first
+   *  - random[:seed]: random order
+   */
+  void sortByInsertionOrder(vector<Acdfg*> & acdfgs, const string & policy) {
+    typedef std::pair<string, Acdfg*> keyed_acdfg_t;
+
+    if (policy == "size-asc") {
+      std::sort(acdfgs.begin(), acdfgs.end(), compareBins);
+    } else if (policy == "size-desc") {
+      std::stable_sort(acdfgs.begin(), acdfgs.end(),
+                       [](Acdfg* a, Acdfg* b) { return compareBins(b, a); });
+    } else if (policy == "methods") {
+      vector<keyed_acdfg_t> keyed;
+      for (Acdfg* a : acdfgs)
+        keyed.push_back(keyed_acdfg_t(getMethodsKey(a), a));
+      std::stable_sort(keyed.begin(), keyed.end(),
+                       [](const keyed_acdfg_t & a, const keyed_acdfg_t & b) {
+                         if (a.first != b.first) return a.first < b.first;
+                         return compareBins(a.second, b.second);
+                       });
+      for (int i = 0; i < keyed.size(); i++)
+        acdfgs[i] = keyed[i].second;
+    } else if (policy == "duplicates") {
+      vector<keyed_acdfg_t> keyed;
+      map<string, int> signatureCount;
+      for (Acdfg* a : acdfgs) {
+        keyed.push_back(keyed_acdfg_t(getSignature(a), a));
+        signatureCount[keyed.back().first] += 1;
+      }
+      std::stable_sort(keyed.begin(), keyed.end(),
+                       [&signatureCount](const keyed_acdfg_t & a,
+                                         const keyed_acdfg_t & b) {
+                         int countA = signatureCount[a.first];
+                         int countB = signatureCount[b.first];
+                         if (countA != countB) return countA > countB;
+                         if (a.first != b.first) return a.first < b.first;
+                         return compareBins(a.second, b.second);
+                       });
+      for (int i = 0; i < keyed.size(); i++)
+        acdfgs[i] = keyed[i].second;
+    } else {
+      unsigned long seed = 0;
+      if (policy.size() > 7)
+        seed = strtoul(policy.substr(7).c_str(), NULL, 10);
+      std::mt19937 generator(seed);
+      std::shuffle(acdfgs.begin(), acdfgs.end(), generator);
+    }
+  }
+
+  void printPhaseStats(const string & phase,
+                       std::chrono::milliseconds time,
+                       const Stats & before,
+                       const Stats & after) {
+    cout << "Phase " << phase <<
+      ": time (ms) " << time.count() <<
+      ", SAT calls " << after.getNumSATCalls() - before.getNumSATCalls() <<
+      ", subsumption checks " <<
+      after.getNumSubsumptionChecks() - before.getNumSubsumptionChecks() <<
+      ", SAT time (ms) " <<
+      (after.getSatSolverTime() - before.getSatSolverTime()).count() << endl;
+  }
+
   /**
    * Add the Acdfgs to the lattice.
    */
   void FrequentSubgraphMiner::binAndSubs(Lattice &lattice,
                                          vector<Acdfg*> & allSlicedACDFGs) {
-    int i = 0;
+    int batchSize = batch_size > 1 ? batch_size : 1;
 
-    for (Acdfg* a: allSlicedACDFGs) {
-      i++;
+    for (int start = 0; start < allSlicedACDFGs.size(); start += batchSize) {
+      int end = start + batchSize;
+      if (end > allSlicedACDFGs.size())
+        end = allSlicedACDFGs.size();
 
-      if (i % 10 == 0) {
-        cout << "Processing acdfg " << i << "/" <<
-          allSlicedACDFGs.size() << ".." << endl;
+      if (batchSize > 1) {
+        vector<Acdfg*> batch(allSlicedACDFGs.begin() + start,
+                             allSlicedACDFGs.begin() + end);
+        binAndSubsBatch(lattice, batch);
+      } else {
+        binAndSubs(lattice, allSlicedACDFGs[start]);
       }
 
-      binAndSubs(lattice, a);
+      if (end / 10 > start / 10) {
+        cout << "Processing acdfg " << end << "/" <<
+          allSlicedACDFGs.size() << ".." << endl;
+      }
 
-      saveState(lattice, i % 1000 == 0 && incremental);
+      saveState(lattice, end / 1000 > start / 1000 && incremental);
     }
-
-    // Compute the transitive closure of the lattice
-    lattice.makeClosure();
+    // The insertion keeps the relation transitively closed
   }
 
   void FrequentSubgraphMiner::computePatternsThroughSlicing(Lattice & lattice,
@@ -683,12 +1456,17 @@ namespace fixrgraphiso {
 
     // 1. Slice all the ACDFGs using the methods in the method names as the
     // target
+    Stats stats_start = *lattice.getStats();
     vector<Acdfg*> allSlicedACDFGs;
     sliceAcdfgs(filenames, methodnames, lattice, allSlicedACDFGs);
-    std::sort(allSlicedACDFGs.begin(), allSlicedACDFGs.end(), compareBins);
+    sortByInsertionOrder(allSlicedACDFGs, insertion_order);
 
     auto end_slicing = std::chrono::steady_clock::now();
     cout << "Slicing took " << diff_times(start, end_slicing).count() << endl;
+    Stats stats_slicing = *lattice.getStats();
+    printPhaseStats("slicing (" + insertion_order + " order)",
+                    diff_times_ms(start, end_slicing),
+                    stats_start, stats_slicing);
 
     if (anytimeComputation) {
       // Compute bins and lattice at the same time
@@ -698,6 +1476,9 @@ namespace fixrgraphiso {
       auto end_binning = std::chrono::steady_clock::now();
       cout << "Binning and lattice computation took " <<
         diff_times(end_slicing, end_binning).count() << endl;
+      printPhaseStats("binning and lattice",
+                      diff_times_ms(end_slicing, end_binning),
+                      stats_slicing, *lattice.getStats());
     } else {
       // 2. Compute a binning of all the sliced ACDFGs using the exact
       // isomorphism
@@ -735,6 +1516,9 @@ namespace fixrgraphiso {
       auto end_binning = std::chrono::steady_clock::now();
       cout << "Binning took " <<
         diff_times(end_slicing, end_binning).count() << endl;
+      Stats stats_binning = *lattice.getStats();
+      printPhaseStats("binning", diff_times_ms(end_slicing, end_binning),
+                      stats_slicing, stats_binning);
 
       lattice.sortByFrequency();
 
@@ -745,6 +1529,8 @@ namespace fixrgraphiso {
       auto end_lattice = std::chrono::steady_clock::now();
       cout << "Lattice took " <<
         diff_times(end_binning, end_lattice).count() << endl;
+      printPhaseStats("lattice", diff_times_ms(end_binning, end_lattice),
+                      stats_binning, *lattice.getStats());
     }
 
     assert(lattice.isValid()); // To run in debug mode
@@ -752,16 +1538,27 @@ namespace fixrgraphiso {
     cout << "Total bins " << lattice.getAllBins().size() << endl;
 
     // Classify the bin
+    auto start_classification = std::chrono::steady_clock::now();
+    Stats stats_classification = *lattice.getStats();
     classifyBins(lattice);
 
     auto end = std::chrono::steady_clock::now();
+    printPhaseStats("classification",
+                    diff_times_ms(start_classification, end),
+                    stats_classification, *lattice.getStats());
+    printPhaseStats("total", diff_times_ms(start, end),
+                    stats_start, *lattice.getStats());
+
     std::chrono::seconds time_taken =
       std::chrono::duration_cast<std::chrono::seconds>(end -start);
 
     // Print all the patterns
     lattice.dumpAllBins(time_taken, output_prefix,
                         info_file_name,
-                        lattice_filename);
+                        lattice_filename,
+                        format_version,
+                        reduced_relations);
+    writeLatticeIndex();
   }
 
   /**
@@ -795,11 +1592,215 @@ namespace fixrgraphiso {
       std::chrono::duration_cast<std::chrono::seconds>(start -start);
     lattice.dumpAllBins(time_taken, output_prefix,
                         info_file_name,
-                        lattice_filename);
+                        lattice_filename,
+                        format_version,
+                        reduced_relations);
+    writeLatticeIndex();
     delete lattice_ptr;
   }
 
 
+  bool compareBinsByRepr(AcdfgBin* b1, AcdfgBin* b2)
+  {
+    return compareBins(b1->getRepresentative(), b2->getRepresentative());
+  }
+
+  /**
+   * \brief Insert the bins of other in lattice.
+   *
+   * The representative of each bin of other is inserted with the same
+   * algorithm used to insert a single acdfg, then all the members of
+   * the bin are added to the bin found in lattice.
+   * The isomorphism of each member is composed with the isomorphism
+   * between the two representatives.
+   */
+  void FrequentSubgraphMiner::mergeLattice(Lattice &lattice,
+                                           const Lattice &other) {
+    vector<AcdfgBin*> otherBins(other.getAllBins());
+    // Insert the smaller graphs first, as in the mining
+    std::stable_sort(otherBins.begin(), otherBins.end(), compareBinsByRepr);
+
+    // bin of each acdfg already in the lattice
+    map<string, AcdfgBin*> nameToBin;
+    for (AcdfgBin* bin : lattice.getAllBins())
+      for (const string & name : bin->getAcdfgNames())
+        nameToBin[name] = bin;
+
+    int i = 0;
+    vector<string> newNames;
+    for (AcdfgBin* otherBin : otherBins) {
+      i++;
+      if (i % 10 == 0) {
+        cout << "Merging bin " << i << "/" <<
+          otherBins.size() << ".." << endl;
+      }
+
+      newNames.clear();
+      for (const string & name : otherBin->getAcdfgNames()) {
+        if (nameToBin.find(name) != nameToBin.end()) {
+          std::cerr << "Warning: " << name << " is already in the lattice" <<
+            " -- Ignoring it." << endl;
+          continue;
+        }
+        newNames.push_back(name);
+      }
+      // do not create an empty bin
+      if (newNames.empty())
+        continue;
+
+      IsoRepr* reprToBin;
+      AcdfgBin* bin = insertInLattice(lattice,
+                                      otherBin->getRepresentative(),
+                                      reprToBin);
+      if (0 == bin->getFrequency()) {
+        // new bin with the representative of otherBin
+        const string & reprName = otherBin->getRepresentativeName();
+        bool isMember = std::find(newNames.begin(), newNames.end(),
+                                  reprName) != newNames.end();
+        bin->setRepresentativeName(isMember ? reprName : "");
+      }
+
+      const map<string, IsoRepr*> & nameToIso = otherBin->getAcdfgNameToIso();
+      for (const string & name : newNames) {
+        auto isoIt = nameToIso.find(name);
+        assert(isoIt != nameToIso.end());
+        bin->insertEquivalentACDFG(name,
+                                   new IsoRepr(*(isoIt->second), *reprToBin));
+        nameToBin[name] = bin;
+      }
+
+      delete reprToBin;
+    }
+  }
+
+  /**
+   * \brief Merge the lattices in others in lattice and re-classify the bins.
+   *
+   * All the lattices must be computed for the same list of methods.
+   */
+  int FrequentSubgraphMiner::merge(Lattice & lattice,
+                                   const vector<Lattice*> & others,
+                                   int freqCutoff,
+                                   string outputPrefix) {
+    auto start = std::chrono::steady_clock::now();
+
+    this->freq_cutoff = freqCutoff;
+    this->output_prefix = outputPrefix;
+
+    const vector<string> & methodNames = lattice.getMethodNames();
+    set<string> methodSet(methodNames.begin(), methodNames.end());
+    for (Lattice* other : others) {
+      const vector<string> & otherNames = other->getMethodNames();
+      set<string> otherSet(otherNames.begin(), otherNames.end());
+      if (methodSet != otherSet) {
+        std::cerr << "Cannot merge lattices computed for different " <<
+          "method names" << endl;
+        return 1;
+      }
+    }
+
+    for (Lattice* other : others) {
+      mergeLattice(lattice, *other);
+      lattice.getStats()->merge(*other->getStats());
+    }
+
+    // The insertion keeps the relation transitively closed
+    assert(lattice.isValid()); // To run in debug mode
+
+    cout << "Total bins " << lattice.getAllBins().size() << endl;
+
+    lattice.sortByFrequency();
+    classifyBins(lattice);
+
+    auto end = std::chrono::steady_clock::now();
+    std::chrono::seconds time_taken =
+      std::chrono::duration_cast<std::chrono::seconds>(end -start);
+
+    lattice.dumpAllBins(time_taken, output_prefix,
+                        info_file_name,
+                        lattice_filename,
+                        format_version,
+                        reduced_relations);
+    writeLatticeIndex();
+    return 0;
+  }
+
+  int FrequentSubgraphMiner::merge(int argc, char * argv []) {
+    vector<string> latticeFiles;
+    vector<string> methodNames;
+
+    if (0 != processCommandLine(argc, argv, latticeFiles, methodNames))
+      return 1;
+
+    if (latticeFiles.size() < 2) {
+      cout << "Usage --- merge lattices: " << argv[0] <<
+        " -f [frequency cutoff] -o [output info filename] " <<
+        "-l [merged lattice file protobuf] " <<
+        "-p [output path for the found patterns] " <<
+        "[-V lattice format version, 1 or 2] " <<
+        "[-R store the reduced relations] " <<
+        "[-I write the lattice index] " <<
+        "[-Z compress the output files with gzip] " <<
+        "[list of lattice.bin files to merge]" << endl;
+      return 1;
+    }
+
+    vector<Lattice*> lattices;
+    int res = 0;
+    for (const string & latticeFile : latticeFiles) {
+      Lattice* lattice = fixrgraphiso::readLattice(latticeFile);
+      if (NULL == lattice) {
+        std::cerr << "Cannot read the lattice in " << latticeFile << endl;
+        res = 1;
+        break;
+      }
+      lattices.push_back(lattice);
+    }
+
+    if (0 == res) {
+      vector<Lattice*> others(lattices.begin() + 1, lattices.end());
+      res = merge(*lattices[0], others, freq_cutoff, output_prefix);
+    }
+
+    for (Lattice* lattice : lattices)
+      delete lattice;
+
+    return res;
+  }
+
+  /**
+   * \brief Remove the acdfgs from the lattice and re-classify the bins.
+   */
+  int FrequentSubgraphMiner::remove(Lattice & lattice,
+                                    const vector<string> & acdfgNames,
+                                    int freqCutoff,
+                                    string outputPrefix) {
+    auto start = std::chrono::steady_clock::now();
+
+    this->freq_cutoff = freqCutoff;
+    this->output_prefix = outputPrefix;
+
+    int removed = lattice.removeAcdfgs(acdfgNames);
+    cout << "Removed " << removed << "/" << acdfgNames.size() <<
+      " acdfgs" << endl;
+    cout << "Total bins " << lattice.getAllBins().size() << endl;
+
+    lattice.sortByFrequency();
+    classifyBins(lattice);
+
+    auto end = std::chrono::steady_clock::now();
+    std::chrono::seconds time_taken =
+      std::chrono::duration_cast<std::chrono::seconds>(end -start);
+
+    lattice.dumpAllBins(time_taken, output_prefix,
+                        info_file_name,
+                        lattice_filename,
+                        format_version,
+                        reduced_relations);
+    writeLatticeIndex();
+    return 0;
+  }
+
   /**
    * \brief For every possible pair (a,b) of acdfg in filenames tests if a subsumes b
    */
@@ -844,6 +1845,17 @@ namespace fixrgraphiso {
         testPairwiseSubsumption(filenames, methodnames);
       } else if (rerunClassification) {
         reClassifyBins();
+      } else if (sweep_abs_cutoffs.size() > 0 ||
+                 sweep_rel_thresholds.size() > 0) {
+        return sweepThresholds();
+      } else if (removeAcdfgs) {
+        Lattice *lattice_ptr = fixrgraphiso::readLattice(lattice_filename);
+        if (NULL == lattice_ptr) {
+          std::cerr << "Cannot read the lattice in " << lattice_filename << endl;
+          return 1;
+        }
+        remove(*lattice_ptr, toRemove, freq_cutoff, output_prefix);
+        delete lattice_ptr;
       } else {
         Lattice *lattice_ptr;
 
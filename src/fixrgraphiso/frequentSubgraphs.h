@@ -1,21 +1,68 @@
 #include <stdlib.h>
 #include <vector>
 #include "fixrgraphiso/acdfgBin.h"
+#include "fixrgraphiso/serializationLattice.h"
 
 namespace fixrgraphiso {
   using std::string;
   using std::vector;
 
+  /**
+   * Classification of the bins of a lattice for a threshold
+   */
+  struct ThresholdClassification {
+    bool isRelative;
+    double threshold;
+    vector<AcdfgBin*> popular;
+    vector<AcdfgBin*> anomalous;
+    vector<AcdfgBin*> isolated;
+  };
+
+  /* Order used to insert the acdfgs in the lattice (option -O) */
+  bool isValidInsertionOrder(const string & policy);
+  void sortByInsertionOrder(vector<Acdfg*> & acdfgs, const string & policy);
+
   class FrequentSubgraphMiner {
     private:
 
     void computePopularity(Lattice &lattice,
-                           const vector<AcdfgBin*> &order,
+                           const vector<vector<AcdfgBin*>> &levels,
                            const bool no_subsumed_popular,
                            const bool is_relative,
                            const double popularity_threshold);
 
     protected:
+    /**
+     * State of the visit of the lattice done to insert an acdfg
+     */
+    struct PendingInsertion {
+      PendingInsertion() : acdfg(NULL), bin(NULL), isoToBin(NULL) {}
+
+      /* Start the insertion of acdfg in a lattice with binsCount bins */
+      void reset(Acdfg* acdfg, int binsCount) {
+        this->acdfg = acdfg;
+        visited.clear(binsCount);
+        notSubsumedBins.clear(binsCount);
+        notSubsumingBins.clear(binsCount);
+        subsumedBins.clear();
+        subsumingBins.clear();
+        bin = NULL;
+        isoToBin = NULL;
+      }
+
+      Acdfg* acdfg;
+      BinSet visited;
+      // set of bins acdfg cannot subsume
+      BinSet notSubsumedBins;
+      // set of bins that cannot subsume acdfg
+      BinSet notSubsumingBins;
+      vector<AcdfgBin*> subsumedBins;
+      vector<AcdfgBin*> subsumingBins;
+      // bin equivalent to acdfg, if found
+      AcdfgBin* bin;
+      IsoRepr* isoToBin;
+    };
+
     int processCommandLine(int argc, char * argv[],
                            vector<string> & filenames,
                            vector<string> & methodNames);
@@ -27,9 +74,16 @@ namespace fixrgraphiso {
 
     void pruneFrontiers(Lattice &lattice,
                         Acdfg* acdfgToInsert,
-                        set<AcdfgBin*> &notSubsumedBins,
-                        set<AcdfgBin*> &notSubsumingBins);
-    void binAndSubs(Lattice &lattice, Acdfg* a);
+                        BinSet &notSubsumedBins,
+                        BinSet &notSubsumingBins);
+    bool visitBin(PendingInsertion & insertion, AcdfgBin* bin,
+                  vector<AcdfgBin*> & frontier);
+    AcdfgBin* createBin(Lattice &lattice,
+                        const PendingInsertion & insertion);
+    AcdfgBin* insertInLattice(Lattice &lattice, Acdfg* a,
+                              IsoRepr* &isoToBin);
+    AcdfgBin* binAndSubs(Lattice &lattice, Acdfg* a);
+    void binAndSubsBatch(Lattice &lattice, const vector<Acdfg*> & batch);
     void binAndSubs(Lattice &lattice,
                     vector<Acdfg*> &allSlicedACDFGs);
 
@@ -41,8 +95,14 @@ namespace fixrgraphiso {
 
     void classifyBins(Lattice & lattice);
 
+    void classifyAllBins(Lattice & lattice);
+
+    void reclassifyChangedBins(Lattice & lattice);
+
     void reClassifyBins();
 
+    int sweepThresholds();
+
     void computePatternsThroughSlicing(Lattice & lattice,
                                        vector<string> & filenames,
                                        vector<string> & methodnames);
@@ -51,6 +111,9 @@ namespace fixrgraphiso {
                                  vector<string> & methodnames);
 
     void saveState(Lattice &lattice, bool toSave);
+    void writeLatticeIndex();
+
+    void mergeLattice(Lattice &lattice, const Lattice &other);
 
     public:
     FrequentSubgraphMiner();
@@ -62,6 +125,23 @@ namespace fixrgraphiso {
              string outputPrefix,
              string acdfgFileName);
 
+    int merge(int argc, char * argv []);
+
+    void sweepThresholds(Lattice & lattice,
+                         const vector<int> & absCutoffs,
+                         const vector<double> & relThresholds,
+                         vector<ThresholdClassification> & results);
+
+    int remove(Lattice & lattice,
+               const vector<string> & acdfgNames,
+               int freqCutoff,
+               string outputPrefix);
+
+    int merge(Lattice & lattice,
+              const vector<Lattice*> & others,
+              int freqCutoff,
+              string outputPrefix);
+
 
     private:
     int freq_cutoff = 20;
@@ -79,6 +159,28 @@ namespace fixrgraphiso {
     bool anytimeComputation = false;
     // If true restarts the mining result and saves them regularly
     bool incremental = false;
+    // Thresholds of the sweep of the classification
+    vector<int> sweep_abs_cutoffs;
+    vector<double> sweep_rel_thresholds;
+    // Order used to insert the acdfgs in the lattice
+    string insertion_order = "size-asc";
+    // Number of acdfgs inserted together in the lattice
+    int batch_size = 1;
+    // If true removes the acdfgs in toRemove from the lattice
+    bool removeAcdfgs = false;
+    vector<string> toRemove;
+
+    // Format used to write the lattice
+    int format_version = LATTICE_FORMAT_VERSION;
+    // If true the lattice file only stores the immediate relations
+    bool reduced_relations = false;
+    // If true writes the index of the lattice next to the lattice file
+    bool write_index = false;
+    // Number of threads used in the classification (0 is one per core)
+    int num_threads = 1;
+
+    // State of the insertions, reused to avoid allocations
+    vector<PendingInsertion> insertions;
 
     bool use_relative_popularity = false;
     double relative_pop_threshold = 0.2;
@@ -0,0 +1,105 @@
+// -*- C++ -*-
+//
+// Read-only view of a lattice shared by concurrent searches
+//
+
+#include <algorithm>
+#include "fixrgraphiso/frozenLattice.h"
+
+namespace fixrgraphiso {
+
+  static string nodeLabel(const Node* node) {
+    switch (node->get_type()) {
+    case METHOD_NODE:
+      return toMethodNode(node)->get_name();
+    case DATA_NODE:
+      return toDataNode(node)->get_data_type();
+    default:
+      return "";
+    }
+  }
+
+  SimilarityFeatures::SimilarityFeatures(const Acdfg & acdfg) {
+    nodeCount = acdfg.node_count();
+    for (auto it = acdfg.begin_nodes(); it != acdfg.end_nodes(); ++it) {
+      if ((*it)->get_type() == METHOD_NODE)
+        methodNames.push_back(toMethodNode(*it)->get_name());
+    }
+    for (auto it = acdfg.begin_edges(); it != acdfg.end_edges(); ++it) {
+      const Edge* edge = *it;
+      edgeTriples.push_back(nodeLabel(edge->get_src()) + "\t" +
+                            std::to_string(edge->get_type()) + "\t" +
+                            nodeLabel(edge->get_dst()));
+    }
+    std::sort(methodNames.begin(), methodNames.end());
+    std::sort(edgeTriples.begin(), edgeTriples.end());
+  }
+
+  /* Size of the multiset intersection of two sorted vectors */
+  static int countCommon(const vector<string> & a, const vector<string> & b) {
+    int common = 0;
+    auto i = a.begin();
+    auto j = b.begin();
+    while (i != a.end() && j != b.end()) {
+      if (*i < *j) {
+        ++i;
+      } else if (*j < *i) {
+        ++j;
+      } else {
+        ++common; ++i; ++j;
+      }
+    }
+    return common;
+  }
+
+  double SimilarityFeatures::similarityScore(const SimilarityFeatures & pattern) const {
+    double methods = pattern.methodNames.empty() ? 1 :
+      ((double) countCommon(methodNames, pattern.methodNames)) /
+      pattern.methodNames.size();
+    double edges = pattern.edgeTriples.empty() ? 1 :
+      ((double) countCommon(edgeTriples, pattern.edgeTriples)) /
+      pattern.edgeTriples.size();
+    double size = std::max(nodeCount, pattern.nodeCount) == 0 ? 1 :
+      ((double) std::min(nodeCount, pattern.nodeCount)) /
+      std::max(nodeCount, pattern.nodeCount);
+
+    // the methods decide if an approximate result is reported
+    return 0.5 * methods + 0.3 * edges + 0.2 * size;
+  }
+
+  FrozenLattice::FrozenLattice(Lattice* lattice) :
+    lattice(lattice),
+    popularBins(lattice->getPopularBins()),
+    anomalousBins(lattice->getAnomalousBins()) {
+    Lattice::sortBinsByFrequency(popularBins);
+    Lattice::sortBinsByFrequency(anomalousBins);
+
+    // Computes the immediate subsuming bins of all the bins
+    lattice->buildTr(tr);
+
+    // e.g., a lattice classified after it was read
+    if (! lattice->hasSubsumingAnomalous())
+      lattice->buildSubsumingAnomalous();
+
+    for (AcdfgBin* bin : popularBins) {
+      bool has_popular_anc = false;
+      for (auto incomingBin : bin->getIncomingEdges())
+        has_popular_anc = has_popular_anc || incomingBin->isPopular();
+      if (! has_popular_anc)
+        popularRoots.push_back(bin);
+    }
+  }
+
+  FrozenLattice::~FrozenLattice() {
+    Lattice::deleteTr(tr);
+  }
+
+  const vector<SimilarityFeatures> & FrozenLattice::getPopularFeatures() const {
+    std::call_once(popularFeaturesOnce, [this]() {
+        for (AcdfgBin* bin : popularBins)
+          popularFeatures.push_back(SimilarityFeatures(*bin->getRepresentative()));
+      });
+    return popularFeatures;
+  }
+
+} // end fixrgraphiso namespace
@@ -0,0 +1,101 @@
+// -*- C++ -*-
+//
+// Read-only view of a lattice shared by concurrent searches
+//
+
+#ifndef FROZEN_LATTICE_H_INCLUDED
+#define FROZEN_LATTICE_H_INCLUDED
+
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+#include "fixrgraphiso/acdfg.h"
+#include "fixrgraphiso/acdfgBin.h"
+
+namespace fixrgraphiso {
+  using std::vector;
+  using std::set;
+  using std::map;
+  using std::string;
+
+  /**
+   * Cheap features of an acdfg used to rank the popular bins in
+   * search_similar
+   */
+  class SimilarityFeatures {
+  public:
+    SimilarityFeatures(const Acdfg & acdfg);
+
+    /**
+     * Score in [0,1] of how similar the acdfg is to the pattern, computed
+     * from the fraction of the method names and of the edges (labelled
+     * with the method name or data type of their nodes) of the pattern
+     * found in the acdfg, and from the ratio of their number of nodes.
+     */
+    double similarityScore(const SimilarityFeatures & pattern) const;
+
+  private:
+    // sorted, with repetitions
+    vector<string> methodNames;
+    vector<string> edgeTriples;
+    int nodeCount;
+  };
+
+  /**
+   * Immutable view of a lattice used by the searches.
+   *
+   * The constructor computes once the popular and anomalous bins sorted
+   * by frequency, the immediate subsuming bins (i.e., the transition
+   * relation of the lattice), the popular bins without popular
+   * ancestors and, if the lattice does not have them yet, the anomalous
+   * bins subsuming each popular bin. After the construction neither the
+   * view nor the lattice are modified by a search (except for the
+   * features of the popular bins, computed once on their first use), so
+   * any number of SearchLattice can use the same view concurrently.
+   *
+   * The constructor is not thread safe, and the lattice must not be
+   * modified while the view exists. The representatives of a lattice
+   * loaded from a LatticeIndex are still decoded lazily: the index
+   * serializes the decoding.
+   */
+  class FrozenLattice {
+  public:
+    FrozenLattice(Lattice* lattice);
+    ~FrozenLattice();
+
+    Lattice* getLattice() const { return lattice; }
+    const vector<string> & getMethodNames() const {
+      return lattice->getMethodNames();
+    }
+
+    const vector<AcdfgBin*> & getPopularBins() const { return popularBins; }
+    const vector<AcdfgBin*> & getAnomalousBins() const { return anomalousBins; }
+
+    /* Popular bins not subsuming another popular bin, in frequency order */
+    const vector<AcdfgBin*> & getPopularRoots() const { return popularRoots; }
+
+    /* The bins immediately subsuming bin */
+    const set<AcdfgBin*> & getTr(AcdfgBin* bin) const { return *tr.at(bin); }
+
+    /**
+     * Features of the popular bins, in the order of getPopularBins.
+     * Computed on the first call, that decodes the popular
+     * representatives of a lattice loaded from an index.
+     */
+    const vector<SimilarityFeatures> & getPopularFeatures() const;
+
+  private:
+    Lattice* lattice;
+    vector<AcdfgBin*> popularBins;
+    vector<AcdfgBin*> anomalousBins;
+    vector<AcdfgBin*> popularRoots;
+    map<AcdfgBin*, set<AcdfgBin*>*> tr;
+    mutable std::once_flag popularFeaturesOnce;
+    mutable vector<SimilarityFeatures> popularFeatures;
+  };
+
+} // end fixrgraphiso namespace
+
+#endif // FROZEN_LATTICE_H_INCLUDED
@@ -626,11 +626,13 @@ namespace fixrgraphiso {
 
     // 5. Solve
 #ifdef USE_GUROBI_SOLVER
-    bool stat = milp.solveUsingGurobiLibrary(debug, gurobi_timeout);
+    double timeout = gurobi_timeout;
+    if (timeLimit > 0 && timeLimit / 1000.0 < timeout)
+      timeout = timeLimit / 1000.0;
+    bool stat = milp.solveUsingGurobiLibrary(debug, timeout);
     return stat;
 #else
-    milp.solveUsingGLPKLibrary(debug);
-    return true;
+    return milp.solveUsingGLPKLibrary(debug, timeLimit);
 #endif
   }
 
@@ -31,7 +31,7 @@ namespace fixrgraphiso {
 
   class IlpApproxIsomorphism {
   public:
-  IlpApproxIsomorphism(Acdfg* a, Acdfg* b, const bool debug): acdfg_a(a), acdfg_b(b), debug(debug){};
+  IlpApproxIsomorphism(Acdfg* a, Acdfg* b, const bool debug): acdfg_a(a), acdfg_b(b), debug(debug), timeLimit(0){};
     ~IlpApproxIsomorphism(){};
     void prettyPrintEncodingResultInDot(ostream & out);
     void printMatchOfB();
@@ -47,11 +47,16 @@ namespace fixrgraphiso {
 
     void populateResults(IsoRepr & res);
 
+    /* Time limit of the solver in ms (0 is none): computeILPEncoding
+       returns false when it is reached */
+    void setTimeLimit(int timeLimit) { this->timeLimit = timeLimit; }
+
   private:
 
     Acdfg * acdfg_a; // The first graph
     Acdfg * acdfg_b; // The second graph
     bool debug;
+    int timeLimit;
 #ifdef USE_GUROBI_SOLVER
     double gurobi_timeout;
 #endif
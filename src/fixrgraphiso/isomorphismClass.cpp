@@ -4,6 +4,7 @@
 #include "fixrgraphiso/serialization.h"
 #include "fixrgraphiso/collectStats.h"
 #include "fixrgraphiso/proto_iso.pb.h"
+#include "fixrgraphiso/compression.h"
 
 using std::cout;
 using std::endl;
@@ -26,7 +27,15 @@ namespace fixrgraphiso {
     return false;
   }
 
-  IsoEncoder::IsoEncoder():  ctx(), s(ctx), alreadySolved(false), satisfiable(false){}
+  IsoEncoder::IsoEncoder():  ctx(), s(ctx), alreadySolved(false), satisfiable(false),
+                             hasTimeout(false), unknown(false){}
+
+  void IsoEncoder::setTimeout(unsigned timeout) {
+    z3::params p(ctx);
+    p.set("timeout", timeout);
+    s.set(p);
+    hasTimeout = true;
+  }
 
   IsoEncoder::~IsoEncoder(){
   }
@@ -134,7 +143,10 @@ namespace fixrgraphiso {
         satisfiable = true;
         break;
       default:
-        assert(false);
+        // only when the solver gives up
+        assert(hasTimeout);
+        satisfiable = false;
+        unknown = true;
         break;
       }
     }
@@ -741,7 +753,7 @@ namespace fixrgraphiso {
     Iso iso;
     std::fstream inp_file (fname.c_str(), std::ios::in | std::ios::binary);
     assert(inp_file.is_open());
-    iso.ParseFromIstream(& inp_file);
+    parseFromStream(inp_file, &iso);
     inp_file.close();
     AcdfgSerializer s;
     acdfg = s.create_acdfg(&iso);
@@ -886,13 +898,41 @@ namespace fixrgraphiso {
     for (auto it = isoRepr.edgesRel.begin();
          it != isoRepr.edgesRel.end(); it++) {
       if (! reverse) {
-        this->addNodeRel(it->first, it->second);
+        this->addEdgeRel(it->first, it->second);
       } else {
-        this->addNodeRel(it->second, it->first);
+        this->addEdgeRel(it->second, it->first);
       }
     }
   }
 
+  /**
+   * Compose two isomorphisms: first relates acdfg_1 to acdfg_2 and
+   * second relates acdfg_2 to acdfg_3, the result relates acdfg_1 to
+   * acdfg_3
+   */
+  IsoRepr::IsoRepr(const IsoRepr& first, const IsoRepr& second) {
+    this->acdfg_1 = first.acdfg_1;
+    this->acdfg_2 = second.acdfg_2;
+
+    map<long, long> secondNodes;
+    for (auto nodePair : second.nodesRel)
+      secondNodes[nodePair.first] = nodePair.second;
+    for (auto nodePair : first.nodesRel) {
+      auto it = secondNodes.find(nodePair.second);
+      if (it != secondNodes.end())
+        this->addNodeRel(nodePair.first, it->second);
+    }
+
+    map<long, long> secondEdges;
+    for (auto edgePair : second.edgesRel)
+      secondEdges[edgePair.first] = edgePair.second;
+    for (auto edgePair : first.edgesRel) {
+      auto it = secondEdges.find(edgePair.second);
+      if (it != secondEdges.end())
+        this->addEdgeRel(edgePair.first, it->second);
+    }
+  }
+
   std::ostream & operator << (std::ostream &out, const IsoRepr &isoRepr)
   {
     out << "Nodes:" << endl;
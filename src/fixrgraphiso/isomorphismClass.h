@@ -35,11 +35,17 @@ namespace fixrgraphiso {
     z3::solver s;
     bool satisfiable;
     bool alreadySolved;
+    bool hasTimeout;
+    bool unknown;
   public:
 
     typedef z3::expr var_t;
     IsoEncoder();
     ~IsoEncoder();
+    /* Give up after timeout ms: the problem is then unsat and timedOut
+       is true */
+    void setTimeout(unsigned timeout);
+    bool timedOut() const { return unknown; }
     var_t createBooleanVariable(const string & vName);
     void atmostOne(const vector<var_t>  & what);
     void atleastOne(const vector<var_t>  & what);
@@ -63,9 +69,12 @@ namespace fixrgraphiso {
     IsoRepr(const UnweightedIso& iso);
     IsoRepr(Acdfg* acdfg);
     IsoRepr(const IsoRepr& isoRepr, bool reverse);
+    IsoRepr(const IsoRepr& first, const IsoRepr& second);
 
     const Acdfg& getAcdfg1() const { return (const Acdfg&) *acdfg_1;}
     const Acdfg& getAcdfg2() const { return (const Acdfg&) *acdfg_2;}
+    Acdfg* getAcdfg1Ptr() const { return acdfg_1; }
+    Acdfg* getAcdfg2Ptr() const { return acdfg_2; }
 
     void addNodeRel(node_id_t node_1, node_id_t node_2) {
       nodesRel.insert(id_pair_t(node_1,node_2));
@@ -146,6 +155,10 @@ namespace fixrgraphiso {
     bool check(IsoRepr *iso);
     bool check_iso(IsoRepr *iso);
     bool canSubsume();
+
+    /* Time limit of the SAT check in ms */
+    void setTimeout(unsigned timeout) { e.setTimeout(timeout); }
+    bool timedOut() const { return e.timedOut(); }
   };
 
 
@@ -0,0 +1,704 @@
+// -*- C++ -*-
+//
+// Index of a lattice file that is memory mapped and decoded lazily
+//
+
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <vector>
+#include <algorithm>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "fixrgraphiso/latticeIndex.h"
+#include "fixrgraphiso/serialization.h"
+#include "fixrgraphiso/serializationLattice.h"
+#include "fixrgraphiso/compression.h"
+#include "fixrgraphiso/fingerprint.h"
+
+namespace fixrgraphiso {
+  using std::vector;
+  using std::endl;
+  using std::cerr;
+  using std::ifstream;
+  using std::ofstream;
+
+  static const char LATTICE_INDEX_MAGIC[8] = {'F','I','X','R','L','I','D','X'};
+  static const uint32_t LATTICE_INDEX_VERSION = 4;
+
+  /* Classification of a bin in the index */
+  enum {
+    INDEX_BIN_POPULAR = 1,
+    INDEX_BIN_ANOMALOUS = 2,
+    INDEX_BIN_ISOLATED = 4,
+    INDEX_BIN_SUBSUMING = 8
+  };
+
+  /* Position of an object in a file */
+  struct LatticeIndexRange {
+    uint64_t offset;
+    uint64_t size;
+  };
+
+  /**
+   * Header of the index file, followed by the sections in the order
+   * they appear here. All the values are in the native byte order.
+   */
+  struct LatticeIndexHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t binsCount;
+    // size and modification time (ns) of the indexed lattice file, to
+    // detect a stale index without reading the lattice
+    uint64_t latticeSize;
+    uint64_t latticeMtime;
+    // FNV-1a hash of the indexed lattice file (e.g., for the search cache)
+    uint64_t latticeHash;
+    // LatticeIndexBin[binsCount]
+    uint64_t binsOffset;
+    // LatticeIndexRange[acdfgsCount], the acdfgs table of the format v2
+    uint64_t acdfgsOffset;
+    uint64_t acdfgsCount;
+    // LatticeIndexRange[namesCount], positions in the strings
+    uint64_t namesOffset;
+    uint64_t namesCount;
+    // uint32_t[refsCount], indexes of the bins
+    uint64_t refsOffset;
+    uint64_t refsCount;
+    // char[stringsSize]
+    uint64_t stringsOffset;
+    uint64_t stringsSize;
+    // ranges in the names
+    uint32_t methodNamesStart;
+    uint32_t methodNamesCount;
+    // ranges in the refs
+    uint32_t popularStart;
+    uint32_t popularCount;
+    uint32_t anomalousStart;
+    uint32_t anomalousCount;
+    uint32_t isolatedStart;
+    uint32_t isolatedCount;
+  };
+
+  struct LatticeIndexBin {
+    // id of the bin in the lattice file
+    uint64_t protoId;
+    // AcdfgBin message in the lattice file
+    LatticeIndexRange bin;
+    // Acdfg message of the representative in the lattice file
+    LatticeIndexRange repr;
+    uint32_t flags;
+    uint32_t cumulativeFrequency;
+    // names of the members, in the names
+    uint32_t namesStart;
+    uint32_t namesCount;
+    // transitively closed and immediate subsuming bins, in the refs
+    uint32_t subsumingStart;
+    uint32_t subsumingCount;
+    uint32_t immediateStart;
+    uint32_t immediateCount;
+    // anomalous bins subsuming a popular bin, in the refs
+    uint32_t anomalousStart;
+    uint32_t anomalousCount;
+  };
+
+  /*
+   * Minimal reader of the protobuf wire format, used to find the
+   * position of the messages in the lattice file
+   */
+  static bool readVarint(const uint8_t* & p, const uint8_t* end,
+                         uint64_t & value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && p < end; shift += 7) {
+      uint8_t byte = *p++;
+      value |= ((uint64_t) (byte & 0x7F)) << shift;
+      if (0 == (byte & 0x80))
+        return true;
+    }
+    return false;
+  }
+
+  static bool readLengthDelimited(const uint8_t* & p, const uint8_t* end,
+                                  const uint8_t* begin,
+                                  LatticeIndexRange & range) {
+    uint64_t size;
+    if (! readVarint(p, end, size) || size > (uint64_t) (end - p))
+      return false;
+    range.offset = p - begin;
+    range.size = size;
+    p += size;
+    return true;
+  }
+
+  static bool skipField(const uint8_t* & p, const uint8_t* end,
+                        int wireType) {
+    uint64_t value;
+    LatticeIndexRange range;
+    switch (wireType) {
+    case 0:
+      return readVarint(p, end, value);
+    case 1:
+      if (end - p < 8) return false;
+      p += 8;
+      return true;
+    case 2:
+      return readLengthDelimited(p, end, p, range);
+    case 5:
+      if (end - p < 4) return false;
+      p += 4;
+      return true;
+    default:
+      return false;
+    }
+  }
+
+  /**
+   * Find the AcdfgBin messages and the acdfgs table (format v2) in the
+   * serialized lattice
+   */
+  static bool scanLattice(const string & data,
+                          vector<LatticeIndexRange> & binRanges,
+                          vector<LatticeIndexRange> & acdfgRanges) {
+    const uint8_t* begin = (const uint8_t*) data.data();
+    const uint8_t* end = begin + data.size();
+    const uint8_t* p = begin;
+
+    while (p < end) {
+      uint64_t tag;
+      if (! readVarint(p, end, tag))
+        return false;
+      int field = tag >> 3;
+      int wireType = tag & 7;
+
+      if (2 == wireType &&
+          acdfg_protobuf::Lattice::kBinsFieldNumber == field) {
+        LatticeIndexRange range;
+        if (! readLengthDelimited(p, end, begin, range)) return false;
+        binRanges.push_back(range);
+      } else if (2 == wireType &&
+                 acdfg_protobuf::Lattice::kAcdfgsFieldNumber == field) {
+        LatticeIndexRange range;
+        if (! readLengthDelimited(p, end, begin, range)) return false;
+        acdfgRanges.push_back(range);
+      } else if (! skipField(p, end, wireType)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /**
+   * Find the representative of the bin stored at binRange
+   */
+  static bool scanBinRepr(const string & data,
+                          const LatticeIndexRange & binRange,
+                          const vector<LatticeIndexRange> & acdfgRanges,
+                          LatticeIndexRange & reprRange) {
+    const uint8_t* begin = (const uint8_t*) data.data();
+    const uint8_t* end = begin + binRange.offset + binRange.size;
+    const uint8_t* p = begin + binRange.offset;
+    bool found = false;
+
+    while (p < end) {
+      uint64_t tag;
+      if (! readVarint(p, end, tag))
+        return false;
+      int field = tag >> 3;
+      int wireType = tag & 7;
+
+      if (2 == wireType &&
+          acdfg_protobuf::Lattice::AcdfgBin::kAcdfgReprFieldNumber == field) {
+        if (! readLengthDelimited(p, end, begin, reprRange)) return false;
+        found = true;
+      } else if (0 == wireType &&
+                 acdfg_protobuf::Lattice::AcdfgBin::kAcdfgReprRefFieldNumber == field) {
+        uint64_t ref;
+        if (! readVarint(p, end, ref) || ref >= acdfgRanges.size())
+          return false;
+        reprRange = acdfgRanges[ref];
+        found = true;
+      } else if (! skipField(p, end, wireType)) {
+        return false;
+      }
+    }
+    return found;
+  }
+
+  static void addString(const string & value,
+                        vector<LatticeIndexRange> & names,
+                        string & strings) {
+    LatticeIndexRange range;
+    range.offset = strings.size();
+    range.size = value.size();
+    names.push_back(range);
+    strings.append(value);
+  }
+
+  static void addRefs(const vector<AcdfgBin*> & bins,
+                      vector<uint32_t> & refs,
+                      uint32_t & start, uint32_t & count) {
+    start = refs.size();
+    count = bins.size();
+    for (AcdfgBin* bin : bins)
+      refs.push_back(bin->getId());
+  }
+
+  static uint64_t modificationTime(const struct stat & st) {
+    return (uint64_t) st.st_mtim.tv_sec * 1000000000ULL + st.st_mtim.tv_nsec;
+  }
+
+  string LatticeIndex::getIndexFileName(const string & latticeFile) {
+    return latticeFile + ".idx";
+  }
+
+  /**
+   * Write the index of the lattice stored in latticeFile.
+   *
+   * The lattice is fully decoded only once here, to compute the
+   * relations and the position of the representatives.
+   */
+  int LatticeIndex::write(const string & latticeFile,
+                          const string & indexFile) {
+    // before reading, a later change makes the index stale
+    struct stat st;
+    ifstream in(latticeFile.c_str(), std::ios::in | std::ios::binary);
+    if (0 != stat(latticeFile.c_str(), &st) || ! in.is_open()) {
+      cerr << "Cannot read the lattice in " << latticeFile << endl;
+      return 1;
+    }
+    string data((std::istreambuf_iterator<char>(in)),
+                std::istreambuf_iterator<char>());
+    in.close();
+
+    // The index refers to the positions of the acdfgs in the file
+    if (isGzipData(data.data(), data.size())) {
+      cerr << "Cannot index the compressed lattice in " << latticeFile << endl;
+      return 1;
+    }
+
+    vector<LatticeIndexRange> binRanges;
+    vector<LatticeIndexRange> acdfgRanges;
+    acdfg_protobuf::Lattice protoLattice;
+    if ((! protoLattice.ParseFromString(data)) ||
+        (! scanLattice(data, binRanges, acdfgRanges))) {
+      cerr << "Cannot parse the lattice in " << latticeFile << endl;
+      return 1;
+    }
+
+    LatticeSerializer serializer;
+    map<AcdfgBin*, int> bin2id;
+    Lattice* lattice = serializer.lattice_from_proto(&protoLattice, bin2id);
+    if (NULL == lattice) {
+      cerr << "Cannot read the lattice in " << latticeFile << endl;
+      return 1;
+    }
+    const vector<AcdfgBin*> & allBins = lattice->getAllBins();
+    assert(allBins.size() == binRanges.size());
+
+    LatticeIndexHeader header;
+    vector<LatticeIndexBin> bins(allBins.size());
+    vector<LatticeIndexRange> names;
+    vector<uint32_t> refs;
+    string strings;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, LATTICE_INDEX_MAGIC, sizeof(header.magic));
+    header.version = LATTICE_INDEX_VERSION;
+    header.binsCount = allBins.size();
+    header.latticeSize = data.size();
+    header.latticeMtime = modificationTime(st);
+    header.latticeHash = fnvHash(data.data(), data.size());
+
+    header.methodNamesStart = names.size();
+    header.methodNamesCount = lattice->getMethodNames().size();
+    for (const string & methodName : lattice->getMethodNames())
+      addString(methodName, names, strings);
+
+    int res = 0;
+    for (int i = 0; i < allBins.size() && 0 == res; i++) {
+      AcdfgBin* bin = allBins[i];
+      LatticeIndexBin & indexBin = bins[i];
+      assert(bin->getId() == i);
+
+      memset(&indexBin, 0, sizeof(indexBin));
+      indexBin.protoId = bin2id[bin];
+      indexBin.bin = binRanges[i];
+      if (! scanBinRepr(data, binRanges[i], acdfgRanges, indexBin.repr)) {
+        cerr << "Cannot find the representative of bin " <<
+          indexBin.protoId << endl;
+        res = 1;
+      }
+
+      indexBin.flags =
+        (bin->isPopular() ? INDEX_BIN_POPULAR : 0) |
+        (bin->isAnomalous() ? INDEX_BIN_ANOMALOUS : 0) |
+        (bin->isIsolated() ? INDEX_BIN_ISOLATED : 0) |
+        (bin->isSubsuming() ? INDEX_BIN_SUBSUMING : 0);
+      indexBin.cumulativeFrequency = bin->getCumulativeFrequency();
+
+      indexBin.namesStart = names.size();
+      indexBin.namesCount = bin->getAcdfgNames().size();
+      for (const string & name : bin->getAcdfgNames())
+        addString(name, names, strings);
+
+      vector<AcdfgBin*> subsuming(bin->getSubsumingBins().begin(),
+                                  bin->getSubsumingBins().end());
+      addRefs(subsuming, refs, indexBin.subsumingStart,
+              indexBin.subsumingCount);
+      vector<AcdfgBin*> immediate(bin->getImmediateSubsumingBins().begin(),
+                                  bin->getImmediateSubsumingBins().end());
+      addRefs(immediate, refs, indexBin.immediateStart,
+              indexBin.immediateCount);
+      addRefs(bin->getSubsumingAnomalous(), refs, indexBin.anomalousStart,
+              indexBin.anomalousCount);
+    }
+
+    addRefs(lattice->getPopularBins(), refs,
+            header.popularStart, header.popularCount);
+    addRefs(lattice->getAnomalousBins(), refs,
+            header.anomalousStart, header.anomalousCount);
+    addRefs(lattice->getIsolatedBins(), refs,
+            header.isolatedStart, header.isolatedCount);
+    delete lattice;
+
+    if (0 != res)
+      return res;
+
+    header.binsOffset = sizeof(header);
+    header.acdfgsOffset = header.binsOffset +
+      bins.size() * sizeof(LatticeIndexBin);
+    header.acdfgsCount = acdfgRanges.size();
+    header.namesOffset = header.acdfgsOffset +
+      acdfgRanges.size() * sizeof(LatticeIndexRange);
+    header.namesCount = names.size();
+    header.refsOffset = header.namesOffset +
+      names.size() * sizeof(LatticeIndexRange);
+    header.refsCount = refs.size();
+    header.stringsOffset = header.refsOffset + refs.size() * sizeof(uint32_t);
+    header.stringsSize = strings.size();
+
+    ofstream out(indexFile.c_str(),
+                 std::ios::out | std::ios::binary | std::ios::trunc);
+    if (! out.is_open()) {
+      cerr << "Cannot write the index in " << indexFile << endl;
+      return 1;
+    }
+    out.write((const char*) &header, sizeof(header));
+    out.write((const char*) bins.data(), bins.size() * sizeof(LatticeIndexBin));
+    out.write((const char*) acdfgRanges.data(),
+              acdfgRanges.size() * sizeof(LatticeIndexRange));
+    out.write((const char*) names.data(),
+              names.size() * sizeof(LatticeIndexRange));
+    out.write((const char*) refs.data(), refs.size() * sizeof(uint32_t));
+    out.write(strings.data(), strings.size());
+    out.close();
+
+    return out.fail() ? 1 : 0;
+  }
+
+  static const char* mapFile(const string & fileName, size_t & size,
+                             uint64_t & mtime) {
+    int fd = ::open(fileName.c_str(), O_RDONLY);
+    if (fd < 0)
+      return NULL;
+
+    struct stat st;
+    void* data = MAP_FAILED;
+    if (0 == fstat(fd, &st) && st.st_size > 0) {
+      size = st.st_size;
+      mtime = modificationTime(st);
+      data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    ::close(fd);
+
+    return MAP_FAILED == data ? NULL : (const char*) data;
+  }
+
+  static bool inFile(uint64_t offset, uint64_t count, uint64_t elementSize,
+                     uint64_t fileSize) {
+    return offset <= fileSize &&
+      count <= (fileSize - offset) / elementSize;
+  }
+
+  /**
+   * True if all the ranges in the names, refs and strings of the index
+   * are in the arrays, and all the refs are bins
+   */
+  bool LatticeIndex::isConsistent(const LatticeIndexRange* names,
+                                  const uint32_t* refs) const {
+    for (uint64_t i = 0; i < header->namesCount; i++)
+      if (! inFile(names[i].offset, names[i].size, 1, header->stringsSize))
+        return false;
+    for (uint64_t i = 0; i < header->refsCount; i++)
+      if (refs[i] >= header->binsCount)
+        return false;
+
+    if (! (inFile(header->methodNamesStart, header->methodNamesCount, 1,
+                  header->namesCount) &&
+           inFile(header->popularStart, header->popularCount, 1,
+                  header->refsCount) &&
+           inFile(header->anomalousStart, header->anomalousCount, 1,
+                  header->refsCount) &&
+           inFile(header->isolatedStart, header->isolatedCount, 1,
+                  header->refsCount)))
+      return false;
+
+    for (uint32_t i = 0; i < header->binsCount; i++) {
+      const LatticeIndexBin & indexBin = bins[i];
+      if (! (inFile(indexBin.namesStart, indexBin.namesCount, 1,
+                    header->namesCount) &&
+             inFile(indexBin.subsumingStart, indexBin.subsumingCount, 1,
+                    header->refsCount) &&
+             inFile(indexBin.immediateStart, indexBin.immediateCount, 1,
+                    header->refsCount) &&
+             inFile(indexBin.anomalousStart, indexBin.anomalousCount, 1,
+                    header->refsCount)))
+        return false;
+    }
+    return true;
+  }
+
+  LatticeIndex::LatticeIndex() : latticeData(NULL), latticeSize(0),
+                                 indexData(NULL), indexSize(0),
+                                 header(NULL), bins(NULL), lattice(NULL) {}
+
+  LatticeIndex::~LatticeIndex() {
+    close();
+  }
+
+  void LatticeIndex::close() {
+    if (NULL != lattice)
+      delete lattice;
+    lattice = NULL;
+    acdfgBin2id.clear();
+
+    for (auto decoded : decodedAcdfgs)
+      delete decoded.second;
+    decodedAcdfgs.clear();
+
+    if (NULL != latticeData)
+      munmap((void*) latticeData, latticeSize);
+    if (NULL != indexData)
+      munmap((void*) indexData, indexSize);
+    latticeData = NULL;
+    indexData = NULL;
+    header = NULL;
+    bins = NULL;
+  }
+
+  /**
+   * Map the lattice and its index and build the lattice, without
+   * decoding any acdfg.
+   *
+   * Return 0 on success.
+   */
+  int LatticeIndex::open(const string & latticeFile,
+                         const string & indexFile) {
+    close();
+
+    uint64_t latticeMtime;
+    uint64_t indexMtime;
+    latticeData = mapFile(latticeFile, latticeSize, latticeMtime);
+    if (NULL == latticeData) {
+      cerr << "Cannot map the lattice in " << latticeFile << endl;
+      return 1;
+    }
+    indexData = mapFile(indexFile, indexSize, indexMtime);
+    if (NULL == indexData) {
+      cerr << "Cannot map the index in " << indexFile << endl;
+      close();
+      return 1;
+    }
+
+    header = (const LatticeIndexHeader*) indexData;
+    if (indexSize < sizeof(LatticeIndexHeader) ||
+        0 != memcmp(header->magic, LATTICE_INDEX_MAGIC, sizeof(header->magic)) ||
+        LATTICE_INDEX_VERSION != header->version) {
+      cerr << "Invalid lattice index " << indexFile << endl;
+      close();
+      return 1;
+    }
+    if (header->latticeSize != latticeSize ||
+        header->latticeMtime != latticeMtime) {
+      cerr << "The index " << indexFile << " is not up to date with " <<
+        latticeFile << endl;
+      close();
+      return 1;
+    }
+    if (! (inFile(header->binsOffset, header->binsCount,
+                  sizeof(LatticeIndexBin), indexSize) &&
+           inFile(header->acdfgsOffset, header->acdfgsCount,
+                  sizeof(LatticeIndexRange), indexSize) &&
+           inFile(header->namesOffset, header->namesCount,
+                  sizeof(LatticeIndexRange), indexSize) &&
+           inFile(header->refsOffset, header->refsCount,
+                  sizeof(uint32_t), indexSize) &&
+           inFile(header->stringsOffset, header->stringsSize, 1, indexSize))) {
+      cerr << "Truncated lattice index " << indexFile << endl;
+      close();
+      return 1;
+    }
+
+    bins = (const LatticeIndexBin*) (indexData + header->binsOffset);
+    const LatticeIndexRange* names =
+      (const LatticeIndexRange*) (indexData + header->namesOffset);
+    const uint32_t* refs = (const uint32_t*) (indexData + header->refsOffset);
+    const char* strings = indexData + header->stringsOffset;
+
+    if (! isConsistent(names, refs)) {
+      cerr << "Corrupted lattice index " << indexFile << endl;
+      close();
+      return 1;
+    }
+
+    auto getName = [&](uint32_t i) {
+      return string(strings + names[i].offset, names[i].size);
+    };
+
+    lattice = new Lattice();
+    for (uint32_t i = 0; i < header->methodNamesCount; i++)
+      lattice->addMethodName(getName(header->methodNamesStart + i));
+
+    // 1. Create the bins
+    for (uint32_t i = 0; i < header->binsCount; i++) {
+      const LatticeIndexBin & indexBin = bins[i];
+      AcdfgBin* bin = new AcdfgBin(NULL, lattice->getStats(), false);
+      bin->setLoader(this);
+
+      // the isomorphisms are decoded only by loadIsos
+      for (uint32_t j = 0; j < indexBin.namesCount; j++)
+        bin->insertEquivalentACDFG(getName(indexBin.namesStart + j), NULL);
+
+      if (indexBin.flags & INDEX_BIN_ANOMALOUS) bin->setAnomalous();
+      if (indexBin.flags & INDEX_BIN_SUBSUMING) bin->setSubsuming();
+      if (indexBin.flags & INDEX_BIN_POPULAR) bin->setPopular(true);
+      if (indexBin.flags & INDEX_BIN_ISOLATED) bin->setIsolated();
+      bin->setCumulativeFrequency(indexBin.cumulativeFrequency);
+
+      lattice->addBin(bin);
+      acdfgBin2id[bin] = indexBin.protoId;
+    }
+
+    // 2. Create the relations
+    const vector<AcdfgBin*> & allBins = lattice->getAllBins();
+    vector<AcdfgBin*> subsuming;
+    vector<AcdfgBin*> immediate;
+    for (uint32_t i = 0; i < header->binsCount; i++) {
+      const LatticeIndexBin & indexBin = bins[i];
+      subsuming.clear();
+      immediate.clear();
+      for (uint32_t j = 0; j < indexBin.subsumingCount; j++)
+        subsuming.push_back(allBins[refs[indexBin.subsumingStart + j]]);
+      for (uint32_t j = 0; j < indexBin.immediateCount; j++)
+        immediate.push_back(allBins[refs[indexBin.immediateStart + j]]);
+      std::sort(subsuming.begin(), subsuming.end());
+      allBins[i]->setSubsumingBins(subsuming, immediate);
+    }
+
+    // 3. Populate popular/anomalous/isolated list
+    for (uint32_t i = 0; i < header->popularCount; i++)
+      lattice->addPopular(allBins[refs[header->popularStart + i]]);
+    for (uint32_t i = 0; i < header->anomalousCount; i++)
+      lattice->addAnomalous(allBins[refs[header->anomalousStart + i]]);
+    for (uint32_t i = 0; i < header->isolatedCount; i++)
+      lattice->addIsolated(allBins[refs[header->isolatedStart + i]]);
+
+    map<AcdfgBin*, vector<AcdfgBin*>> popularToAnomalous;
+    for (AcdfgBin* popular : lattice->getPopularBins()) {
+      const LatticeIndexBin & indexBin = bins[popular->getId()];
+      vector<AcdfgBin*> & anomalous = popularToAnomalous[popular];
+      for (uint32_t j = 0; j < indexBin.anomalousCount; j++)
+        anomalous.push_back(allBins[refs[indexBin.anomalousStart + j]]);
+    }
+    lattice->setSubsumingAnomalous(popularToAnomalous);
+
+    lattice->clearChanged();
+
+    return 0;
+  }
+
+  Acdfg* LatticeIndex::loadAcdfg(uint64_t offset, uint64_t size) {
+    // the searches sharing the lattice may decode the acdfgs concurrently
+    std::lock_guard<std::mutex> guard(decodeLock);
+    auto it = decodedAcdfgs.find(offset);
+    if (it != decodedAcdfgs.end())
+      return it->second;
+
+    Acdfg* acdfg = NULL;
+    acdfg_protobuf::Acdfg protoAcdfg;
+    if (inFile(offset, size, 1, latticeSize) &&
+        protoAcdfg.ParseFromArray(latticeData + offset, size)) {
+      AcdfgSerializer serializer;
+      acdfg = serializer.create_acdfg(protoAcdfg);
+    } else {
+      cerr << "Cannot decode the acdfg at " << offset << endl;
+    }
+
+    decodedAcdfgs[offset] = acdfg;
+    return acdfg;
+  }
+
+  uint64_t LatticeIndex::getLatticeHash() const {
+    return header->latticeHash;
+  }
+
+  Acdfg* LatticeIndex::loadRepresentative(const AcdfgBin* bin) {
+    assert(NULL != bins && bin->getId() < header->binsCount);
+    const LatticeIndexRange & repr = bins[bin->getId()].repr;
+    return loadAcdfg(repr.offset, repr.size);
+  }
+
+  /**
+   * Decode the isomorphisms of the members of the bin.
+   *
+   * Return 0 on success.
+   */
+  int LatticeIndex::loadIsos(AcdfgBin* bin) {
+    assert(NULL != bins && bin->getId() < header->binsCount);
+    const LatticeIndexRange & binRange = bins[bin->getId()].bin;
+    const LatticeIndexRange* acdfgs =
+      (const LatticeIndexRange*) (indexData + header->acdfgsOffset);
+
+    acdfg_protobuf::Lattice::AcdfgBin protoBin;
+    if (! (inFile(binRange.offset, binRange.size, 1, latticeSize) &&
+           protoBin.ParseFromArray(latticeData + binRange.offset,
+                                   binRange.size))) {
+      cerr << "Cannot decode the bin " << acdfgBin2id[bin] << endl;
+      return 1;
+    }
+
+    for (int j = 0; j < protoBin.names_to_iso_size(); j++) {
+      const acdfg_protobuf::Lattice::IsoPair & protoIso =
+        protoBin.names_to_iso(j);
+      IsoRepr* iso = NULL;
+
+      if (protoIso.has_iso_ref()) {
+        const acdfg_protobuf::Lattice::IsoRef & isoRef = protoIso.iso_ref();
+        if (isoRef.acdfg_1() >= header->acdfgsCount ||
+            isoRef.acdfg_2() >= header->acdfgsCount)
+          return 1;
+
+        const LatticeIndexRange & range1 = acdfgs[isoRef.acdfg_1()];
+        const LatticeIndexRange & range2 = acdfgs[isoRef.acdfg_2()];
+        iso = new IsoRepr(loadAcdfg(range1.offset, range1.size),
+                          loadAcdfg(range2.offset, range2.size));
+        for (int k = 0; k < isoRef.nodesmap_size(); k++)
+          iso->addNodeRel(isoRef.nodesmap(k).id_1(), isoRef.nodesmap(k).id_2());
+        for (int k = 0; k < isoRef.edgesmap_size(); k++)
+          iso->addEdgeRel(isoRef.edgesmap(k).id_1(), isoRef.edgesmap(k).id_2());
+      } else if (protoIso.has_iso()) {
+        iso = new IsoRepr(protoIso.iso());
+      } else {
+        return 1;
+      }
+
+      bin->setIso(protoIso.method_name(), iso);
+    }
+
+    return 0;
+  }
+
+} // end fixrgraphiso namespace
@@ -0,0 +1,87 @@
+// -*- C++ -*-
+//
+// Index of a lattice file that is memory mapped and decoded lazily
+//
+
+#ifndef LATTICE_INDEX_H_INCLUDED
+#define LATTICE_INDEX_H_INCLUDED
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <stdint.h>
+#include "fixrgraphiso/acdfgBin.h"
+
+namespace fixrgraphiso {
+  using std::string;
+  using std::map;
+
+  struct LatticeIndexHeader;
+  struct LatticeIndexBin;
+  struct LatticeIndexRange;
+
+  /**
+   * Index of a lattice file (e.g., lattice.bin.idx).
+   *
+   * The index stores the classification, the relations and the names
+   * of the bins in fixed-layout arrays, and the position of the acdfgs
+   * in the lattice file. Both files are memory mapped: the representative
+   * of a bin is decoded on its first access and the isomorphisms of the
+   * members only if requested with loadIsos.
+   *
+   * The representatives can be decoded concurrently (e.g., by searches
+   * sharing the lattice), loadIsos must not.
+   *
+   * The index must outlive the lattice returned by getLattice.
+   */
+  class LatticeIndex : public AcdfgLoader {
+  public:
+    LatticeIndex();
+    ~LatticeIndex();
+
+    static string getIndexFileName(const string & latticeFile);
+    static int write(const string & latticeFile, const string & indexFile);
+
+    int open(const string & latticeFile, const string & indexFile);
+
+    Lattice* getLattice() const { return lattice; }
+    const map<AcdfgBin*, int> & getAcdfgBin2id() const {
+      return acdfgBin2id;
+    }
+
+    const char* getLatticeData() const { return latticeData; }
+    size_t getLatticeSize() const { return latticeSize; }
+    /* FNV-1a hash of the lattice file, computed when writing the index */
+    uint64_t getLatticeHash() const;
+
+    Acdfg* loadRepresentative(const AcdfgBin* bin);
+    int loadIsos(AcdfgBin* bin);
+    int getDecodedCount() const {
+      std::lock_guard<std::mutex> guard(decodeLock);
+      return decodedAcdfgs.size();
+    }
+
+  private:
+    bool isConsistent(const LatticeIndexRange* names,
+                      const uint32_t* refs) const;
+    Acdfg* loadAcdfg(uint64_t offset, uint64_t size);
+    void close();
+
+    const char* latticeData;
+    size_t latticeSize;
+    const char* indexData;
+    size_t indexSize;
+
+    const LatticeIndexHeader* header;
+    const LatticeIndexBin* bins;
+
+    Lattice* lattice;
+    map<AcdfgBin*, int> acdfgBin2id;
+    // acdfgs already decoded, by offset in the lattice file
+    map<uint64_t, Acdfg*> decodedAcdfgs;
+    mutable std::mutex decodeLock;
+  };
+
+} // end fixrgraphiso namespace
+
+#endif // LATTICE_INDEX_H_INCLUDED
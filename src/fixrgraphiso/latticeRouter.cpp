@@ -0,0 +1,170 @@
+// -*- C++ -*-
+//
+// Routing index selecting the lattices relevant to a query
+//
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include "fixrgraphiso/latticeRouter.h"
+#include "fixrgraphiso/serializationLattice.h"
+#include "fixrgraphiso/findDuplicates.h"
+#include "fixrgraphiso/compression.h"
+#include "fixrgraphiso/proto_search.pb.h"
+
+namespace fixrgraphiso {
+  using std::endl;
+  using std::cerr;
+  namespace fixr_protobuf = edu::colorado::plv::fixr::protobuf;
+
+  LatticeRouter::LatticeRouter() {
+  }
+
+  void LatticeRouter::addEntry(const Entry & entry) {
+    int pos = entries.size();
+    entries.push_back(entry);
+    for (const string & methodName : entry.methodNames)
+      methodToEntries[methodName].push_back(pos);
+  }
+
+  void LatticeRouter::addLattice(const string & latticeFile, int latticeId,
+                                 Lattice & lattice) {
+    Entry entry;
+    entry.latticeFile = latticeFile;
+    entry.latticeId = latticeId;
+    entry.methodNames.insert(lattice.getMethodNames().begin(),
+                             lattice.getMethodNames().end());
+
+    for (AcdfgBin* popular : lattice.getPopularBins()) {
+      set<string> methods;
+      popular->getRepresentative()->fill_methods(methods);
+      entry.popularMethods.push_back(methods);
+    }
+
+    addEntry(entry);
+  }
+
+  /**
+   * Add all the lattices in the list (one "<id> <lattice_file>" per line)
+   */
+  int LatticeRouter::addLatticeList(const string & latticeListFile) {
+    vector<std::pair<string,int>> latticeNamesList;
+    if (0 != readLatticeList(latticeListFile, latticeNamesList))
+      return 1;
+
+    for (auto latticeName : latticeNamesList) {
+      Lattice* lattice = readLattice(latticeName.first);
+      if (NULL == lattice) {
+        cerr << "Cannot read the lattice in " << latticeName.first << endl;
+        return 1;
+      }
+      addLattice(latticeName.first, latticeName.second, *lattice);
+      delete lattice;
+    }
+    return 0;
+  }
+
+  int LatticeRouter::read(const string & indexFile) {
+    fixr_protobuf::LatticeRoutingIndex protoIndex;
+    std::ifstream input(indexFile.c_str(), std::ios::in | std::ios::binary);
+    if (! input.is_open() || ! parseFromStream(input, &protoIndex)) {
+      cerr << "Cannot read the routing index " << indexFile << endl;
+      return 1;
+    }
+
+    for (const auto & protoEntry : protoIndex.lattices()) {
+      Entry entry;
+      entry.latticeFile = protoEntry.lattice_file();
+      entry.latticeId = protoEntry.lattice_id();
+      entry.methodNames.insert(protoEntry.method_names().begin(),
+                               protoEntry.method_names().end());
+      for (const auto & protoPopular : protoEntry.popular())
+        entry.popularMethods.push_back(set<string>(protoPopular.method_names().begin(),
+                                                   protoPopular.method_names().end()));
+      addEntry(entry);
+    }
+    return 0;
+  }
+
+  int LatticeRouter::write(const string & indexFile) const {
+    fixr_protobuf::LatticeRoutingIndex protoIndex;
+    for (const Entry & entry : entries) {
+      fixr_protobuf::LatticeRoutingIndex::Entry* protoEntry =
+        protoIndex.add_lattices();
+      protoEntry->set_lattice_file(entry.latticeFile);
+      protoEntry->set_lattice_id(entry.latticeId);
+      for (const string & methodName : entry.methodNames)
+        protoEntry->add_method_names(methodName);
+      for (const set<string> & methods : entry.popularMethods) {
+        fixr_protobuf::LatticeRoutingIndex::PopularMethods* protoPopular =
+          protoEntry->add_popular();
+        for (const string & methodName : methods)
+          protoPopular->add_method_names(methodName);
+      }
+    }
+
+    std::ofstream output(indexFile.c_str(),
+                         std::ios::out | std::ios::binary | std::ios::trunc);
+    if (! output.is_open() || ! serializeToStream(protoIndex, output)) {
+      cerr << "Cannot write the routing index " << indexFile << endl;
+      return 1;
+    }
+    return 0;
+  }
+
+  void LatticeRouter::route(Acdfg & query, int minOverlap, int maxRoutes,
+                            vector<LatticeRoute> & routes) const {
+    set<string> queryMethods;
+    query.fill_methods(queryMethods);
+
+    // count the methods of the query in each lattice
+    map<int, int> overlap;
+    for (const string & methodName : queryMethods) {
+      auto it = methodToEntries.find(methodName);
+      if (it == methodToEntries.end())
+        continue;
+      for (int pos : it->second)
+        overlap[pos] += 1;
+    }
+
+    vector<LatticeRoute> found;
+    for (auto posCount : overlap) {
+      if (posCount.second < minOverlap)
+        continue;
+
+      const Entry & entry = entries[posCount.first];
+      double coverage = 0;
+      for (const set<string> & methods : entry.popularMethods) {
+        if (methods.empty())
+          continue;
+        int common = 0;
+        for (const string & methodName : methods)
+          common += queryMethods.count(methodName);
+        coverage = std::max(coverage, ((double) common) / methods.size());
+      }
+      // no popular bin to compare with the query
+      if (coverage <= 0)
+        continue;
+
+      LatticeRoute route;
+      route.latticeFile = entry.latticeFile;
+      route.latticeId = entry.latticeId;
+      route.methodOverlap = posCount.second;
+      route.popularCoverage = coverage;
+      found.push_back(route);
+    }
+
+    // stable, the lattices with the same score stay in the index order
+    std::stable_sort(found.begin(), found.end(),
+                     [](const LatticeRoute & a, const LatticeRoute & b) {
+                       if (a.popularCoverage != b.popularCoverage)
+                         return a.popularCoverage > b.popularCoverage;
+                       return a.methodOverlap > b.methodOverlap;
+                     });
+
+    if (maxRoutes > 0 && found.size() > maxRoutes)
+      found.resize(maxRoutes);
+    routes.insert(routes.end(), found.begin(), found.end());
+  }
+
+} // end fixrgraphiso namespace
@@ -0,0 +1,84 @@
+// -*- C++ -*-
+//
+// Routing index selecting the lattices relevant to a query
+//
+
+#ifndef LATTICE_ROUTER_H_INCLUDED
+#define LATTICE_ROUTER_H_INCLUDED
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include "fixrgraphiso/acdfg.h"
+#include "fixrgraphiso/acdfgBin.h"
+
+namespace fixrgraphiso {
+  using std::string;
+  using std::vector;
+  using std::set;
+  using std::map;
+
+  /* A lattice selected for a query */
+  struct LatticeRoute {
+    string latticeFile;
+    int latticeId;
+    // number of methods of the query in the lattice
+    int methodOverlap;
+    // max fraction of the methods of a popular bin found in the query
+    double popularCoverage;
+  };
+
+  /**
+   * Index of the methods of a set of lattices (e.g., the cluster
+   * lattices in a lattice list).
+   *
+   * For each lattice the index keeps its method names and the methods
+   * of its popular bins. A lattice can give results for a query only if
+   * the query contains some of its methods (otherwise the sliced query
+   * is empty) and some of the methods of a popular bin (the search only
+   * compares the query with the popular bins), so route skips all the
+   * other lattices.
+   *
+   * The methods are matched by name.
+   */
+  class LatticeRouter {
+  public:
+    LatticeRouter();
+
+    void addLattice(const string & latticeFile, int latticeId,
+                    Lattice & lattice);
+    int addLatticeList(const string & latticeListFile);
+
+    int read(const string & indexFile);
+    int write(const string & indexFile) const;
+
+    int size() const { return entries.size(); }
+
+    /**
+     * Find the lattices sharing at least minOverlap methods with the
+     * query, ranked by the coverage of their best popular bin and then
+     * by the number of common methods. Return at most maxRoutes lattices
+     * (all of them if maxRoutes is 0).
+     */
+    void route(Acdfg & query, int minOverlap, int maxRoutes,
+               vector<LatticeRoute> & routes) const;
+
+  private:
+    struct Entry {
+      string latticeFile;
+      int latticeId;
+      set<string> methodNames;
+      vector<set<string>> popularMethods;
+    };
+
+    void addEntry(const Entry & entry);
+
+    vector<Entry> entries;
+    // position in entries of the lattices containing a method
+    map<string, vector<int>> methodToEntries;
+  };
+
+} // end fixrgraphiso namespace
+
+#endif // LATTICE_ROUTER_H_INCLUDED
@@ -0,0 +1,7 @@
+#include "fixrgraphiso/frequentSubgraphs.h"
+
+int main(int argc, char * argv[]){
+  fixrgraphiso::FrequentSubgraphMiner miner;
+
+  return miner.merge(argc, argv);
+}
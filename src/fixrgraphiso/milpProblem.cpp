@@ -166,7 +166,22 @@ namespace fixrgraphiso{
 
     return len;
   }
-  void MILProblem::solveUsingGLPKLibrary(const bool debug){
+  /**
+   * GLPK keeps its environment in thread-local storage (when built with
+   * TLS, the default), so the problems can be solved concurrently in
+   * different threads. The environment of a thread is allocated by its
+   * first call to GLPK and must be freed by the same thread, when the
+   * thread terminates.
+   */
+  struct GlpkThreadEnv {
+    ~GlpkThreadEnv() { glp_free_env(); }
+  };
+
+  bool MILProblem::solveUsingGLPKLibrary(const bool debug,
+                                         const int timeLimit){
+    thread_local GlpkThreadEnv threadEnv;
+    (void) threadEnv;
+
     glp_prob * lp;
     lp = glp_create_prob();
     int nRows = (int) (this -> ineqs.size() + this -> eqs.size());
@@ -246,11 +261,21 @@ namespace fixrgraphiso{
     params.gmi_cuts=GLP_ON;
     params.mir_cuts=GLP_ON;
     params.cov_cuts=GLP_ON;
+    // the results of the searches may be written on stdout
+    params.msg_lev = debug ? GLP_MSG_ALL : GLP_MSG_OFF;
+    if (timeLimit > 0)
+      params.tm_lim = timeLimit;
     int rVal = glp_intopt(lp, &params);
-    if (rVal == 0){
-      std::cout << "Problem sucessfully solved ! " << std::endl;
+    if (rVal == GLP_ETMLIM && timeLimit > 0) {
+      if (debug) std::cout << "Time limit reached " << std::endl;
+      delete[] (ind);
+      delete[] (val);
+      glp_delete_prob(lp);
+      return false;
+    } else if (rVal == 0){
+      if (debug) std::cout << "Problem sucessfully solved ! " << std::endl;
     } else {
-      std::cout << " GLPK bailed with error code " << std::endl;
+      std::cerr << " GLPK bailed with error code " << std::endl;
       assert(false);
     }
 
@@ -258,27 +283,27 @@ namespace fixrgraphiso{
     switch (stat){
     case GLP_OPT:
       {
-        std::cout << "Optimal solution found " << std::endl;
+        if (debug) std::cout << "Optimal solution found " << std::endl;
 
       }
       break;
     case GLP_FEAS:
       {
-        std::cout << "Solver could not find optimal integer solution due to premature termination, perhaps " << std::endl;
+        std::cerr << "Solver could not find optimal integer solution due to premature termination, perhaps " << std::endl;
         assert(false);
       }
       break;
 
     case GLP_NOFEAS:
       {
-        std::cout << " Problem is primal infeasible " << std::endl;
+        std::cerr << " Problem is primal infeasible " << std::endl;
         assert(false);
       }
       break;
 
     case GLP_UNDEF:
       {
-        std::cout << "Solver bailed out with undefined message " << std::endl;
+        std::cerr << "Solver bailed out with undefined message " << std::endl;
         assert(false);
       }
       break;
@@ -288,7 +313,7 @@ namespace fixrgraphiso{
 
     // Extract the solution from the result, if feasible.
     objValue =  glp_mip_obj_val(lp);
-    std:: cout << " \t Objective Value : " << objValue << std::endl;
+    if (debug) std::cout << " \t Objective Value : " << objValue << std::endl;
 
     for (it = id2Variable.begin(); it != id2Variable.end(); ++it){
 
@@ -331,7 +356,7 @@ namespace fixrgraphiso{
     delete[] (ind);
     delete[] (val);
     glp_delete_prob(lp);
-
+    return true;
   }
 
 
@@ -357,6 +382,8 @@ namespace fixrgraphiso{
     try {
       GRBEnv env = GRBEnv();
       env.set(GRB_DoubleParam_TimeLimit, gurobi_timeout);
+      // the results of the searches may be written on stdout
+      env.set(GRB_IntParam_OutputFlag, debug ? 1 : 0);
       GRBModel m = GRBModel(env);
 
       std::map<int, GRBVar> id2VarMap;
@@ -409,9 +436,9 @@ namespace fixrgraphiso{
       int optimstatus = m.get(GRB_IntAttr_Status);
       // Retrieve the solution
       if (optimstatus == GRB_OPTIMAL){
-        std::cout << "Gurobi successfully optimized " << std::endl;
+        if (debug) std::cout << "Gurobi successfully optimized " << std::endl;
         float objValue = m.get(GRB_DoubleAttr_ObjVal);
-        std:: cout << " \t Objective Value : " << objValue << std::endl;
+        if (debug) std::cout << " \t Objective Value : " << objValue << std::endl;
 
         for (it = id2Variable.begin(); it != id2Variable.end(); ++it){
 
@@ -456,22 +483,22 @@ namespace fixrgraphiso{
       } else {
         switch (optimstatus) {
         case GRB_INF_OR_UNBD:
-          std::cout << "Model is either infeasible or unbounded but not sure which! " << std::endl;
+          std::cerr << "Model is either infeasible or unbounded but not sure which! " << std::endl;
           break;
         case GRB_INFEASIBLE:
-          std::cout << "Model is infeasible " << std::endl;
+          std::cerr << "Model is infeasible " << std::endl;
           break;
 
         case GRB_UNBOUNDED:
-          std::cout << "Model is unbounded " << std::endl;
+          std::cerr << "Model is unbounded " << std::endl;
           break;
 
         case GRB_TIME_LIMIT:
-          std::cout << "Time limit exceeded " << std::endl;
+          if (debug) std::cout << "Time limit exceeded " << std::endl;
           solvedSuccessfully = false;
           break;
         default:
-          std::cout << "Optimization was stopped with status = "
+          std::cerr << "Optimization was stopped with status = "
                     << optimstatus << std::endl;
           break;
         }
@@ -69,7 +69,8 @@ namespace fixrgraphiso {
 
     void prettyPrintAMPLFormat(std::ostream & out);
 
-    void solveUsingGLPKLibrary(const bool debug);
+    /* Return false if the time limit (in ms, 0 is none) is reached */
+    bool solveUsingGLPKLibrary(const bool debug, const int timeLimit = 0);
 
     #ifdef USE_GUROBI_SOLVER
     bool solveUsingGurobiLibrary(const bool debug,
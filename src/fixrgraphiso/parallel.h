@@ -0,0 +1,91 @@
+#ifndef D__PARALLEL__H__
+#define D__PARALLEL__H__
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace fixrgraphiso {
+
+  /**
+   * Number of threads to use when numThreads is 0 (i.e., one per core).
+   */
+  inline int getNumThreads(int numThreads) {
+    if (numThreads > 0)
+      return numThreads;
+    int cores = std::thread::hardware_concurrency();
+    return cores > 0 ? cores : 1;
+  }
+
+  /**
+   * \brief Calls f(i) for all i in [begin, end) using numThreads threads.
+   *
+   * The range is split in contiguous chunks, one per thread, of at
+   * least minChunk elements. The calls must not write any shared data.
+   * With one thread (or a small range) the calls are done in order in
+   * the calling thread.
+   */
+  template <typename F>
+  void parallelFor(int begin, int end, int numThreads, const F & f,
+                   int minChunk = 16) {
+    const int size = end - begin;
+    int threads = getNumThreads(numThreads);
+
+    if (threads > size / minChunk)
+      threads = size / minChunk;
+
+    if (threads <= 1) {
+      for (int i = begin; i < end; i++)
+        f(i);
+      return;
+    }
+
+    std::vector<std::thread> workers;
+    const int chunk = (size + threads - 1) / threads;
+    for (int start = begin; start < end; start += chunk) {
+      int stop = start + chunk < end ? start + chunk : end;
+      workers.push_back(std::thread([start, stop, &f]() {
+            for (int i = start; i < stop; i++)
+              f(i);
+          }));
+    }
+
+    for (auto & worker : workers)
+      worker.join();
+  }
+
+  /**
+   * \brief Calls f(i) for all i in [begin, end) using numThreads threads.
+   *
+   * Each thread takes the next index as soon as it is done with the
+   * previous one, so use it instead of parallelFor when the cost of the
+   * calls varies a lot. The calls are done in any order.
+   */
+  template <typename F>
+  void parallelForDynamic(int begin, int end, int numThreads, const F & f) {
+    int threads = getNumThreads(numThreads);
+    if (threads > end - begin)
+      threads = end - begin;
+
+    std::atomic<int> next(begin);
+    auto work = [&next, end, &f]() {
+      for (int i = next++; i < end; i = next++)
+        f(i);
+    };
+
+    if (threads <= 1) {
+      work();
+      return;
+    }
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; i++)
+      workers.push_back(std::thread(work));
+
+    for (auto & worker : workers)
+      worker.join();
+  }
+
+}
+
+#endif
@@ -0,0 +1,81 @@
+// -*- C++ -*-
+//
+// Search many queries in the same lattice concurrently
+//
+
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <google/protobuf/util/delimited_message_util.h>
+#include "fixrgraphiso/searchBatch.h"
+#include "fixrgraphiso/searchLattice.h"
+#include "fixrgraphiso/frozenLattice.h"
+#include "fixrgraphiso/serialization.h"
+#include "fixrgraphiso/parallel.h"
+
+namespace fixrgraphiso {
+  using std::endl;
+  using std::cerr;
+  namespace fixr_protobuf = edu::colorado::plv::fixr::protobuf;
+
+  int searchBatch(Lattice* lattice,
+                  const map<AcdfgBin*, int> & acdfgBin2id,
+                  const vector<string> & queryFiles,
+                  int numThreads,
+                  const SearchOptions & options,
+                  SearchCache* cache,
+                  google::protobuf::io::ZeroCopyOutputStream* output) {
+    std::mutex outputLock;
+    int errors = 0;
+
+    FrozenLattice view(lattice);
+
+    parallelForDynamic(0, queryFiles.size(), numThreads, [&](int i) {
+        auto start = std::chrono::steady_clock::now();
+        fixr_protobuf::SearchResults* protoResults;
+
+        Acdfg* query = readAcdfg(queryFiles[i]);
+        if (NULL == query) {
+          protoResults = new fixr_protobuf::SearchResults();
+          protoResults->set_error("Cannot read the query acdfg");
+        } else {
+          vector<SearchResult*> results;
+#ifdef USE_GUROBI_SOLVER
+          SearchLattice searchLattice(query, &view, false, 30);
+#else
+          SearchLattice searchLattice(query, &view, false);
+#endif
+          searchLattice.setOptions(options);
+          protoResults = searchWithCache(searchLattice, acdfgBin2id, cache,
+                                         results);
+
+          for (SearchResult* result : results)
+            delete result;
+          delete query;
+        }
+
+        auto end = std::chrono::steady_clock::now();
+        protoResults->set_query_file(queryFiles[i]);
+        protoResults->set_search_time_us(
+            std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+
+        {
+          std::lock_guard<std::mutex> guard(outputLock);
+          if (protoResults->has_error()) {
+            cerr << "Cannot search " << queryFiles[i] << ": " <<
+              protoResults->error() << endl;
+            errors++;
+          }
+          if (! google::protobuf::util::SerializeDelimitedToZeroCopyStream(*protoResults,
+                                                                           output)) {
+            cerr << "Cannot write the results of " << queryFiles[i] << endl;
+            errors++;
+          }
+        }
+        delete protoResults;
+      });
+
+    return errors;
+  }
+
+} // end fixrgraphiso namespace
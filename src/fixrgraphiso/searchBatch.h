@@ -0,0 +1,44 @@
+// -*- C++ -*-
+//
+// Search many queries in the same lattice concurrently
+//
+
+#ifndef SEARCH_BATCH_H_INCLUDED
+#define SEARCH_BATCH_H_INCLUDED
+
+#include <map>
+#include <string>
+#include <vector>
+#include <google/protobuf/io/zero_copy_stream.h>
+#include "fixrgraphiso/acdfgBin.h"
+#include "fixrgraphiso/searchLattice.h"
+#include "fixrgraphiso/searchCache.h"
+
+namespace fixrgraphiso {
+  using std::string;
+  using std::vector;
+  using std::map;
+
+  /**
+   * Search all the queries in queryFiles using numThreads threads and
+   * the given search options. The results of the queries already
+   * searched are taken from the cache, if cache is not NULL.
+   *
+   * Writes a length-delimited SearchResults message for each query in
+   * output, in the order the searches terminate. The results refer to
+   * the bins with the ids in acdfgBin2id, and contain the name of the
+   * query file and the time taken by the search.
+   *
+   * Return the number of queries that could not be answered.
+   */
+  int searchBatch(Lattice* lattice,
+                  const map<AcdfgBin*, int> & acdfgBin2id,
+                  const vector<string> & queryFiles,
+                  int numThreads,
+                  const SearchOptions & options,
+                  SearchCache* cache,
+                  google::protobuf::io::ZeroCopyOutputStream* output);
+
+} // end fixrgraphiso namespace
+
+#endif // SEARCH_BATCH_H_INCLUDED
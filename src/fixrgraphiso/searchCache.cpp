@@ -0,0 +1,314 @@
+// -*- C++ -*-
+//
+// Cache of the search results of the queries on a lattice
+//
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#include "fixrgraphiso/searchCache.h"
+#include "fixrgraphiso/serialization.h"
+#include "fixrgraphiso/compression.h"
+#include "fixrgraphiso/fingerprint.h"
+
+namespace fixrgraphiso {
+  using std::endl;
+  using std::cerr;
+
+  static const char* LATTICE_HASH_FILE = "LATTICE";
+  static const char* RESULTS_SUFFIX = ".res";
+
+  SearchCache::SearchCache(const string & latticeHash, size_t maxEntries) :
+    latticeHash(latticeHash), maxEntries(maxEntries), hits(0), misses(0) {
+  }
+
+  static bool endsWith(const string & s, const string & suffix) {
+    return s.size() >= suffix.size() &&
+      0 == s.compare(s.size() - suffix.size(), suffix.size(), suffix);
+  }
+
+  /* Write data to fileName, replacing it atomically */
+  static bool writeFileAtomic(const string & fileName, const string & data) {
+    std::ostringstream tmpName;
+    tmpName << fileName << ".tmp." << getpid() << "." <<
+      std::hash<std::thread::id>()(std::this_thread::get_id());
+    {
+      std::ofstream out(tmpName.str().c_str(),
+                        std::ios::out | std::ios::binary | std::ios::trunc);
+      if (! out.is_open())
+        return false;
+      out.write(data.data(), data.size());
+      if (! out.good())
+        return false;
+    }
+    if (0 != rename(tmpName.str().c_str(), fileName.c_str())) {
+      unlink(tmpName.str().c_str());
+      return false;
+    }
+    return true;
+  }
+
+  /**
+   * Use spillDir to store the results, removing the results of another
+   * lattice
+   */
+  int SearchCache::setSpillDirectory(const string & spillDir) {
+    if (0 != mkdir(spillDir.c_str(), 0755) && EEXIST != errno) {
+      cerr << "Cannot create the cache directory " << spillDir << ": " <<
+        strerror(errno) << endl;
+      return 1;
+    }
+
+    string hashFileName = spillDir + "/" + LATTICE_HASH_FILE;
+    string storedHash;
+    {
+      std::ifstream hashFile(hashFileName.c_str());
+      if (hashFile.is_open())
+        std::getline(hashFile, storedHash);
+    }
+
+    if (storedHash != latticeHash) {
+      DIR* dir = opendir(spillDir.c_str());
+      if (NULL == dir) {
+        cerr << "Cannot read the cache directory " << spillDir << endl;
+        return 1;
+      }
+      for (struct dirent* entry = readdir(dir); NULL != entry;
+           entry = readdir(dir)) {
+        string name(entry->d_name);
+        if (endsWith(name, RESULTS_SUFFIX))
+          unlink((spillDir + "/" + name).c_str());
+      }
+      closedir(dir);
+
+      if (! writeFileAtomic(hashFileName, latticeHash + "\n")) {
+        cerr << "Cannot write the cache directory " << spillDir << endl;
+        return 1;
+      }
+    }
+
+    this->spillDir = spillDir;
+    return 0;
+  }
+
+  int SearchCache::setLatticeSpillDirectory(const string & spillDir,
+                                            const string & latticeFile) {
+    if (0 != mkdir(spillDir.c_str(), 0755) && EEXIST != errno) {
+      cerr << "Cannot create the cache directory " << spillDir << ": " <<
+        strerror(errno) << endl;
+      return 1;
+    }
+    return setSpillDirectory(spillDir + "/" +
+                             fingerprint(latticeFile.data(), latticeFile.size()));
+  }
+
+  string SearchCache::getSpillFileName(const string & queryKey) const {
+    return spillDir + "/" + fingerprint(queryKey.data(), queryKey.size()) +
+      RESULTS_SUFFIX;
+  }
+
+  void SearchCache::insertEntry(const string & queryKey,
+                                const string & results) {
+    std::lock_guard<std::mutex> guard(lock);
+
+    auto it = keyToEntry.find(queryKey);
+    if (it != keyToEntry.end()) {
+      entries.erase(it->second);
+      keyToEntry.erase(it);
+    }
+
+    Entry entry;
+    entry.queryKey = queryKey;
+    entry.results = results;
+    entries.push_front(entry);
+    keyToEntry[queryKey] = entries.begin();
+
+    while (entries.size() > maxEntries) {
+      keyToEntry.erase(entries.back().queryKey);
+      entries.pop_back();
+    }
+  }
+
+  bool SearchCache::lookup(const string & queryKey,
+                           fixr_protobuf::SearchResults & results) {
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      auto it = keyToEntry.find(queryKey);
+      if (it != keyToEntry.end()) {
+        entries.splice(entries.begin(), entries, it->second);
+        if (results.ParseFromString(it->second->results)) {
+          hits++;
+          return true;
+        }
+      }
+    }
+
+    if (! spillDir.empty()) {
+      fixr_protobuf::CachedSearchResults cached;
+      std::ifstream input(getSpillFileName(queryKey).c_str(),
+                          std::ios::in | std::ios::binary);
+      // different keys can have the same fingerprint
+      if (input.is_open() && parseFromStream(input, &cached) &&
+          cached.query_key() == queryKey &&
+          results.ParseFromString(cached.results())) {
+        insertEntry(queryKey, cached.results());
+        hits++;
+        return true;
+      }
+    }
+
+    misses++;
+    return false;
+  }
+
+  void SearchCache::insert(const string & queryKey,
+                           const fixr_protobuf::SearchResults & results) {
+    string data;
+    if (! results.SerializeToString(&data))
+      return;
+    insertEntry(queryKey, data);
+
+    if (! spillDir.empty()) {
+      fixr_protobuf::CachedSearchResults cached;
+      cached.set_query_key(queryKey);
+      cached.set_results(data);
+
+      std::ostringstream out;
+      if (! serializeToStream(cached, out) ||
+          ! writeFileAtomic(getSpillFileName(queryKey), out.str()))
+        cerr << "Cannot write the cached results in " << spillDir << endl;
+    }
+  }
+
+  size_t SearchCache::size() {
+    std::lock_guard<std::mutex> guard(lock);
+    return entries.size();
+  }
+
+  /**
+   * The serialized sliced query, without the information on its source
+   * that do not change the results, followed by the options.
+   */
+  string SearchCache::getQueryKey(const Acdfg & slicedQuery,
+                                  const SearchOptions & options) {
+    AcdfgSerializer serializer;
+    acdfg_protobuf::Acdfg protoQuery;
+    serializer.fill_proto_from_acdfg(slicedQuery, &protoQuery);
+    protoQuery.clear_source_info();
+    protoQuery.clear_repo_tag();
+    protoQuery.clear_node_lines();
+
+    string key;
+    {
+      google::protobuf::io::StringOutputStream stringStream(&key);
+      google::protobuf::io::CodedOutputStream codedStream(&stringStream);
+      codedStream.SetSerializationDeterministic(true);
+      protoQuery.SerializeToCodedStream(&codedStream);
+    }
+
+    std::ostringstream optionsRepr;
+    optionsRepr << "\n" << options.similarTopK << " " <<
+      options.similarMinScore;
+    return key + optionsRepr.str();
+  }
+
+  static string hashRepr(uint64_t hash) {
+    char repr[17];
+    snprintf(repr, sizeof(repr), "%016llx", (unsigned long long) hash);
+    return string(repr);
+  }
+
+  string SearchCache::fingerprint(const char* data, size_t size) {
+    return hashRepr(fnvHash(data, size));
+  }
+
+  string SearchCache::hashLatticeData(const char* data, size_t size) {
+    return hashLattice(fnvHash(data, size), size);
+  }
+
+  string SearchCache::hashLattice(uint64_t dataHash, size_t size) {
+    return hashRepr(dataHash) + "-" + std::to_string(size);
+  }
+
+  /* Same as hashLatticeData on the content of the file */
+  int SearchCache::hashLatticeFile(const string & latticeFile, string & hash) {
+    std::ifstream input(latticeFile.c_str(), std::ios::in | std::ios::binary);
+    if (! input.is_open()) {
+      cerr << "Cannot read the lattice in " << latticeFile << endl;
+      return 1;
+    }
+
+    uint64_t fileHash = FNV_OFFSET;
+    size_t size = 0;
+    vector<char> buffer(1 << 20);
+    while (input) {
+      input.read(buffer.data(), buffer.size());
+      fileHash = fnvUpdate(fileHash, buffer.data(), input.gcount());
+      size += input.gcount();
+    }
+    if (input.bad()) {
+      cerr << "Cannot read the lattice in " << latticeFile << endl;
+      return 1;
+    }
+
+    hash = hashLattice(fileHash, size);
+    return 0;
+  }
+
+  /**
+   * Replace the query in the isomorphisms of the cached results (their
+   * acdfg_1, see SearchResult) with slicedQuery: the key does not
+   * contain the source information and the lines of the query, so the
+   * results could come from the same query at another position.
+   */
+  static void setCachedQuery(const Acdfg & slicedQuery,
+                             fixr_protobuf::SearchResults & results) {
+    AcdfgSerializer serializer;
+    acdfg_protobuf::Acdfg protoQuery;
+    serializer.fill_proto_from_acdfg(slicedQuery, &protoQuery);
+
+    for (auto & result : *results.mutable_results()) {
+      result.mutable_isotoreference()->mutable_acdfg_1()->CopyFrom(protoQuery);
+      if (result.has_isotoanomalous())
+        result.mutable_isotoanomalous()->mutable_acdfg_1()->CopyFrom(protoQuery);
+    }
+  }
+
+  fixr_protobuf::SearchResults*
+  searchWithCache(SearchLattice & search,
+                  const map<AcdfgBin*, int> & acdfgBin2id,
+                  SearchCache* cache,
+                  vector<SearchResult*> & results) {
+    string queryKey;
+    if (NULL != cache) {
+      queryKey = SearchCache::getQueryKey(*search.getSlicedQuery(),
+                                          search.getOptions());
+      fixr_protobuf::SearchResults* protoResults =
+        new fixr_protobuf::SearchResults();
+      if (cache->lookup(queryKey, *protoResults)) {
+        setCachedQuery(*search.getSlicedQuery(), *protoResults);
+        protoResults->set_cached(true);
+        return protoResults;
+      }
+      delete protoResults;
+    }
+
+    search.newSearch(results);
+    fixr_protobuf::SearchResults* protoResults =
+      search.toProto(results, acdfgBin2id);
+    // the partial results depend on the timeout
+    if (NULL != cache && ! protoResults->partial())
+      cache->insert(queryKey, *protoResults);
+    return protoResults;
+  }
+
+} // end fixrgraphiso namespace
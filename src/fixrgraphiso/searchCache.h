@@ -0,0 +1,115 @@
+// -*- C++ -*-
+//
+// Cache of the search results of the queries on a lattice
+//
+
+#ifndef SEARCH_CACHE_H_INCLUDED
+#define SEARCH_CACHE_H_INCLUDED
+
+#include <atomic>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+#include "fixrgraphiso/acdfg.h"
+#include "fixrgraphiso/searchLattice.h"
+#include "fixrgraphiso/proto_search.pb.h"
+
+namespace fixrgraphiso {
+  using std::string;
+  using std::vector;
+  using std::map;
+  namespace fixr_protobuf = edu::colorado::plv::fixr::protobuf;
+
+  /**
+   * Cache of the SearchResults of the queries on a lattice.
+   *
+   * The results are found by the key of the query (see getQueryKey),
+   * that depends only on the sliced query and on the search options: the
+   * same method searched again gives the same key, also after changing
+   * the code not in the lattice.
+   *
+   * The cache keeps the maxEntries most recently used results in memory.
+   * With a spill directory, the results are also written to disk (a file
+   * per query, named after the fingerprint of its key) and read back when
+   * missing in memory, so they are shared by different processes. The
+   * directory contains the hash of the lattice: the results of another
+   * lattice (e.g., after the lattice changed) are removed when the cache
+   * is opened.
+   *
+   * The cache can be used concurrently.
+   */
+  class SearchCache {
+  public:
+    /* Cache for the lattice with hash latticeHash (see hashLatticeData) */
+    SearchCache(const string & latticeHash, size_t maxEntries);
+
+    int setSpillDirectory(const string & spillDir);
+    /**
+     * Use a subdirectory of spillDir for the lattice file, so that the
+     * caches of different lattices can share spillDir
+     */
+    int setLatticeSpillDirectory(const string & spillDir,
+                                 const string & latticeFile);
+
+    bool lookup(const string & queryKey,
+                fixr_protobuf::SearchResults & results);
+    void insert(const string & queryKey,
+                const fixr_protobuf::SearchResults & results);
+
+    size_t size();
+    size_t getHits() const { return hits; }
+    size_t getMisses() const { return misses; }
+
+    /* Canonical representation of the sliced query and the options */
+    static string getQueryKey(const Acdfg & slicedQuery,
+                              const SearchOptions & options);
+    /* 64 bits FNV-1a hash of the data, in hex */
+    static string fingerprint(const char* data, size_t size);
+    static string hashLatticeData(const char* data, size_t size);
+    /* Same as hashLatticeData, from the FNV-1a hash of the data */
+    static string hashLattice(uint64_t dataHash, size_t size);
+    static int hashLatticeFile(const string & latticeFile, string & hash);
+
+  private:
+    struct Entry {
+      string queryKey;
+      // serialized SearchResults
+      string results;
+    };
+
+    void insertEntry(const string & queryKey, const string & results);
+    string getSpillFileName(const string & queryKey) const;
+
+    string latticeHash;
+    size_t maxEntries;
+    string spillDir;
+
+    std::mutex lock;
+    // most recently used first
+    std::list<Entry> entries;
+    std::unordered_map<string, std::list<Entry>::iterator> keyToEntry;
+    std::atomic<size_t> hits;
+    std::atomic<size_t> misses;
+  };
+
+  /**
+   * Search the query of search, or get its results from the cache (if
+   * cache is not NULL).
+   *
+   * The results found by the search are also stored in results (empty
+   * if the results come from the cache) and must be deleted by the
+   * caller.
+   */
+  fixr_protobuf::SearchResults*
+  searchWithCache(SearchLattice & search,
+                  const map<AcdfgBin*, int> & acdfgBin2id,
+                  SearchCache* cache,
+                  vector<SearchResult*> & results);
+
+} // end fixrgraphiso namespace
+
+#endif // SEARCH_CACHE_H_INCLUDED
@@ -1,6 +1,7 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <algorithm>
 
 #include "fixrgraphiso/searchLattice.h"
 #include "fixrgraphiso/isomorphismClass.h"
@@ -8,6 +9,7 @@
 
 #include "fixrgraphiso/ilpApproxIsomorphismEncoder.h"
 #include "fixrgraphiso/isomorphismResults.h"
+#include "fixrgraphiso/parallel.h"
 
 namespace fixrgraphiso {
   using std::vector;
@@ -34,15 +36,64 @@ namespace fixrgraphiso {
   }
 
 
+  void SearchLattice::init(Acdfg* query, const FrozenLattice* view,
+                           const bool debug) {
+    set<int> ignoreMethodIds;
+    this->query = query;
+    this->view = view;
+    this->lattice = view->getLattice();
+    this->slicedQuery = query->sliceACDFG(view->getMethodNames(),
+                                          ignoreMethodIds);
+    this->debug = debug;
+    this->skippedIlps = 0;
+    this->savedChecks = 0;
+    this->hasDeadline = false;
+    this->partial = false;
+  }
+
+  void SearchLattice::startDeadline() {
+    hasDeadline = options.timeoutMs > 0;
+    if (hasDeadline)
+      deadline = std::chrono::steady_clock::now() +
+        std::chrono::milliseconds(options.timeoutMs);
+  }
+
+  bool SearchLattice::expired() const {
+    return hasDeadline && std::chrono::steady_clock::now() >= deadline;
+  }
+
+  /* Time left before the deadline, at least 1 ms (0 means no limit) */
+  int SearchLattice::remainingMs() const {
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - std::chrono::steady_clock::now()).count();
+    return left > 1 ? left : 1;
+  }
+
+  static bool isCorrect(const SearchResult* result) {
+    return result->getType() == CORRECT;
+  }
+
+  /**
+   * The results of the lattice walk come before the approximate results
+   * of search_similar, so just move the CORRECT results first
+   */
+  void SearchLattice::rankPartialResults(vector<SearchResult*> & results) const {
+    std::stable_partition(results.begin(), results.end(), isCorrect);
+  }
+
   bool SearchLattice::subsumes(AcdfgBin* acdfgBin,
                                IsoRepr* &isoRepr) {
     IsoRepr *appIso = new IsoRepr(slicedQuery,
                                   acdfgBin->getRepresentative());
     IsoSubsumption d(slicedQuery,
                      acdfgBin->getRepresentative(),
-                     acdfgBin->getStats());
+                     &stats);
+    if (hasDeadline)
+      d.setTimeout(remainingMs());
 
     bool res = d.check(appIso);
+    if (d.timedOut())
+      partial = true;
 
     if (res) {
       isoRepr = appIso;
@@ -60,8 +111,12 @@ namespace fixrgraphiso {
 
     IsoSubsumption d(acdfgBin->getRepresentative(),
                      slicedQuery,
-                     acdfgBin->getStats());
+                     &stats);
+    if (hasDeadline)
+      d.setTimeout(remainingMs());
     bool res = d.check(appIso);
+    if (d.timedOut())
+      partial = true;
 
     if (res) {
       isoRepr = new IsoRepr((const IsoRepr&) *appIso, true);
@@ -79,24 +134,40 @@ namespace fixrgraphiso {
 
     /* get all the reachable anomalous pattern that are
        subsumed by the popular one.
-    */
-    for(AcdfgBin* subsuming : popBin->getSubsumingBins()) {
-      if (subsuming->isAnomalous()) {
-        IsoRepr* isoAnom = NULL;
-        if (isSubsumed(subsuming, isoAnom)) {
-          SearchResult* r = new SearchResult(ANOMALOUS_SUBSUMED);
-          r->setReferencePattern(popBin);
-          r->setAnomalousPattern(subsuming);
-          r->setIsoToReference(isoPop);
-          r->setIsoToAnomalous((const IsoRepr&) *isoAnom);
-          results.push_back(r);
 
-          /* the pattern is subsumed by at least an anomalous
-             pattern */
-          is_correct_subsumed = false;
-        }
-        if (NULL != isoAnom) delete(isoAnom);
+       The list starts from the most specific patterns: if the query
+       is not subsumed by an anomalous pattern, it is not subsumed by
+       the anomalous patterns below it either, and they are skipped.
+    */
+    vector<AcdfgBin*> notSubsuming;
+    for(AcdfgBin* subsuming : popBin->getSubsumingAnomalous()) {
+      bool below = std::any_of(notSubsuming.begin(), notSubsuming.end(),
+                               [subsuming](AcdfgBin* upper) {
+                                 return subsuming->hasSubsumingBin(upper);
+                               });
+      if (below)
+        continue;
+
+      if (expired()) {
+        partial = true;
+        break;
+      }
+      IsoRepr* isoAnom = NULL;
+      if (isSubsumed(subsuming, isoAnom)) {
+        SearchResult* r = new SearchResult(ANOMALOUS_SUBSUMED);
+        r->setReferencePattern(popBin);
+        r->setAnomalousPattern(subsuming);
+        r->setIsoToReference(isoPop);
+        r->setIsoToAnomalous((const IsoRepr&) *isoAnom);
+        results.push_back(r);
+
+        /* the pattern is subsumed by at least an anomalous
+           pattern */
+        is_correct_subsumed = false;
+      } else {
+        notSubsuming.push_back(subsuming);
       }
+      if (NULL != isoAnom) delete(isoAnom);
     }
 
     if (is_correct_subsumed) {
@@ -110,11 +181,15 @@ namespace fixrgraphiso {
   void SearchLattice::search(vector<SearchResult*> & results) {
     bool can_subsume = true;
     bool can_be_subsumed = true;
+    startDeadline();
 
     // Search the relative position of the slicedQuery w.r.t.
     // the popular pattern
-    for (auto it = lattice->beginPopular(); it != lattice->endPopular(); it++) {
-      AcdfgBin* popBin = *it;
+    for (AcdfgBin* popBin : view->getPopularBins()) {
+      if (expired()) {
+        partial = true;
+        break;
+      }
 
       if (can_subsume) {
         IsoRepr* isoPop = NULL;
@@ -125,6 +200,7 @@ namespace fixrgraphiso {
           r->setReferencePattern(popBin);
           r->setIsoToReference((const IsoRepr&) *isoPop);
           results.push_back(r);
+          delete(isoPop);
 
           /* cannot be subsumed by another popular pattern */
           can_be_subsumed = false;
@@ -152,6 +228,8 @@ namespace fixrgraphiso {
     if (can_subsume && can_be_subsumed) {
       search_similar(results);
     }
+    if (partial)
+      rankPartialResults(results);
   }
 
   int compareApproxIsoByNodes(Acdfg* query, Acdfg* pattern, IsoRepr* iso) {
@@ -208,62 +286,196 @@ namespace fixrgraphiso {
   }
 
   void SearchLattice::search_similar(vector<SearchResult*> & results) {
-    for (auto it = lattice->beginPopular(); it != lattice->endPopular(); it++) {
-      AcdfgBin* popBin = *it;
+    if (expired()) {
+      partial = true;
+      return;
+    }
 
-      IlpApproxIsomorphism ilp(slicedQuery, popBin->getRepresentative(), debug);
+    const vector<AcdfgBin*> & popularBins = view->getPopularBins();
+    vector<AcdfgBin*> candidates;
+
+    if (options.similarTopK <= 0 && options.similarMinScore <= 0) {
+      candidates = popularBins;
+    } else {
+      SimilarityFeatures queryFeatures(*slicedQuery);
+      const vector<SimilarityFeatures> & popularFeatures =
+        view->getPopularFeatures();
+      vector<std::pair<double, size_t>> scores;
+      for (size_t i = 0; i < popularBins.size(); i++) {
+        double score = queryFeatures.similarityScore(popularFeatures[i]);
+        if (score >= options.similarMinScore)
+          scores.push_back(std::make_pair(score, i));
+      }
+
+      // best scores first, the most popular bin first on the same score
+      std::stable_sort(scores.begin(), scores.end(),
+                       [](const std::pair<double, size_t> & a,
+                          const std::pair<double, size_t> & b) {
+                         return a.first > b.first;
+                       });
+      if (options.similarTopK > 0 && scores.size() > (size_t) options.similarTopK)
+        scores.resize(options.similarTopK);
+
+      // keep the results in the order of the popular bins
+      vector<size_t> positions;
+      for (auto scorePos : scores)
+        positions.push_back(scorePos.second);
+      std::sort(positions.begin(), positions.end());
+      for (size_t pos : positions)
+        candidates.push_back(popularBins[pos]);
+    }
+    skippedIlps += popularBins.size() - candidates.size();
+
+    // the ILPs are independent, each result goes in the position of its
+    // popular bin to report the results in the same order
+    vector<SearchResult*> found(candidates.size(), NULL);
+    parallelForDynamic(0, candidates.size(), options.ilpThreads,
+                       [&](int i) {
+                         found[i] = compareSimilar(candidates[i]);
+                       });
+    for (SearchResult* r : found) {
+      if (NULL != r)
+        results.push_back(r);
+    }
+  }
+
+  /**
+   * Compare the query with the popular bin solving the ILP.
+   *
+   * Return the approximate result, or NULL. Called concurrently on
+   * different bins.
+   */
+  SearchResult* SearchLattice::compareSimilar(AcdfgBin* popBin) {
+    if (expired()) {
+      partial = true;
+      return NULL;
+    }
+
+    IlpApproxIsomorphism ilp(slicedQuery, popBin->getRepresentative(), debug);
+    if (hasDeadline)
+      ilp.setTimeLimit(remainingMs());
 
 #ifdef USE_GUROBI_SOLVER
-      bool stat = ilp.computeILPEncoding(gurobi_timeout);
+    bool stat = ilp.computeILPEncoding(gurobi_timeout);
 #else
-      bool stat = ilp.computeILPEncoding();
+    bool stat = ilp.computeILPEncoding();
 #endif
+    if (! stat && expired())
+      partial = true;
+
+    if (stat) {
+      IsoRepr *appIso = new IsoRepr(slicedQuery,
+                                    popBin->getRepresentative());
+      ilp.populateResults((IsoRepr&) *appIso);
+
+      // Heuristic to consider "good" results
+      if (0 > compareApproxIsoByNodes(query,
+                                      popBin->getRepresentative(),
+                                      appIso)) {
+        // Here query misses some method nodes wrt popBin
+        SearchResult* r = new SearchResult(ANOMALOUS_SUBSUMED);
+        r->setReferencePattern(popBin);
+        r->setIsoToReference((const IsoRepr&) *appIso);
+        delete appIso;
+        return r;
+      } else {
+        delete appIso;
+      }
+    }
+    return NULL;
+  }
 
-      if (stat) {
-        IsoRepr *appIso = new IsoRepr(slicedQuery,
-                                      popBin->getRepresentative());
-        ilp.populateResults((IsoRepr&) *appIso);
+  static bool lessById(const AcdfgBin* a, const AcdfgBin* b) {
+    return a->getId() < b->getId();
+  }
 
-        // Heuristic to consider "good" results
-        if (0 > compareApproxIsoByNodes(query,
-                                        popBin->getRepresentative(),
-                                        appIso)) {
-          // Here query misses some method nodes wrt popBin
-          SearchResult* r = new SearchResult(ANOMALOUS_SUBSUMED);
-          r->setReferencePattern(popBin);
-          r->setIsoToReference((const IsoRepr&) *appIso);
-          results.push_back(r);
-        } else {
-          delete appIso;
-        }
-      }
+  /**
+   * Push the bins in the order of their ids, so that the visit does not
+   * depend on where the bins are allocated (e.g., when they are loaded
+   * from a lattice index)
+   */
+  static void pushById(const set<AcdfgBin*> & bins,
+                       vector<AcdfgBin*> & toVisit) {
+    size_t start = toVisit.size();
+    toVisit.insert(toVisit.end(), bins.begin(), bins.end());
+    std::sort(toVisit.begin() + start, toVisit.end(), lessById);
+  }
+
+  void SearchLattice::resetOutcomes() {
+    subsumedOutcomes.assign(lattice->getAllBins().size(), UNKNOWN_OUTCOME);
+    subsumingOutcomes.assign(lattice->getAllBins().size(), UNKNOWN_OUTCOME);
+  }
+
+  void SearchLattice::setOutcome(vector<char> & outcomes,
+                                 const set<AcdfgBin*> & bins,
+                                 Outcome outcome) {
+    // a check interrupted by the timeout is not a reliable negative
+    if (DOES_NOT_HOLD == outcome && partial)
+      return;
+    for (AcdfgBin* bin : bins)
+      outcomes[bin->getId()] = outcome;
+  }
+
+  /**
+   * isSubsumed, skipped if the query is known not to be subsumed by
+   * the bin.
+   *
+   * If query <= bin then query <= b for all the bins b above bin, while
+   * if not query <= bin then not query <= b for all the bins b below
+   * bin. A check that holds is always performed, since the search needs
+   * its isomorphism.
+   */
+  bool SearchLattice::checkSubsumed(AcdfgBin* acdfgBin, IsoRepr*& isoRepr) {
+    if (DOES_NOT_HOLD == subsumedOutcomes[acdfgBin->getId()]) {
+      savedChecks++;
+      return false;
+    }
+
+    bool res = isSubsumed(acdfgBin, isoRepr);
+    subsumedOutcomes[acdfgBin->getId()] = res ? HOLDS : DOES_NOT_HOLD;
+    if (res)
+      setOutcome(subsumedOutcomes, acdfgBin->getSubsumingBins(), HOLDS);
+    else
+      setOutcome(subsumedOutcomes, acdfgBin->getIncomingEdges(),
+                 DOES_NOT_HOLD);
+    return res;
+  }
+
+  /* Same as checkSubsumed for bin <= query, that holds below bin */
+  bool SearchLattice::checkSubsumes(AcdfgBin* acdfgBin, IsoRepr*& isoRepr) {
+    if (DOES_NOT_HOLD == subsumingOutcomes[acdfgBin->getId()]) {
+      savedChecks++;
+      return false;
     }
+
+    bool res = subsumes(acdfgBin, isoRepr);
+    subsumingOutcomes[acdfgBin->getId()] = res ? HOLDS : DOES_NOT_HOLD;
+    if (res)
+      setOutcome(subsumingOutcomes, acdfgBin->getIncomingEdges(), HOLDS);
+    else
+      setOutcome(subsumingOutcomes, acdfgBin->getSubsumingBins(),
+                 DOES_NOT_HOLD);
+    return res;
   }
 
   void SearchLattice::newSearch(vector<SearchResult*> & results) {
-    vector<AcdfgBin*> queue;
+    // start from the popular bins without popular ancestors
+    vector<AcdfgBin*> queue(view->getPopularRoots());
     set<AcdfgBin*> visited;
-    map<AcdfgBin*, set<AcdfgBin*>*> tr;
-    map<AcdfgBin*, set<AcdfgBin*>*> inverseTr;
 
     // Skip empty query --- this may happen after slicing
     if (this->slicedQuery->method_node_count() == 0)
       return;
 
-    lattice->buildTr(tr);
+    startDeadline();
+    resetOutcomes();
 
-    for (auto it = lattice->beginPopular(); it != lattice->endPopular(); it++) {
-      AcdfgBin* bin = *it;
-      bool has_popular_anc = false;
-
-      for (auto incomingBin : bin->getIncomingEdges()) {
-        has_popular_anc = has_popular_anc || incomingBin->isPopular();
+    while (! queue.empty()) {
+      if (expired()) {
+        partial = true;
+        break;
       }
-      if (! has_popular_anc)
-        queue.push_back(bin);
-    }
 
-    while (! queue.empty()) {
       AcdfgBin* bin = queue.back();
       queue.pop_back();
 
@@ -273,8 +485,19 @@ namespace fixrgraphiso {
       visited.insert(bin);
 
       IsoRepr* iso = NULL;
-
-      if (isSubsumed(bin, iso)) {
+      IsoRepr* iso2 = NULL;
+
+      /* query <= bin is known from a bin below: if also bin <= query
+         the isomorphism of query <= bin is not needed */
+      bool knownSubsumed = HOLDS == subsumedOutcomes[bin->getId()];
+      if (knownSubsumed && checkSubsumes(bin, iso2)) {
+        savedChecks++;
+
+        SearchResult* r = new SearchResult(CORRECT);
+        r->setReferencePattern(bin);
+        r->setIsoToReference((const IsoRepr&) *iso2);
+        results.push_back(r);
+      } else if (checkSubsumed(bin, iso)) {
         /* Stop, we found a place in the lattice for query:
            query <= bin
          */
@@ -282,21 +505,18 @@ namespace fixrgraphiso {
 
         assert(iso != NULL);
 
-        IsoRepr* iso2 = NULL;
-        if (subsumes(bin, iso2)) {
+        if ((! knownSubsumed) && checkSubsumes(bin, iso2)) {
           SearchResult* r = new SearchResult(CORRECT);
           r->setReferencePattern(bin);
           r->setIsoToReference((const IsoRepr&) *iso2);
           results.push_back(r);
-
-          delete iso; // iso not used in the result
         } else {
           SearchResult* r = new SearchResult(ANOMALOUS_SUBSUMED);
           r->setReferencePattern(bin);
           r->setIsoToReference((const IsoRepr&) *iso);
           results.push_back(r);
         }
-      } else if (subsumes(bin, iso)) {
+      } else if ((! knownSubsumed) && checkSubsumes(bin, iso)) {
         /* bin <= query */
 
         assert (iso != NULL);
@@ -304,17 +524,15 @@ namespace fixrgraphiso {
         /* get the "next" reachable descendant popular children */
         bool noPopularChildren = true;
         vector<AcdfgBin*> toVisit;
-        for (auto childBin : *tr[bin]) {
-          toVisit.push_back(childBin);
-        }
+        pushById(view->getTr(bin), toVisit);
         while (! toVisit.empty()) {
           AcdfgBin* childBin = toVisit.back();
           toVisit.pop_back();
           if (childBin->isPopular()) {
             queue.push_back(childBin);
             noPopularChildren = false;
-          } else for (auto succ : *tr[childBin])
-                   toVisit.push_back(succ);
+          } else
+            pushById(view->getTr(childBin), toVisit);
         }
 
         if (true || noPopularChildren) {
@@ -322,18 +540,20 @@ namespace fixrgraphiso {
           r->setReferencePattern(bin);
           r->setIsoToReference((const IsoRepr&) *iso);
           results.push_back(r);
-        } else {
-          delete iso; // iso not used in the results
         }
 
       } else {
         // Do nothing, not comparable
       }
+
+      // the results keep a copy of the isomorphisms
+      if (NULL != iso) delete(iso);
+      if (NULL != iso2) delete(iso2);
     }
 
     search_similar(results);
-
-    Lattice::deleteTr(tr);
+    if (partial)
+      rankPartialResults(results);
   }
 
   void printBin(const AcdfgBin& bin, ostream& out) {
@@ -395,17 +615,35 @@ namespace fixrgraphiso {
   fixr_protobuf::SearchResults*
   SearchLattice::toProto(const vector<SearchResult*> &results) {
     LatticeSerializer serializer;
-    fixr_protobuf::SearchResults *protoResults =
-      new fixr_protobuf::SearchResults();
 
     map<AcdfgBin*, int> acdfgBin2idMap;
     lattice->getAcdfgBin2id(acdfgBin2idMap);
 
+    fixr_protobuf::SearchResults *protoResults =
+      toProto(results, acdfgBin2idMap);
+
     /* serialize the lattice */
     acdfg_protobuf::Lattice* protoLattice =
       serializer.proto_from_lattice((const Lattice&) *lattice);
     protoResults->set_allocated_lattice(protoLattice);
 
+    return protoResults;
+  }
+
+  /**
+   * Serialize the results without the lattice, referring to the bins
+   * with the ids in acdfgBin2idMap (e.g., the ids in the lattice file)
+   */
+  fixr_protobuf::SearchResults*
+  SearchLattice::toProto(const vector<SearchResult*> &results,
+                         const map<AcdfgBin*, int> & acdfgBin2idMap) {
+    fixr_protobuf::SearchResults *protoResults =
+      new fixr_protobuf::SearchResults();
+    protoResults->set_skipped_ilps(skippedIlps);
+    protoResults->set_saved_checks(savedChecks);
+    if (partial)
+      protoResults->set_partial(true);
+
     /* serialize the results */
     for(SearchResult* result : results) {
       fixr_protobuf::SearchResults::SearchResult *protoRes = protoResults->add_results();
@@ -431,13 +669,13 @@ namespace fixrgraphiso {
         assert(false);
       }
 
-      int ref_id = acdfgBin2idMap[result->getReferencePattern()];
+      int ref_id = acdfgBin2idMap.at(result->getReferencePattern());
       protoRes->set_referencepatternid(ref_id);
 
       {
         AcdfgBin* a = result->getAnomalousPattern();
         if (NULL != a) {
-          int id = acdfgBin2idMap[a];
+          int id = acdfgBin2idMap.at(a);
           protoRes->set_anomalouspatternid(id);
         }
       }
@@ -7,8 +7,11 @@
 #include <map>
 #include <string>
 #include <set>
+#include <atomic>
+#include <chrono>
 #include "fixrgraphiso/acdfgBin.h"
 #include "fixrgraphiso/acdfg.h"
+#include "fixrgraphiso/frozenLattice.h"
 #include "fixrgraphiso/proto_search.pb.h"
 
 namespace fixrgraphiso {
@@ -29,6 +32,9 @@ namespace fixrgraphiso {
 
   /**
    * Single result
+   *
+   * The isomorphisms relate the sliced query (acdfg_1) to the
+   * representatives of the patterns (acdfg_2).
    */
   class SearchResult {
   public:
@@ -40,6 +46,11 @@ namespace fixrgraphiso {
       this->isoToAnomalous = NULL;
     }
 
+    ~SearchResult() {
+      if (NULL != isoToReference) delete isoToReference;
+      if (NULL != isoToAnomalous) delete isoToAnomalous;
+    }
+
     void setAnomalousPattern(AcdfgBin* anomalousPattern) {
       this->anomalousPattern = anomalousPattern;
     }
@@ -73,17 +84,68 @@ namespace fixrgraphiso {
     IsoRepr* isoToAnomalous;
   };
 
+  /**
+   * Options of the search
+   *
+   * search_similar compares the query with all the popular bins solving
+   * an ILP for each of them. Before solving the ILPs, the popular bins
+   * are ranked by a cheap similarity score (see similarityScore): only
+   * the similarTopK bins with the best score (all of them if 0) and a
+   * score of at least similarMinScore are compared with the ILP.
+   *
+   * The ILPs are solved by ilpThreads threads (0 is one per core).
+   *
+   * With a timeoutMs, the search stops after timeoutMs ms: the lattice
+   * walk, the subsumption checks and the ILPs are all interrupted, and
+   * the results found so far are returned as partial results.
+   *
+   * The defaults solve all the ILPs in the calling thread, without a
+   * timeout.
+   */
+  struct SearchOptions {
+    SearchOptions() : similarTopK(0), similarMinScore(0), ilpThreads(1),
+                      timeoutMs(0) {}
+
+    int similarTopK;
+    double similarMinScore;
+    int ilpThreads;
+    int timeoutMs;
+  };
+
   /**
    * Implement the search in the lattice
+   *
+   * The searches created on the same FrozenLattice can run concurrently.
+   * The search created on a Lattice sorts the lattice and builds its own
+   * view, so it cannot run concurrently with other searches.
    */
   class SearchLattice {
 
   private:
+    void init(Acdfg* query, const FrozenLattice* view, const bool debug);
     bool subsumes(AcdfgBin* acdfgBin, IsoRepr*& isoRepr);
     bool isSubsumed(AcdfgBin* acdfgBin, IsoRepr*& isoRepr);
     void findAnomalous(AcdfgBin* popBin, const IsoRepr& isoPop,
                        vector<SearchResult*> &results);
     void search_similar(vector<SearchResult*> & results);
+    SearchResult* compareSimilar(AcdfgBin* popBin);
+
+    /* Outcome of a subsumption check between the query and a bin */
+    enum Outcome {
+      UNKNOWN_OUTCOME = 0,
+      HOLDS,
+      DOES_NOT_HOLD
+    };
+    void resetOutcomes();
+    bool checkSubsumed(AcdfgBin* acdfgBin, IsoRepr*& isoRepr);
+    bool checkSubsumes(AcdfgBin* acdfgBin, IsoRepr*& isoRepr);
+    void setOutcome(vector<char> & outcomes, const set<AcdfgBin*> & bins,
+                    Outcome outcome);
+
+    void startDeadline();
+    bool expired() const;
+    int remainingMs() const;
+    void rankPartialResults(vector<SearchResult*> & results) const;
 
   public:
     SearchLattice(Acdfg* query, Lattice* lattice,
@@ -92,35 +154,78 @@ namespace fixrgraphiso {
                   , const double gurobi_timeout
 #endif
                   ) {
-      set<int> ignoreMethodIds;
-      this->query = query;
-      this->lattice = lattice;
-      this->slicedQuery = query->sliceACDFG(lattice->getMethodNames(),
-                                            ignoreMethodIds);
-      this->debug = debug;
 #ifdef USE_GUROBI_SOLVER
       this->gurobi_timeout = gurobi_timeout;
 #endif
-
       lattice->sortAllByFrequency();
+      this->ownedView = new FrozenLattice(lattice);
+      init(query, ownedView, debug);
+    }
+
+    SearchLattice(Acdfg* query, const FrozenLattice* view,
+                  const bool debug
+#ifdef USE_GUROBI_SOLVER
+                  , const double gurobi_timeout
+#endif
+                  ) {
+#ifdef USE_GUROBI_SOLVER
+      this->gurobi_timeout = gurobi_timeout;
+#endif
+      this->ownedView = NULL;
+      init(query, view, debug);
     }
 
     ~SearchLattice() {
       delete(slicedQuery);
+      if (NULL != ownedView)
+        delete(ownedView);
     }
 
     void printResult(const vector<SearchResult*> &results,
                      ostream & out_stream);
 
     fixr_protobuf::SearchResults* toProto(const vector<SearchResult*> &results);
+    fixr_protobuf::SearchResults*
+    toProto(const vector<SearchResult*> &results,
+            const std::map<AcdfgBin*, int> & acdfgBin2idMap);
 
     void search(vector<SearchResult*> &results);
     void newSearch(vector<SearchResult*> & results);
 
+    void setOptions(const SearchOptions & options) { this->options = options; }
+    const SearchOptions & getOptions() const { return options; }
+    const Acdfg* getSlicedQuery() const { return slicedQuery; }
+    /* Number of popular bins not compared with the ILP in search_similar */
+    int getSkippedIlps() const { return skippedIlps; }
+    /* Number of subsumption checks of newSearch inferred from the lattice */
+    int getSavedChecks() const { return savedChecks; }
+    /**
+     * True if the search reached the timeout: the results are then
+     * incomplete, and ranked with the CORRECT results first, then the
+     * results found in the lattice and then the approximate ones
+     */
+    bool isPartial() const { return partial; }
+
   private:
     Lattice* lattice;
+    const FrozenLattice* view;
+    // The view built for the lattice, if not given to the constructor
+    FrozenLattice* ownedView;
     Acdfg* query;
     Acdfg* slicedQuery;
+    // Not the stats of the lattice, that is shared by the searches
+    Stats stats;
+
+    SearchOptions options;
+    int skippedIlps;
+    // outcomes of newSearch, by bin id, for query <= bin and bin <= query
+    vector<char> subsumedOutcomes;
+    vector<char> subsumingOutcomes;
+    int savedChecks;
+    bool hasDeadline;
+    std::chrono::steady_clock::time_point deadline;
+    // set by the threads solving the ILPs
+    std::atomic<bool> partial;
 
     bool debug;
 #ifdef USE_GUROBI_SOLVER
@@ -0,0 +1,132 @@
+#include "fixrgraphiso/searchServer.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+
+using std::cerr;
+using std::endl;
+using std::string;
+using std::vector;
+
+using fixrgraphiso::SearchServer;
+using fixrgraphiso::SearchOptions;
+
+void printHelp() {
+  cerr << "searchlatticed " <<
+    "-l <lattice_file> [-l <lattice_file> ...] [-m] [-s <socket>] [-K <top_k>] [-S <min_score>] [-J <ilp_threads>] [-T <timeout_ms>] [-c <cache_entries> [-C <cache_dir>]]" << endl <<
+    "\t <lattice_file>: path to the file storing a lattice" << endl <<
+    "\t -m: load the lattices from their index (<lattice_file>.idx)" << endl <<
+    "\t <socket>: path of the unix socket accepting the clients " <<
+    "(default: serve stdin/stdout)" << endl <<
+    "\t <top_k>, <min_score>: compare with the ILP only the popular bins " <<
+    "most similar to the query (see searchlattice)" << endl <<
+    "\t <ilp_threads>: threads solving the ILPs of a query " <<
+    "(0 is one per core, default 1)" << endl <<
+    "\t <timeout_ms>: default timeout of the searches (0 is none, the " <<
+    "requests can set their own timeout)" << endl <<
+    "\t <cache_entries>: cache the results of the last <cache_entries> " <<
+    "queries of each lattice (default 0, no cache)" << endl <<
+    "\t <cache_dir>: also store the cached results in <cache_dir>, " <<
+    "to reuse them after a restart" << endl <<
+    "The requests (SearchRequest) and the answers (SearchResults) are " <<
+    "length-delimited protobuf messages." << endl;
+}
+
+int main(int argc, char * argv[]){
+  extern char *optarg;
+  extern int optind;
+
+  vector<string> latticeFileNames;
+  string* socketPath = NULL;
+  bool useIndex = false;
+  SearchOptions options;
+  size_t cacheEntries = 0;
+  string cacheDir;
+
+  char c;
+  while ((c = getopt(argc, argv, "l:ms:K:S:J:c:C:T:")) != -1) {
+    switch (c){
+    case 'l': {
+      latticeFileNames.push_back(string(optarg));
+      break;
+    }
+    case 'm': {
+      useIndex = true;
+      break;
+    }
+    case 's': {
+      socketPath = new string(optarg);
+      break;
+    }
+    case 'K': {
+      options.similarTopK = strtol(optarg, NULL, 10);
+      break;
+    }
+    case 'S': {
+      options.similarMinScore = strtod(optarg, NULL);
+      break;
+    }
+    case 'J': {
+      options.ilpThreads = strtol(optarg, NULL, 10);
+      break;
+    }
+    case 'T': {
+      options.timeoutMs = strtol(optarg, NULL, 10);
+      break;
+    }
+    case 'c': {
+      cacheEntries = strtol(optarg, NULL, 10);
+      break;
+    }
+    case 'C': {
+      cacheDir = string(optarg);
+      break;
+    }
+    default:
+      printHelp();
+      return 1;
+      break;
+    }
+  }
+
+  if (latticeFileNames.empty()) {
+    printHelp();
+    return 1;
+  }
+
+  // Only the results go to stdout, from before loading the lattices
+  int outFd = -1;
+  if (NULL == socketPath) {
+    outFd = SearchServer::takeStdout();
+    if (outFd < 0)
+      return 1;
+  }
+
+  SearchServer server;
+  server.setOptions(options);
+  if (cacheEntries > 0)
+    server.enableCache(cacheEntries, cacheDir);
+  for (const string & latticeFileName : latticeFileNames) {
+    if (0 != server.addLattice(latticeFileName, useIndex))
+      return 1;
+  }
+  cerr << "Loaded " << latticeFileNames.size() << " lattices" << endl;
+
+  // A client closing its connection must not stop the server
+  signal(SIGPIPE, SIG_IGN);
+
+  int res;
+  if (NULL != socketPath) {
+    res = server.listen(*socketPath);
+    delete(socketPath);
+  } else {
+    res = server.serve(STDIN_FILENO, outFd);
+    close(outFd);
+  }
+
+  return res;
+}
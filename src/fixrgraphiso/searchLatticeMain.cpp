@@ -1,7 +1,16 @@
 #include "fixrgraphiso/searchLattice.h"
 #include "fixrgraphiso/serialization.h"
 #include "fixrgraphiso/serializationLattice.h"
+#include "fixrgraphiso/latticeIndex.h"
+#include "fixrgraphiso/compression.h"
+#include "fixrgraphiso/searchBatch.h"
+#include "fixrgraphiso/searchCache.h"
+#include "fixrgraphiso/latticeRouter.h"
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/wire_format_lite.h>
+#include <google/protobuf/util/delimited_message_util.h>
 
+#include <chrono>
 #include <fstream>
 #include <iostream>
 #include <string>
@@ -24,23 +33,187 @@ using fixrgraphiso::SearchLattice;
 using fixrgraphiso::SearchResult;
 using fixrgraphiso::Acdfg;
 using fixrgraphiso::Lattice;
+using fixrgraphiso::LatticeIndex;
+using fixrgraphiso::LatticeRouter;
+using fixrgraphiso::LatticeRoute;
+using fixrgraphiso::SearchCache;
 
 namespace acdfg_protobuf = edu::colorado::plv::fixr::protobuf;
 
+// Options of all the searches (-K, -S, -J, -T)
+static fixrgraphiso::SearchOptions searchOptions;
+// Directory of the cache of the results (-C), empty if not used
+static string cacheDir;
+// Results kept in memory by the cache
+static const size_t CACHE_ENTRIES = 1024;
+
 void printHelp() {
   cerr << "searchLatticeMain " <<
-    "-q <query_acdfg> -l <lattice_file> -o <result_file>" << endl <<
+    "-q <query_acdfg> -l <lattice_file> -o <result_file> [-m] [-Z] [-j <threads>] [-K <top_k>] [-S <min_score>] [-J <ilp_threads>] [-T <timeout_ms>]" << endl <<
+    "searchLatticeMain -Q <query_list> -l <lattice_file> -o <result_file> [-m] [-Z] [-j <threads>] [-K <top_k>] [-S <min_score>] [-J <ilp_threads>] [-T <timeout_ms>]" << endl <<
+    "searchLatticeMain -q <query_acdfg> -R <routing_index> -o <result_file> [-k <max_lattices>] [-M <min_methods>] [-Z] [-j <threads>] [-K <top_k>] [-S <min_score>] [-J <ilp_threads>] [-T <timeout_ms>]" << endl <<
+    "\t(with -m or -Q: [-C <cache_dir>])" << endl <<
+    "searchLatticeMain -l <lattice_file> -I" << endl <<
+    "searchLatticeMain -L <lattice_list> -R <routing_index>" << endl <<
     "\t <query_acdfg>: path to the acdfg file used as query" << endl <<
+    "\t <query_list>: file with the path of an acdfg query per line; " <<
+    "the result file contains a length-delimited SearchResults per query" << endl <<
     "\t <lattice_file>: path to the file storing the lattice" << endl <<
-    "\t <result_file>: path to the output file" << endl;
+    "\t <lattice_list>: file with a \"<id> <lattice_file>\" per line" << endl <<
+    "\t <routing_index>: index of the methods of the lattices in " <<
+    "<lattice_list>, written with -L. With -q, search only the lattices " <<
+    "relevant to the query; the result file contains a length-delimited " <<
+    "SearchResults per searched lattice" << endl <<
+    "\t <max_lattices>: maximum number of lattices searched (0 is all)" << endl <<
+    "\t <min_methods>: methods the query must share with a lattice " <<
+    "to search it (default 1)" << endl <<
+    "\t <result_file>: path to the output file" << endl <<
+    "\t -I: write the index of the lattice in <lattice_file>.idx" << endl <<
+    "\t -m: search using the index of the lattice" << endl <<
+    "\t -Z: compress the result file with gzip" << endl <<
+    "\t <threads>: threads decoding the lattice and searching the " <<
+    "queries of the list (0 is one per core)" << endl <<
+    "\t <top_k>: compare with the ILP only the <top_k> popular bins " <<
+    "most similar to the query (0 is all, the default)" << endl <<
+    "\t <min_score>: compare with the ILP only the popular bins with a " <<
+    "similarity score (from 0 to 1) of at least <min_score> (default 0)" << endl <<
+    "\t <ilp_threads>: threads solving the ILPs of a query " <<
+    "(0 is one per core, default 1)" << endl <<
+    "\t <timeout_ms>: stop the search of a query after <timeout_ms> ms, " <<
+    "returning the results found so far (default 0, no timeout)" << endl <<
+    "\t <cache_dir>: directory of the cache of the results, reused by " <<
+    "the next searches of the same queries on the same lattice" << endl;
 }
 
-int search(string& queryFile, string& latticeFileName,
-           string& outFileName)
+/**
+ * Write the results followed by the lattice.
+ *
+ * The lattice is copied as it is from the lattice file, so the ids of
+ * the bins in the results must be the ones of the lattice file.
+ */
+int writeResults(acdfg_protobuf::SearchResults* protoRes,
+                 const char* latticeData, size_t latticeSize,
+                 fstream & outfile)
+{
+  using google::protobuf::internal::WireFormatLite;
+  fixrgraphiso::ProtoOutputStream zeroCopyStream(outfile);
+  google::protobuf::io::CodedOutputStream codedStream(zeroCopyStream.get());
+
+  codedStream.WriteTag(WireFormatLite::MakeTag(
+      acdfg_protobuf::SearchResults::kLatticeFieldNumber,
+      WireFormatLite::WIRETYPE_LENGTH_DELIMITED));
+  codedStream.WriteVarint64(latticeSize);
+  for (size_t written = 0; written < latticeSize; ) {
+    int chunk = latticeSize - written < (1 << 30) ?
+      latticeSize - written : (1 << 30);
+    codedStream.WriteRaw(latticeData + written, chunk);
+    written += chunk;
+  }
+
+  // the lattice is already written, it is not set in protoRes
+  if (! protoRes->SerializeToCodedStream(&codedStream))
+    return 1;
+  codedStream.Trim();
+  if (codedStream.HadError() || ! zeroCopyStream.close())
+    return 1;
+  return 0;
+}
+
+/**
+ * Open the cache of the results (-C) of the lattice with the given
+ * hash, return NULL if the cache cannot be used
+ */
+SearchCache* openCache(const string& latticeFileName, const string& latticeHash)
+{
+  SearchCache* cache = new SearchCache(latticeHash, CACHE_ENTRIES);
+  if (0 != cache->setLatticeSpillDirectory(cacheDir, latticeFileName)) {
+    cerr << "Searching without the cache" << endl;
+    delete cache;
+    return NULL;
+  }
+  return cache;
+}
+
+int searchIndex(string& queryFile, string& latticeFileName,
+                string& outFileName)
 {
-  Lattice *lattice;
+  LatticeIndex index;
+  if (0 != index.open(latticeFileName,
+                      LatticeIndex::getIndexFileName(latticeFileName))) {
+    cerr << "Cannot open the index of " << latticeFileName << endl;
+    return 1;
+  }
+
+  Acdfg* query = fixrgraphiso::readAcdfg(queryFile);
+  if (NULL == query) {
+    cerr << "Cannot read acdfg " << queryFile << endl;
+    return 1;
+  }
+
+  SearchCache* cache = NULL;
+  if (! cacheDir.empty())
+    cache = openCache(latticeFileName,
+                      SearchCache::hashLattice(index.getLatticeHash(),
+                                               index.getLatticeSize()));
+
+  vector<SearchResult*> results;
+#ifdef USE_GUROBI_SOLVER
+  SearchLattice searchLattice(query, index.getLattice(), false, 30);
+#else
+  SearchLattice searchLattice(query, index.getLattice(), false);
+#endif
+  searchLattice.setOptions(searchOptions);
+
+  acdfg_protobuf::SearchResults* protoRes =
+    fixrgraphiso::searchWithCache(searchLattice, index.getAcdfgBin2id(),
+                                  cache, results);
+
+  if (protoRes->cached()) {
+    cout << "Found " << protoRes->results_size() <<
+      " results in the cache" << endl;
+  } else {
+    searchLattice.printResult(results, cout);
+    cout << "Skipped " << searchLattice.getSkippedIlps() << " ILPs" << endl;
+    cout << "Saved " << searchLattice.getSavedChecks() <<
+      " subsumption checks" << endl;
+    if (searchLattice.isPartial())
+      cout << "Timeout reached, the results are partial" << endl;
+  }
+
+  int res;
+  {
+    fstream outfile(outFileName.c_str(), ios::out | ios::binary | ios::trunc);
+    res = writeResults(protoRes, index.getLatticeData(),
+                       index.getLatticeSize(), outfile);
+  }
+  if (0 != res)
+    cerr << "Cannot write the results in " << outFileName << endl;
+  delete(protoRes);
+  for (SearchResult* result : results)
+    delete(result);
+  delete(query);
+  if (NULL != cache)
+    delete(cache);
 
-  lattice = fixrgraphiso::readLattice(latticeFileName);
+  return res;
+}
+
+Lattice* loadLattice(string& latticeFileName,
+                     std::map<fixrgraphiso::AcdfgBin*, int> & acdfgBin2id,
+                     int numThreads)
+{
+  if (1 == numThreads)
+    return fixrgraphiso::readLattice(latticeFileName, acdfgBin2id);
+  else
+    return fixrgraphiso::readLatticeParallel(latticeFileName, acdfgBin2id,
+                                             numThreads);
+}
+
+int search(string& queryFile, string& latticeFileName,
+           string& outFileName, int numThreads)
+{
+  std::map<fixrgraphiso::AcdfgBin*, int> acdfgBin2id;
+  Lattice *lattice = loadLattice(latticeFileName, acdfgBin2id, numThreads);
   if (NULL == lattice) {
     cerr << "Cannot read the lattice in " << latticeFileName << endl;
     return 1;
@@ -57,6 +230,7 @@ int search(string& queryFile, string& latticeFileName,
 #else
       SearchLattice searchLattice(query, lattice, false);
 #endif
+      searchLattice.setOptions(searchOptions);
       // searchLattice.search(results);
       searchLattice.newSearch(results);
 
@@ -64,9 +238,14 @@ int search(string& queryFile, string& latticeFileName,
         searchLattice.toProto(results);
 
       searchLattice.printResult(results, cout);
+      cout << "Skipped " << searchLattice.getSkippedIlps() << " ILPs" << endl;
+      cout << "Saved " << searchLattice.getSavedChecks() <<
+        " subsumption checks" << endl;
+      if (searchLattice.isPartial())
+        cout << "Timeout reached, the results are partial" << endl;
 
       fstream outfile(outFileName.c_str(), ios::out | ios::binary | ios::trunc);
-      protoRes->SerializeToOstream(&outfile);
+      fixrgraphiso::serializeToStream(*protoRes, outfile);
       outfile.close();
       delete(protoRes);
 
@@ -78,21 +257,191 @@ int search(string& queryFile, string& latticeFileName,
   return 0;
 }
 
+/**
+ * Search all the queries listed in queryListFile, loading the lattice
+ * (or its index) only once
+ */
+int searchList(string& queryListFile, string& latticeFileName,
+               string& outFileName, int numThreads, bool useIndex)
+{
+  vector<string> queryFiles;
+  {
+    ifstream listStream(queryListFile.c_str());
+    if (! listStream.is_open()) {
+      cerr << "Cannot read the query list " << queryListFile << endl;
+      return 1;
+    }
+    string line;
+    while (std::getline(listStream, line)) {
+      if (! line.empty())
+        queryFiles.push_back(line);
+    }
+  }
+
+  LatticeIndex index;
+  std::map<fixrgraphiso::AcdfgBin*, int> acdfgBin2id;
+  Lattice* lattice;
+  if (useIndex) {
+    if (0 != index.open(latticeFileName,
+                        LatticeIndex::getIndexFileName(latticeFileName))) {
+      cerr << "Cannot open the index of " << latticeFileName << endl;
+      return 1;
+    }
+    lattice = index.getLattice();
+    acdfgBin2id = index.getAcdfgBin2id();
+  } else {
+    lattice = loadLattice(latticeFileName, acdfgBin2id, numThreads);
+    if (NULL == lattice) {
+      cerr << "Cannot read the lattice in " << latticeFileName << endl;
+      return 1;
+    }
+  }
+
+  SearchCache* cache = NULL;
+  if (! cacheDir.empty()) {
+    string latticeHash;
+    if (useIndex) {
+      latticeHash = SearchCache::hashLattice(index.getLatticeHash(),
+                                             index.getLatticeSize());
+    } else if (0 != SearchCache::hashLatticeFile(latticeFileName, latticeHash)) {
+      delete(lattice);
+      return 1;
+    }
+    cache = openCache(latticeFileName, latticeHash);
+  }
+
+  int errors;
+  bool written;
+  auto start = std::chrono::steady_clock::now();
+  {
+    fstream outfile(outFileName.c_str(), ios::out | ios::binary | ios::trunc);
+    fixrgraphiso::ProtoOutputStream output(outfile);
+    errors = fixrgraphiso::searchBatch(lattice, acdfgBin2id, queryFiles,
+                                       numThreads, searchOptions, cache,
+                                       output.get());
+    written = output.close();
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  cout << "Searched " << queryFiles.size() << " queries (" <<
+    errors << " errors) in " <<
+    std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() <<
+    " ms" << endl;
+
+  if (NULL != cache) {
+    cout << "Found " << cache->getHits() << " queries in the cache" << endl;
+    delete(cache);
+  }
+  if (! useIndex)
+    delete(lattice);
+
+  if (! written) {
+    cerr << "Cannot write the results in " << outFileName << endl;
+    return 1;
+  }
+  return 0 == errors ? 0 : 1;
+}
+
+/**
+ * Search the query in the lattices selected by the routing index, from
+ * the most relevant one
+ */
+int searchRouted(string& queryFile, string& routingIndexFile,
+                 string& outFileName, int maxRoutes, int minOverlap,
+                 int numThreads)
+{
+  LatticeRouter router;
+  if (0 != router.read(routingIndexFile))
+    return 1;
+
+  Acdfg* query = fixrgraphiso::readAcdfg(queryFile);
+  if (NULL == query) {
+    cerr << "Cannot read acdfg " << queryFile << endl;
+    return 1;
+  }
+
+  vector<LatticeRoute> routes;
+  router.route(*query, minOverlap, maxRoutes, routes);
+  cout << "Searching " << routes.size() << " of " << router.size() <<
+    " lattices" << endl;
+
+  int res = 0;
+  {
+    fstream outfile(outFileName.c_str(), ios::out | ios::binary | ios::trunc);
+    fixrgraphiso::ProtoOutputStream output(outfile);
+
+    for (const LatticeRoute & route : routes) {
+      string latticeFileName = route.latticeFile;
+      std::map<fixrgraphiso::AcdfgBin*, int> acdfgBin2id;
+      Lattice* lattice = loadLattice(latticeFileName, acdfgBin2id, numThreads);
+      if (NULL == lattice) {
+        cerr << "Cannot read the lattice in " << latticeFileName << endl;
+        res = 1;
+        continue;
+      }
+
+      vector<SearchResult*> results;
+      acdfg_protobuf::SearchResults* protoRes;
+      {
+#ifdef USE_GUROBI_SOLVER
+        SearchLattice searchLattice(query, lattice, false, 30);
+#else
+        SearchLattice searchLattice(query, lattice, false);
+#endif
+        searchLattice.setOptions(searchOptions);
+        searchLattice.newSearch(results);
+        protoRes = searchLattice.toProto(results, acdfgBin2id);
+      }
+      protoRes->set_lattice_file(latticeFileName);
+      cout << latticeFileName << ": " << results.size() << " results" << endl;
+
+      if (! google::protobuf::util::SerializeDelimitedToZeroCopyStream(*protoRes,
+                                                                       output.get()))
+        res = 1;
+
+      delete(protoRes);
+      for (SearchResult* result : results)
+        delete(result);
+      delete(lattice);
+    }
+
+    if (! output.close())
+      res = 1;
+  }
+  delete(query);
+
+  if (0 != res)
+    cerr << "Cannot write the results in " << outFileName << endl;
+  return res;
+}
+
 int main(int argc, char * argv[]){
   extern char *optarg;
   extern int optind;
 
   string* acdfgFileName = NULL;
+  string* queryListFileName = NULL;
   string* latticeFileName = NULL;
   string* outFileName = NULL;
+  string* latticeListFileName = NULL;
+  string* routingIndexFileName = NULL;
+  int maxRoutes = 0;
+  int minOverlap = 1;
+  bool writeIndex = false;
+  bool useIndex = false;
+  int numThreads = 1;
 
   char c;
-  while ((c = getopt(argc, argv, "q:l:o:")) != -1) {
+  while ((c = getopt(argc, argv, "q:Q:l:o:ImZj:L:R:k:M:K:S:J:C:T:")) != -1) {
     switch (c){
     case 'q': {
       acdfgFileName = new string(optarg);
       break;
     }
+    case 'Q': {
+      queryListFileName = new string(optarg);
+      break;
+    }
     case 'l': {
       latticeFileName = new string(optarg);
       break;
@@ -101,6 +450,58 @@ int main(int argc, char * argv[]){
       outFileName = new string(optarg);
       break;
     }
+    case 'I': {
+      writeIndex = true;
+      break;
+    }
+    case 'm': {
+      useIndex = true;
+      break;
+    }
+    case 'j': {
+      numThreads = strtol(optarg, NULL, 10);
+      break;
+    }
+    case 'L': {
+      latticeListFileName = new string(optarg);
+      break;
+    }
+    case 'R': {
+      routingIndexFileName = new string(optarg);
+      break;
+    }
+    case 'k': {
+      maxRoutes = strtol(optarg, NULL, 10);
+      break;
+    }
+    case 'M': {
+      minOverlap = strtol(optarg, NULL, 10);
+      break;
+    }
+    case 'K': {
+      searchOptions.similarTopK = strtol(optarg, NULL, 10);
+      break;
+    }
+    case 'S': {
+      searchOptions.similarMinScore = strtod(optarg, NULL);
+      break;
+    }
+    case 'J': {
+      searchOptions.ilpThreads = strtol(optarg, NULL, 10);
+      break;
+    }
+    case 'T': {
+      searchOptions.timeoutMs = strtol(optarg, NULL, 10);
+      break;
+    }
+    case 'C': {
+      cacheDir = string(optarg);
+      break;
+    }
+    case 'Z': {
+      fixrgraphiso::setOutputCompression(fixrgraphiso::COMPRESSION_GZIP);
+      break;
+    }
     default:
       printHelp();
       return 1;
@@ -108,11 +509,38 @@ int main(int argc, char * argv[]){
     }
   }
 
-  if (NULL == acdfgFileName) {
+  if (NULL != routingIndexFileName) {
+    int res;
+    if (NULL != latticeListFileName) {
+      LatticeRouter router;
+      res = router.addLatticeList(*latticeListFileName);
+      if (0 == res)
+        res = router.write(*routingIndexFileName);
+    } else if (NULL != acdfgFileName && NULL != outFileName) {
+      res = searchRouted(*acdfgFileName, *routingIndexFileName, *outFileName,
+                         maxRoutes, minOverlap, numThreads);
+    } else {
+      printHelp();
+      res = 1;
+    }
+    delete(latticeListFileName);
+    delete(routingIndexFileName);
+    delete(acdfgFileName);
+    delete(outFileName);
+    return res;
+  }
+
+  if (NULL == latticeFileName) {
     printHelp();
     return 1;
   }
-  if (NULL == latticeFileName) {
+  if (writeIndex) {
+    int res = LatticeIndex::write(*latticeFileName,
+                                  LatticeIndex::getIndexFileName(*latticeFileName));
+    delete(latticeFileName);
+    return res;
+  }
+  if (NULL == acdfgFileName && NULL == queryListFileName) {
     printHelp();
     return 1;
   }
@@ -120,12 +548,24 @@ int main(int argc, char * argv[]){
     printHelp();
     return 1;
   }
+  if (NULL != queryListFileName) {
+    int res = searchList(*queryListFileName, *latticeFileName, *outFileName,
+                         numThreads, useIndex);
+    delete(queryListFileName);
+    delete(latticeFileName);
+    delete(outFileName);
+    return res;
+  }
 
-  search(*acdfgFileName, *latticeFileName, *outFileName);
+  int res;
+  if (useIndex)
+    res = searchIndex(*acdfgFileName, *latticeFileName, *outFileName);
+  else
+    res = search(*acdfgFileName, *latticeFileName, *outFileName, numThreads);
 
   delete(acdfgFileName);
   delete(latticeFileName);
   delete(outFileName);
 
-  return 0;
+  return res;
 }
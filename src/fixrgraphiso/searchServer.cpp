@@ -0,0 +1,239 @@
+// -*- C++ -*-
+//
+// Server answering the search queries on lattices kept in memory
+//
+
+#include <cstdio>
+#include <iostream>
+#include <thread>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <google/protobuf/io/zero_copy_stream_impl.h>
+#include <google/protobuf/util/delimited_message_util.h>
+#include "fixrgraphiso/searchServer.h"
+#include "fixrgraphiso/searchLattice.h"
+#include "fixrgraphiso/serialization.h"
+#include "fixrgraphiso/serializationLattice.h"
+
+namespace fixrgraphiso {
+  using std::endl;
+  using std::cerr;
+  using google::protobuf::io::FileInputStream;
+  using google::protobuf::io::FileOutputStream;
+  using google::protobuf::util::ParseDelimitedFromZeroCopyStream;
+  using google::protobuf::util::SerializeDelimitedToZeroCopyStream;
+
+  SearchServer::SearchServer() : cacheEntries(0) {
+  }
+
+  SearchServer::~SearchServer() {
+    for (ResidentLattice* resident : lattices) {
+      delete resident->view;
+      if (NULL != resident->cache)
+        delete resident->cache;
+      if (NULL != resident->index)
+        delete resident->index;
+      else
+        delete resident->lattice;
+      delete resident;
+    }
+  }
+
+  /**
+   * Load the lattice in latticeFile, or its index if useIndex is true
+   */
+  int SearchServer::addLattice(const string & latticeFile, bool useIndex) {
+    ResidentLattice* resident = new ResidentLattice();
+    resident->fileName = latticeFile;
+
+    if (useIndex) {
+      resident->index = new LatticeIndex();
+      if (0 != resident->index->open(latticeFile,
+                                     LatticeIndex::getIndexFileName(latticeFile))) {
+        cerr << "Cannot open the index of " << latticeFile << endl;
+        delete resident->index;
+        delete resident;
+        return 1;
+      }
+      resident->lattice = resident->index->getLattice();
+      resident->acdfgBin2id = resident->index->getAcdfgBin2id();
+    } else {
+      resident->lattice = readLattice(latticeFile, resident->acdfgBin2id);
+      if (NULL == resident->lattice) {
+        cerr << "Cannot read the lattice in " << latticeFile << endl;
+        delete resident;
+        return 1;
+      }
+    }
+
+    resident->view = new FrozenLattice(resident->lattice);
+    lattices.push_back(resident);
+
+    if (cacheEntries > 0) {
+      string latticeHash;
+      if (useIndex)
+        latticeHash = SearchCache::hashLattice(resident->index->getLatticeHash(),
+                                               resident->index->getLatticeSize());
+      else if (0 != SearchCache::hashLatticeFile(latticeFile, latticeHash))
+        return 1;
+
+      resident->cache = new SearchCache(latticeHash, cacheEntries);
+      if (! cacheSpillDir.empty() &&
+          0 != resident->cache->setLatticeSpillDirectory(cacheSpillDir,
+                                                         latticeFile))
+        return 1;
+    }
+    return 0;
+  }
+
+  void SearchServer::enableCache(size_t maxEntries, const string & spillDir) {
+    cacheEntries = maxEntries;
+    cacheSpillDir = spillDir;
+  }
+
+  ResidentLattice* SearchServer::findLattice(const string & latticeFile) {
+    if (latticeFile.empty())
+      return lattices.empty() ? NULL : lattices.front();
+
+    for (ResidentLattice* resident : lattices) {
+      if (resident->fileName == latticeFile)
+        return resident;
+    }
+    return NULL;
+  }
+
+  /**
+   * Search the query of the request, setting the error in protoResults
+   * if the request cannot be answered.
+   */
+  void SearchServer::search(const fixr_protobuf::SearchRequest & request,
+                            fixr_protobuf::SearchResults & protoResults) {
+    ResidentLattice* resident = findLattice(request.lattice());
+    if (NULL == resident) {
+      protoResults.set_error("Unknown lattice " + request.lattice());
+      return;
+    }
+
+    Acdfg* query = NULL;
+    if (request.has_query()) {
+      AcdfgSerializer s;
+      query = s.create_acdfg(request.query());
+    } else if (request.has_query_file()) {
+      query = readAcdfg(request.query_file());
+    }
+    if (NULL == query) {
+      protoResults.set_error("Cannot read the query acdfg");
+      return;
+    }
+
+    {
+      vector<SearchResult*> results;
+#ifdef USE_GUROBI_SOLVER
+      SearchLattice searchLattice(query, resident->view, false, 30);
+#else
+      SearchLattice searchLattice(query, resident->view, false);
+#endif
+      SearchOptions requestOptions(options);
+      if (request.has_timeout_ms())
+        requestOptions.timeoutMs = request.timeout_ms();
+      searchLattice.setOptions(requestOptions);
+
+      fixr_protobuf::SearchResults* res =
+        searchWithCache(searchLattice, resident->acdfgBin2id,
+                        resident->cache, results);
+      protoResults.Swap(res);
+      delete res;
+
+      for (SearchResult* result : results)
+        delete result;
+    }
+
+    delete query;
+  }
+
+  int SearchServer::serve(int inFd, int outFd) {
+    FileInputStream input(inFd);
+    FileOutputStream output(outFd);
+
+    while (true) {
+      fixr_protobuf::SearchRequest request;
+      bool cleanEof = false;
+      if (! ParseDelimitedFromZeroCopyStream(&request, &input, &cleanEof)) {
+        if (cleanEof)
+          return 0;
+        cerr << "Cannot read the search request" << endl;
+        return 1;
+      }
+
+      fixr_protobuf::SearchResults protoResults;
+      search(request, protoResults);
+
+      if (! SerializeDelimitedToZeroCopyStream(protoResults, &output) ||
+          ! output.Flush()) {
+        cerr << "Cannot write the search results" << endl;
+        return 1;
+      }
+    }
+  }
+
+  int SearchServer::takeStdout() {
+    std::cout.flush();
+    fflush(stdout);
+
+    int outFd = dup(STDOUT_FILENO);
+    if (outFd < 0 || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+      cerr << "Cannot redirect stdout: " << strerror(errno) << endl;
+      if (outFd >= 0)
+        ::close(outFd);
+      return -1;
+    }
+    return outFd;
+  }
+
+  int SearchServer::listen(const string & socketPath) {
+    struct sockaddr_un addr;
+    if (socketPath.size() >= sizeof(addr.sun_path)) {
+      cerr << "Socket path too long: " << socketPath << endl;
+      return 1;
+    }
+
+    int serverFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (serverFd < 0) {
+      cerr << "Cannot create the socket: " << strerror(errno) << endl;
+      return 1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socketPath.c_str(), sizeof(addr.sun_path) - 1);
+    unlink(socketPath.c_str());
+
+    if (0 != bind(serverFd, (struct sockaddr*) &addr, sizeof(addr)) ||
+        0 != ::listen(serverFd, SOMAXCONN)) {
+      cerr << "Cannot listen on " << socketPath << ": " <<
+        strerror(errno) << endl;
+      ::close(serverFd);
+      return 1;
+    }
+
+    while (true) {
+      int clientFd = accept(serverFd, NULL, NULL);
+      if (clientFd < 0) {
+        if (EINTR == errno)
+          continue;
+        cerr << "Cannot accept a client: " << strerror(errno) << endl;
+        ::close(serverFd);
+        return 1;
+      }
+
+      std::thread([this, clientFd]() {
+          serve(clientFd, clientFd);
+          ::close(clientFd);
+        }).detach();
+    }
+  }
+
+} // end fixrgraphiso namespace
@@ -0,0 +1,94 @@
+// -*- C++ -*-
+//
+// Server answering the search queries on lattices kept in memory
+//
+
+#ifndef SEARCH_SERVER_H_INCLUDED
+#define SEARCH_SERVER_H_INCLUDED
+
+#include <map>
+#include <string>
+#include <vector>
+#include "fixrgraphiso/acdfgBin.h"
+#include "fixrgraphiso/latticeIndex.h"
+#include "fixrgraphiso/frozenLattice.h"
+#include "fixrgraphiso/searchLattice.h"
+#include "fixrgraphiso/searchCache.h"
+#include "fixrgraphiso/proto_search.pb.h"
+
+namespace fixrgraphiso {
+  using std::string;
+  using std::vector;
+  using std::map;
+  namespace fixr_protobuf = edu::colorado::plv::fixr::protobuf;
+
+  /* A lattice loaded by the server */
+  struct ResidentLattice {
+    ResidentLattice() : lattice(NULL), index(NULL), view(NULL), cache(NULL) {}
+
+    string fileName;
+    Lattice* lattice;
+    // Set if the lattice is loaded from its index
+    LatticeIndex* index;
+    // Ids of the bins in the lattice file, used in the results
+    map<AcdfgBin*, int> acdfgBin2id;
+    // Shared by all the searches on the lattice
+    FrozenLattice* view;
+    // Results of the previous searches, if the cache is enabled
+    SearchCache* cache;
+  };
+
+  /**
+   * Loads the lattices once and answers the search requests.
+   *
+   * The requests and the results are length-delimited SearchRequest and
+   * SearchResults messages. Each client (a connection on the socket, or
+   * stdin/stdout) is served by its own thread, and the searches of
+   * different clients run concurrently (also on the same lattice).
+   */
+  class SearchServer {
+  public:
+    SearchServer();
+    ~SearchServer();
+
+    int addLattice(const string & latticeFile, bool useIndex);
+
+    /* Options of all the searches, set before serving the clients */
+    void setOptions(const SearchOptions & options) { this->options = options; }
+
+    /**
+     * Cache the results of the last maxEntries queries of each lattice
+     * added after the call. With a spillDir, the results are also stored
+     * in a subdirectory of spillDir for each lattice file.
+     */
+    void enableCache(size_t maxEntries, const string & spillDir);
+
+    void search(const fixr_protobuf::SearchRequest & request,
+                fixr_protobuf::SearchResults & protoResults);
+
+    /* Answer the requests read from inFd until the end of the input */
+    int serve(int inFd, int outFd);
+
+    /**
+     * Move stdout to stderr, returning a new descriptor of the original
+     * stdout (-1 on errors). Serving on the returned descriptor, the
+     * messages printed by the search (e.g., by the ILP solver) do not
+     * mix with the results.
+     */
+    static int takeStdout();
+
+    /* Accept the clients on the unix socket socketPath */
+    int listen(const string & socketPath);
+
+  private:
+    ResidentLattice* findLattice(const string & latticeFile);
+
+    vector<ResidentLattice*> lattices;
+    SearchOptions options;
+    size_t cacheEntries;
+    string cacheSpillDir;
+  };
+
+} // end fixrgraphiso namespace
+
+#endif // SEARCH_SERVER_H_INCLUDED
@@ -11,6 +11,7 @@
 #include <map>
 #include <typeinfo>
 #include "fixrgraphiso/serialization.h"
+#include "fixrgraphiso/compression.h"
 
 namespace fixrgraphiso {
 
@@ -310,7 +311,7 @@ namespace fixrgraphiso {
     /* data nodes */
     std::fstream input_stream (file_name, std::ios::in | std::ios::binary);
     if (input_stream.is_open()) {
-      if (acdfg->ParseFromIstream(&input_stream)) {
+      if (parseFromStream(input_stream, acdfg)) {
         return acdfg;
       } else {
         return NULL;
@@ -10,10 +10,19 @@
 #include <fstream>
 
 #include <map>
+#include <tuple>
+#include <algorithm>
+#include <google/protobuf/arena.h>
 #include <typeinfo>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#include <google/protobuf/wire_format_lite.h>
 #include "fixrgraphiso/serialization.h"
 #include "fixrgraphiso/serializationLattice.h"
 #include "fixrgraphiso/collectStats.h"
+#include "fixrgraphiso/compression.h"
+#include "fixrgraphiso/parallel.h"
+#include "fixrgraphiso/fingerprint.h"
 
 namespace fixrgraphiso {
   using namespace std;
@@ -21,173 +30,563 @@ namespace fixrgraphiso {
   using std::ifstream;
   using std::ofstream;
   using std::fstream;
+  using google::protobuf::io::CodedInputStream;
+  using google::protobuf::io::CodedOutputStream;
+  using google::protobuf::io::StringOutputStream;
+  using google::protobuf::internal::WireFormatLite;
+
+  typedef google::protobuf::RepeatedPtrField<acdfg_protobuf::UnweightedIso::RelPair> proto_rel_t;
+  typedef google::protobuf::RepeatedPtrField<acdfg_protobuf::Acdfg> proto_acdfgs_t;
+  typedef google::protobuf::RepeatedPtrField<acdfg_protobuf::Lattice::AcdfgBin> proto_bins_t;
+
+  static void fill_rel_from_proto(const proto_rel_t & protoNodes,
+                                  const proto_rel_t & protoEdges,
+                                  IsoRepr* iso) {
+    for (int i = 0; i < protoNodes.size(); i++)
+      iso->addNodeRel(protoNodes.Get(i).id_1(), protoNodes.Get(i).id_2());
+    for (int i = 0; i < protoEdges.size(); i++)
+      iso->addEdgeRel(protoEdges.Get(i).id_1(), protoEdges.Get(i).id_2());
+  }
+
+  static void fill_proto_from_rel(const set<id_pair_t> & rel,
+                                  proto_rel_t* protoRel) {
+    for (const id_pair_t & pair : rel) {
+      acdfg_protobuf::UnweightedIso::RelPair* protoPair = protoRel->Add();
+      protoPair->set_id_1(pair.first);
+      protoPair->set_id_2(pair.second);
+    }
+  }
 
+  static void write_field(int field,
+                          const google::protobuf::MessageLite & message,
+                          CodedOutputStream* output) {
+    output->WriteTag(WireFormatLite::MakeTag(field,
+        WireFormatLite::WIRETYPE_LENGTH_DELIMITED));
+    output->WriteVarint32(message.ByteSizeLong());
+    message.SerializeWithCachedSizes(output);
+  }
+
+  static bool read_message(CodedInputStream* input,
+                           google::protobuf::MessageLite* message) {
+    uint32_t size;
+    if (! input->ReadVarint32(&size))
+      return false;
+    CodedInputStream::Limit limit = input->PushLimit(size);
+    bool res = message->ParseFromCodedStream(input) &&
+      input->ConsumedEntireMessage();
+    input->PopLimit(limit);
+    return res;
+  }
 
   /**
-   * Read a lattice from the protobuffer and create a lattice data structure
+   * Destination of the acdfgs and of the bins of a serialized lattice
    */
-  Lattice* LatticeSerializer::lattice_from_proto(acdfg_protobuf::Lattice* protoLattice,
-                                                 std::map<AcdfgBin*, int> &acdfgBin2id) {
-    Stats stats;
-    Lattice* lattice = NULL;
-    AcdfgSerializer serializer;
+  class LatticeProtoSink {
+  public:
+    virtual ~LatticeProtoSink() {}
+    virtual void addAcdfg(acdfg_protobuf::Acdfg & protoAcdfg) = 0;
+    virtual void addBin(acdfg_protobuf::Lattice::AcdfgBin & protoBin) = 0;
+  };
+
+  /* Adds the acdfgs and the bins to a Lattice message */
+  class MessageSink : public LatticeProtoSink {
+  public:
+    MessageSink(acdfg_protobuf::Lattice* protoLattice) :
+      protoLattice(protoLattice) {}
+
+    void addAcdfg(acdfg_protobuf::Acdfg & protoAcdfg) {
+      protoLattice->add_acdfgs()->Swap(&protoAcdfg);
+    }
+    void addBin(acdfg_protobuf::Lattice::AcdfgBin & protoBin) {
+      protoLattice->add_bins()->Swap(&protoBin);
+    }
 
-    // 4. Get the statstics
-    if (protoLattice->has_stats()) {
-      stats = Stats(protoLattice->stats().numsatcalls(),
-                    protoLattice->stats().numsubsumptionchecks(),
-                    protoLattice->stats().totalgraphs(),
-                    protoLattice->stats().totalnodes(),
-                    protoLattice->stats().totaledges(),
-                    protoLattice->stats().maxnodes(),
-                    protoLattice->stats().maxedges(),
-                    protoLattice->stats().minnodes(),
-                    protoLattice->stats().minedges(),
-                    std::chrono::milliseconds(protoLattice->stats().satsolvertime()));
-    } else {
-      stats = Stats();
+  private:
+    acdfg_protobuf::Lattice* protoLattice;
+  };
+
+  /**
+   * Writes the acdfgs and the bins as fields of a Lattice message as
+   * soon as they are serialized
+   */
+  class StreamSink : public LatticeProtoSink {
+  public:
+    StreamSink(CodedOutputStream* output) : output(output) {}
+
+    void addAcdfg(acdfg_protobuf::Acdfg & protoAcdfg) {
+      write_field(acdfg_protobuf::Lattice::kAcdfgsFieldNumber, protoAcdfg,
+                  output);
+    }
+    void addBin(acdfg_protobuf::Lattice::AcdfgBin & protoBin) {
+      write_field(acdfg_protobuf::Lattice::kBinsFieldNumber, protoBin,
+                  output);
     }
 
-    lattice = new Lattice(stats);
+  private:
+    CodedOutputStream* output;
+  };
 
-    /* 0. set the method names */
-    for (int i = 0; i < protoLattice->method_names_size(); i++) {
-      string methodName = protoLattice->method_names(i);
-      lattice->addMethodName(methodName);
+  /**
+   * Table of the acdfgs of a lattice in the format v2.
+   *
+   * An acdfg shared by several bins and isomorphisms (or copies of the
+   * same acdfg) is stored only once. The acdfgs are passed to the sink
+   * when first seen, and the table only keeps their size and two
+   * independent hashes to find the copies.
+   */
+  class AcdfgTable {
+  public:
+    AcdfgTable(LatticeProtoSink & sink) : sink(sink), size(0) {}
+
+    int getRef(const Acdfg* acdfg) {
+      auto refIt = acdfgToRef.find(acdfg);
+      if (refIt != acdfgToRef.end())
+        return refIt->second;
+
+      acdfg_protobuf::Acdfg protoAcdfg;
+      serializer.fill_proto_from_acdfg(*acdfg, &protoAcdfg);
+      string bytes = protoAcdfg.SerializeAsString();
+
+      // Look for a copy of the acdfg already in the table
+      acdfg_key_t key(bytes.size(), std::hash<string>()(bytes),
+                      fnvHash(bytes.data(), bytes.size()));
+      int ref;
+      auto copyIt = keyToRef.find(key);
+      if (copyIt != keyToRef.end()) {
+        ref = copyIt->second;
+      } else {
+        ref = size++;
+        keyToRef[key] = ref;
+        sink.addAcdfg(protoAcdfg);
+      }
+
+      acdfgToRef[acdfg] = ref;
+      return ref;
     }
 
-    // 1. Create the all the AcdfgBins
-    // It just creates the bins, ignoring their relations
-    map<int, AcdfgBin*> id2AcdfgBinMap;
-    for (int i = 0; i < protoLattice->bins_size(); i++) {
-      const acdfg_protobuf::Lattice::AcdfgBin & protoAcdfgBin =
-        protoLattice->bins(i);
+  private:
+    typedef std::tuple<size_t, size_t, uint64_t> acdfg_key_t;
+
+    LatticeProtoSink & sink;
+    int size;
+    AcdfgSerializer serializer;
+    map<const Acdfg*, int> acdfgToRef;
+    map<acdfg_key_t, int> keyToRef;
+  };
 
-      const acdfg_protobuf::Acdfg & protoRepr = protoAcdfgBin.acdfg_repr();
-      Acdfg* repr = serializer.create_acdfg(protoRepr);
+  /**
+   * Builds a lattice from its acdfgs and bins, added in the order they
+   * appear in the Lattice message.
+   *
+   * The relations between the bins are stored as ids and created only
+   * at the end, when all the bins are known.
+   */
+  class LatticeBuilder {
+  public:
+    LatticeBuilder() : lattice(new Lattice()) {}
+    ~LatticeBuilder() {
+      if (NULL != lattice)
+        delete lattice;
+    }
 
-      AcdfgBin* acdfgBin = new AcdfgBin(repr, lattice->getStats());
-      for (int j = 0; j < protoAcdfgBin.names_to_iso_size(); j++) {
-        const acdfg_protobuf::Lattice::IsoPair & protoIso =
-          protoAcdfgBin.names_to_iso(j);
+    void addAcdfg(const acdfg_protobuf::Acdfg & protoAcdfg) {
+      acdfgTable.push_back(serializer.create_acdfg(protoAcdfg));
+    }
+    void addAcdfgs(const proto_acdfgs_t & protoAcdfgs, int numThreads);
 
-        IsoRepr* iso = new IsoRepr(protoIso.iso());
+    /* True if the acdfgs referred by the bin were already added */
+    bool hasAcdfgs(const acdfg_protobuf::Lattice::AcdfgBin & protoAcdfgBin) const;
 
-        acdfgBin->insertEquivalentACDFG(protoIso.method_name(), iso);
+    bool addBin(const acdfg_protobuf::Lattice::AcdfgBin & protoAcdfgBin);
+    bool addBins(const proto_bins_t & protoBins, int numThreads);
+
+    /* protoHeader contains all the fields except the bins and the acdfgs */
+    Lattice* build(const acdfg_protobuf::Lattice & protoHeader,
+                   std::map<AcdfgBin*, int> &acdfgBin2id);
+
+  private:
+    AcdfgBin* createBin(const acdfg_protobuf::Lattice::AcdfgBin & protoAcdfgBin) const;
+    void insertBin(AcdfgBin* acdfgBin,
+                   const acdfg_protobuf::Lattice::AcdfgBin & protoAcdfgBin);
+
+    Lattice* lattice;
+    AcdfgSerializer serializer;
+    // The acdfgs shared by the bins (format v2)
+    vector<Acdfg*> acdfgTable;
+    map<int, AcdfgBin*> id2AcdfgBinMap;
+    // ids of the related bins, by bin
+    vector<vector<int>> subsumingIds;
+    vector<vector<int>> incomingIds;
+    vector<vector<int>> subsumingAnomalousIds;
+  };
+
+  bool LatticeBuilder::hasAcdfgs(const acdfg_protobuf::Lattice::AcdfgBin & protoAcdfgBin) const {
+    if (protoAcdfgBin.has_acdfg_repr_ref() &&
+        protoAcdfgBin.acdfg_repr_ref() >= acdfgTable.size())
+      return false;
+
+    for (int j = 0; j < protoAcdfgBin.names_to_iso_size(); j++) {
+      const acdfg_protobuf::Lattice::IsoPair & protoIso =
+        protoAcdfgBin.names_to_iso(j);
+      if (protoIso.has_iso_ref() &&
+          (protoIso.iso_ref().acdfg_1() >= acdfgTable.size() ||
+           protoIso.iso_ref().acdfg_2() >= acdfgTable.size()))
+        return false;
+    }
+    return true;
+  }
+
+  /**
+   * Create the bin without adding it to the lattice.
+   *
+   * It only reads the acdfgs table, so several bins can be created
+   * concurrently.
+   */
+  AcdfgBin* LatticeBuilder::createBin(const acdfg_protobuf::Lattice::AcdfgBin & protoAcdfgBin) const {
+    AcdfgSerializer serializer;
+    Acdfg* repr = NULL;
+    if (protoAcdfgBin.has_acdfg_repr_ref()) {
+      if (protoAcdfgBin.acdfg_repr_ref() < acdfgTable.size())
+        repr = acdfgTable[protoAcdfgBin.acdfg_repr_ref()];
+    } else if (protoAcdfgBin.has_acdfg_repr()) {
+      repr = serializer.create_acdfg(protoAcdfgBin.acdfg_repr());
+    }
+    if (NULL == repr) {
+      std::cerr << "Missing representative for bin " <<
+        protoAcdfgBin.id() << endl;
+      return NULL;
+    }
+
+    // The representative is already one of the members of the bin
+    AcdfgBin* acdfgBin = new AcdfgBin(repr, lattice->getStats(),
+                                      protoAcdfgBin.names_to_iso_size() == 0);
+
+    for (int j = 0; j < protoAcdfgBin.names_to_iso_size(); j++) {
+      const acdfg_protobuf::Lattice::IsoPair & protoIso =
+        protoAcdfgBin.names_to_iso(j);
+
+      IsoRepr* iso = NULL;
+      if (protoIso.has_iso_ref()) {
+        const acdfg_protobuf::Lattice::IsoRef & isoRef = protoIso.iso_ref();
+        if (isoRef.acdfg_1() < acdfgTable.size() &&
+            isoRef.acdfg_2() < acdfgTable.size()) {
+          iso = new IsoRepr(acdfgTable[isoRef.acdfg_1()],
+                            acdfgTable[isoRef.acdfg_2()]);
+          fill_rel_from_proto(isoRef.nodesmap(), isoRef.edgesmap(), iso);
+        }
+      } else if (protoIso.has_iso()) {
+        iso = new IsoRepr(protoIso.iso());
+      }
+      if (NULL == iso) {
+        std::cerr << "Missing isomorphism for " <<
+          protoIso.method_name() << endl;
+        delete acdfgBin;
+        return NULL;
       }
 
-      if (protoAcdfgBin.anomalous()) acdfgBin->setAnomalous();
-      if (protoAcdfgBin.subsuming()) acdfgBin->setSubsuming();
-      if (protoAcdfgBin.popular()) acdfgBin->setPopular(true);
-      if (protoAcdfgBin.isolated()) acdfgBin->setIsolated();
+      acdfgBin->insertEquivalentACDFG(protoIso.method_name(), iso);
+    }
+    // Unknown in the older lattices (see AcdfgBin::removeAcdfg)
+    acdfgBin->setRepresentativeName(protoAcdfgBin.has_repr_name() ?
+                                    protoAcdfgBin.repr_name() : "");
+
+    if (protoAcdfgBin.anomalous()) acdfgBin->setAnomalous();
+    if (protoAcdfgBin.subsuming()) acdfgBin->setSubsuming();
+    if (protoAcdfgBin.popular()) acdfgBin->setPopular(true);
+    if (protoAcdfgBin.isolated()) acdfgBin->setIsolated();
+
+    if (protoAcdfgBin.has_cumulative_frequency())
+      acdfgBin->setCumulativeFrequency(protoAcdfgBin.cumulative_frequency());
+    else
+      acdfgBin->setCumulativeFrequency(0);
+
+    return acdfgBin;
+  }
+
+  void LatticeBuilder::insertBin(AcdfgBin* acdfgBin,
+                                 const acdfg_protobuf::Lattice::AcdfgBin & protoAcdfgBin) {
+    lattice->addBin(acdfgBin);
+    id2AcdfgBinMap[protoAcdfgBin.id()] = acdfgBin;
+
+    subsumingIds.push_back(vector<int>(protoAcdfgBin.subsuming_bins().begin(),
+                                       protoAcdfgBin.subsuming_bins().end()));
+    incomingIds.push_back(vector<int>(protoAcdfgBin.incoming_edges().begin(),
+                                      protoAcdfgBin.incoming_edges().end()));
+    subsumingAnomalousIds.push_back(vector<int>(protoAcdfgBin.subsuming_anomalous().begin(),
+                                                protoAcdfgBin.subsuming_anomalous().end()));
+  }
 
-      if (protoAcdfgBin.has_cumulative_frequency())
-        acdfgBin->setCumulativeFrequency(protoAcdfgBin.cumulative_frequency());
-      else
-        acdfgBin->setCumulativeFrequency(0);
+  bool LatticeBuilder::addBin(const acdfg_protobuf::Lattice::AcdfgBin & protoAcdfgBin) {
+    AcdfgBin* acdfgBin = createBin(protoAcdfgBin);
+    if (NULL == acdfgBin)
+      return false;
+    insertBin(acdfgBin, protoAcdfgBin);
+    return true;
+  }
 
-      id2AcdfgBinMap[protoAcdfgBin.id()] = acdfgBin;
-      acdfgBin2id[acdfgBin] = protoAcdfgBin.id();
+  void LatticeBuilder::addAcdfgs(const proto_acdfgs_t & protoAcdfgs,
+                                 int numThreads) {
+    size_t start = acdfgTable.size();
+    acdfgTable.resize(start + protoAcdfgs.size());
+    parallelFor(0, protoAcdfgs.size(), numThreads, [&](int i) {
+        AcdfgSerializer serializer;
+        acdfgTable[start + i] = serializer.create_acdfg(protoAcdfgs.Get(i));
+      });
+  }
 
-      lattice->addBin(acdfgBin);
+  /**
+   * Create the bins concurrently and add them to the lattice in order
+   */
+  bool LatticeBuilder::addBins(const proto_bins_t & protoBins,
+                               int numThreads) {
+    vector<AcdfgBin*> bins(protoBins.size(), NULL);
+    parallelFor(0, protoBins.size(), numThreads, [&](int i) {
+        bins[i] = createBin(protoBins.Get(i));
+      });
+
+    bool res = std::find(bins.begin(), bins.end(),
+                         (AcdfgBin*) NULL) == bins.end();
+    for (int i = 0; i < bins.size(); i++) {
+      if (res)
+        insertBin(bins[i], protoBins.Get(i));
+      else if (NULL != bins[i])
+        delete bins[i];
+    }
+    return res;
+  }
+
+  Lattice* LatticeBuilder::build(const acdfg_protobuf::Lattice & protoLattice,
+                                 std::map<AcdfgBin*, int> &acdfgBin2id) {
+    if (protoLattice.has_version() &&
+        protoLattice.version() > LATTICE_FORMAT_VERSION) {
+      std::cerr << "Unsupported lattice format version " <<
+        protoLattice.version() << endl;
+      return NULL;
+    }
+
+    // 4. Get the statstics
+    if (protoLattice.has_stats()) {
+      *lattice->getStats() =
+        Stats(protoLattice.stats().numsatcalls(),
+              protoLattice.stats().numsubsumptionchecks(),
+              protoLattice.stats().totalgraphs(),
+              protoLattice.stats().totalnodes(),
+              protoLattice.stats().totaledges(),
+              protoLattice.stats().maxnodes(),
+              protoLattice.stats().maxedges(),
+              protoLattice.stats().minnodes(),
+              protoLattice.stats().minedges(),
+              std::chrono::milliseconds(protoLattice.stats().satsolvertime()));
     }
 
+    /* 0. set the method names */
+    for (int i = 0; i < protoLattice.method_names_size(); i++) {
+      string methodName = protoLattice.method_names(i);
+      lattice->addMethodName(methodName);
+    }
+
+    const vector<AcdfgBin*> & allBins = lattice->getAllBins();
+    for (auto idAndBin : id2AcdfgBinMap)
+      acdfgBin2id[idAndBin.second] = idAndBin.first;
+
     // 2. Create links between bins
-    for (int i = 0; i < protoLattice->bins_size(); i++) {
-      const acdfg_protobuf::Lattice::AcdfgBin & protoAcdfgBin =
-        protoLattice->bins(i);
-      AcdfgBin* currentBin = id2AcdfgBinMap[protoAcdfgBin.id()];
-
-      for (int j = 0; j < protoAcdfgBin.subsuming_bins_size(); j++) {
-        int otherId = protoAcdfgBin.subsuming_bins(j);
-        AcdfgBin* other = id2AcdfgBinMap[otherId];
-        currentBin->addSubsumingBin(other);
+    if (protoLattice.reduced_relations()) {
+      // Only the immediate relation is stored
+      vector<vector<AcdfgBin*>> immediateSubsuming(allBins.size());
+      for (int i = 0; i < allBins.size(); i++) {
+        for (int otherId : subsumingIds[i])
+          immediateSubsuming[i].push_back(id2AcdfgBinMap[otherId]);
       }
+      lattice->buildFromImmediate(immediateSubsuming);
+    } else {
+      for (int i = 0; i < allBins.size(); i++) {
+        AcdfgBin* currentBin = allBins[i];
 
-      for (int j = 0; j < protoAcdfgBin.incoming_edges_size(); j++) {
-        int otherId = protoAcdfgBin.incoming_edges(j);
-        AcdfgBin* other = id2AcdfgBinMap[otherId];
-        currentBin->insertIncomingEdge(other);
-      }
-    }
+        for (int otherId : subsumingIds[i])
+          currentBin->addSubsumingBin(id2AcdfgBinMap[otherId]);
 
-    for (auto bin : lattice->getAllBins())
-      bin->computeImmediatelySubsumingBins();
+        for (int otherId : incomingIds[i])
+          currentBin->insertIncomingEdge(id2AcdfgBinMap[otherId]);
+      }
 
+      for (auto bin : allBins)
+        bin->computeImmediatelySubsumingBins();
+    }
 
     // 3. Populate popular/anomalous/isolated list
-    for (int i = 0; i < protoLattice->popular_bins_size(); i++) {
-      AcdfgBin* other = id2AcdfgBinMap[protoLattice->popular_bins(i)];
+    for (int i = 0; i < protoLattice.popular_bins_size(); i++) {
+      AcdfgBin* other = id2AcdfgBinMap[protoLattice.popular_bins(i)];
       lattice->addPopular(other);
     }
 
-    for (int i = 0; i < protoLattice->anomalous_bins_size(); i++) {
-      AcdfgBin* other = id2AcdfgBinMap[protoLattice->anomalous_bins(i)];
+    for (int i = 0; i < protoLattice.anomalous_bins_size(); i++) {
+      AcdfgBin* other = id2AcdfgBinMap[protoLattice.anomalous_bins(i)];
       lattice->addAnomalous(other);
     }
 
-    for (int i = 0; i < protoLattice->isolated_bins_size(); i++) {
-      AcdfgBin* other = id2AcdfgBinMap[protoLattice->isolated_bins(i)];
+    for (int i = 0; i < protoLattice.isolated_bins_size(); i++) {
+      AcdfgBin* other = id2AcdfgBinMap[protoLattice.isolated_bins(i)];
       lattice->addIsolated(other);
     }
 
-    return lattice;
+    // older lattices do not store the anomalous bins of the popular ones
+    if (protoLattice.has_subsuming_anomalous()) {
+      map<AcdfgBin*, vector<AcdfgBin*>> popularToAnomalous;
+      for (auto popular : lattice->getPopularBins()) {
+        vector<AcdfgBin*> & anomalous = popularToAnomalous[popular];
+        for (int otherId : subsumingAnomalousIds[popular->getId()])
+          anomalous.push_back(id2AcdfgBinMap[otherId]);
+      }
+      lattice->setSubsumingAnomalous(popularToAnomalous);
+    } else {
+      lattice->buildSubsumingAnomalous();
+    }
+
+    if (protoLattice.has_classification()) {
+      const acdfg_protobuf::Lattice::Classification & protoClassification =
+        protoLattice.classification();
+      ClassificationParams params;
+      params.relative = protoClassification.relative();
+      params.freqCutoff = protoClassification.freq_cutoff();
+      params.relativeThreshold = protoClassification.relative_threshold();
+      params.anomalyCutOff = protoClassification.anomaly_cutoff();
+      lattice->setClassification(params);
+    }
+
+    // the lattice is as it was classified
+    lattice->clearChanged();
+
+    Lattice* res = lattice;
+    lattice = NULL;
+    return res;
   }
 
+
   /**
-   * Serialize a lattice structure in a protobuffer
+   * Read a lattice from the protobuffer and create a lattice data structure
    */
-  acdfg_protobuf::Lattice* LatticeSerializer::proto_from_lattice(const Lattice & lattice) {
-    acdfg_protobuf::Lattice* protoLattice = new acdfg_protobuf::Lattice();
-
+  Lattice* LatticeSerializer::lattice_from_proto(acdfg_protobuf::Lattice* protoLattice,
+                                                 std::map<AcdfgBin*, int> &acdfgBin2id) {
+    return lattice_from_proto(protoLattice, acdfgBin2id, 1);
+  }
 
-    // 0. Assign the method names
-    for (const string & methodName : lattice.getMethodNames()) {
-      protoLattice->add_method_names(methodName);
+  /**
+   * Read a lattice from the protobuffer, decoding the acdfgs and the
+   * bins with numThreads threads (0 is one per core).
+   */
+  Lattice* LatticeSerializer::lattice_from_proto(acdfg_protobuf::Lattice* protoLattice,
+                                                 std::map<AcdfgBin*, int> &acdfgBin2id,
+                                                 int numThreads) {
+    LatticeBuilder builder;
+
+    if (protoLattice->has_version() &&
+        protoLattice->version() > LATTICE_FORMAT_VERSION) {
+      std::cerr << "Unsupported lattice format version " <<
+        protoLattice->version() << endl;
+      return NULL;
     }
 
-    // 1. Assign the IDs to the bins
-    map<AcdfgBin*, int> acdfgBin2idMap;
-    lattice.getAcdfgBin2id(acdfgBin2idMap);
+    builder.addAcdfgs(protoLattice->acdfgs(), numThreads);
 
-    // 2. Populate the bins field
-    for (auto it = lattice.beginAllBins();
-         it != lattice.endAllBins(); ++it) {
-      AcdfgBin * a = *it;
-      int id = acdfgBin2idMap[a];
+    // 1. Create the all the AcdfgBins
+    // It just creates the bins, ignoring their relations
+    if (! builder.addBins(protoLattice->bins(), numThreads))
+      return NULL;
 
-      acdfg_protobuf::Lattice::AcdfgBin* proto_a =
-        protoLattice->add_bins();
+    return builder.build(*protoLattice, acdfgBin2id);
+  }
 
-      proto_a->set_id(id);
+  /**
+   * Read a lattice from a serialized Lattice message, decoding one bin
+   * at a time.
+   *
+   * The bins are built as soon as they are read if the acdfgs they
+   * refer to were already read (always true for the lattices written by
+   * write_lattice). Otherwise, the bin and the ones after it are kept
+   * until the end of the message.
+   */
+  Lattice* LatticeSerializer::read_lattice(google::protobuf::io::ZeroCopyInputStream* input,
+                                           std::map<AcdfgBin*, int> &acdfgBin2id) {
+    LatticeBuilder builder;
+    vector<acdfg_protobuf::Lattice::AcdfgBin*> pendingBins;
+    string headerBytes;
+    bool res = true;
+
+    {
+      StringOutputStream headerStream(&headerBytes);
+      CodedOutputStream header(&headerStream);
+
+      while (res) {
+        // a new stream for each field, to not hit the limit on the total
+        // size of the bytes read by a CodedInputStream
+        CodedInputStream codedInput(input);
+        uint32_t tag = codedInput.ReadTag();
+        if (0 == tag) {
+          res = codedInput.ConsumedEntireMessage();
+          break;
+        }
+
+        int field = WireFormatLite::GetTagFieldNumber(tag);
+        bool lengthDelimited = WireFormatLite::GetTagWireType(tag) ==
+          WireFormatLite::WIRETYPE_LENGTH_DELIMITED;
+
+        if (lengthDelimited &&
+            acdfg_protobuf::Lattice::kBinsFieldNumber == field) {
+          acdfg_protobuf::Lattice::AcdfgBin* protoBin =
+            new acdfg_protobuf::Lattice::AcdfgBin();
+          res = read_message(&codedInput, protoBin);
+          if (res && pendingBins.empty() && builder.hasAcdfgs(*protoBin)) {
+            res = builder.addBin(*protoBin);
+            delete protoBin;
+          } else {
+            pendingBins.push_back(protoBin);
+          }
+        } else if (lengthDelimited &&
+                   acdfg_protobuf::Lattice::kAcdfgsFieldNumber == field) {
+          acdfg_protobuf::Acdfg protoAcdfg;
+          res = read_message(&codedInput, &protoAcdfg);
+          if (res)
+            builder.addAcdfg(protoAcdfg);
+        } else {
+          // the other fields are small and read at the end
+          res = WireFormatLite::SkipField(&codedInput, tag, &header);
+        }
+      }
+    }
 
-      acdfg_protobuf::Acdfg* proto_repr = proto_a->mutable_acdfg_repr();
-      AcdfgSerializer serializer;
-      Acdfg* reprAcdfg = (a->getRepresentative());
-      serializer.fill_proto_from_acdfg((const Acdfg&) *reprAcdfg, proto_repr);
+    for (acdfg_protobuf::Lattice::AcdfgBin* protoBin : pendingBins) {
+      res = res && builder.addBin(*protoBin);
+      delete protoBin;
+    }
 
-      const map<string, IsoRepr*> names_to_iso = a->getAcdfgNameToIso();
-      for (auto it = names_to_iso.begin(); it != names_to_iso.end(); it++) {
-        acdfg_protobuf::Lattice::IsoPair* pair = proto_a->add_names_to_iso();
-        pair->set_method_name(it->first);
-        pair->set_allocated_iso(it->second->proto_from_iso());
-      }
+    acdfg_protobuf::Lattice protoHeader;
+    if (! (res && protoHeader.ParseFromString(headerBytes))) {
+      std::cerr << "Cannot parse the lattice" << endl;
+      return NULL;
+    }
 
-      for (AcdfgBin* subsuming : a->getSubsumingBins()) {
-        int id = acdfgBin2idMap[subsuming];
-        proto_a->add_subsuming_bins(id);
-      }
+    return builder.build(protoHeader, acdfgBin2id);
+  }
 
-      for (AcdfgBin* incoming : a->getIncomingEdges()) {
-        int id = acdfgBin2idMap[incoming];
-        proto_a->add_incoming_edges(id);
-      }
+  /**
+   * Fill all the fields of protoLattice but the bins and the acdfgs
+   */
+  static void fill_proto_header(const Lattice & lattice,
+                                int version,
+                                bool reducedRelations,
+                                map<AcdfgBin*, int> & acdfgBin2idMap,
+                                acdfg_protobuf::Lattice* protoLattice) {
+    // v1 files do not have the version
+    if (LATTICE_FORMAT_V1 != version)
+      protoLattice->set_version(version);
+    if (reducedRelations)
+      protoLattice->set_reduced_relations(true);
+    // serialize_bins computes the lists if the lattice does not have them
+    protoLattice->set_has_subsuming_anomalous(true);
 
-      proto_a->set_subsuming(a->isSubsuming());
-      proto_a->set_anomalous(a->isAnomalous());
-      proto_a->set_popular(a->isPopular());
-      proto_a->set_isolated(a->isIsolated());
-      proto_a->set_cumulative_frequency(a->getCumulativeFrequency());
+    // 0. Assign the method names
+    for (const string & methodName : lattice.getMethodNames()) {
+      protoLattice->add_method_names(methodName);
     }
 
     for (auto it = lattice.beginPopular(); it != lattice.endPopular(); ++it) {
@@ -207,6 +606,17 @@ namespace fixrgraphiso {
       protoLattice->add_isolated_bins(acdfgBin2idMap[a]);
     }
 
+    // The classification is valid only if no bins changed after it
+    if (lattice.isClassified() && ! lattice.hasChangedBins()) {
+      acdfg_protobuf::Lattice::Classification* protoClassification =
+        protoLattice->mutable_classification();
+      const ClassificationParams & params = lattice.getClassification();
+      protoClassification->set_relative(params.relative);
+      protoClassification->set_freq_cutoff(params.freqCutoff);
+      protoClassification->set_relative_threshold(params.relativeThreshold);
+      protoClassification->set_anomaly_cutoff(params.anomalyCutOff);
+    }
+
     acdfg_protobuf::Lattice::Stats* stats = protoLattice->mutable_stats();
 
     stats->set_numsatcalls(lattice.getStats().getNumSATCalls());
@@ -219,16 +629,166 @@ namespace fixrgraphiso {
     stats->set_minnodes(lattice.getStats().getMinNodes());
     stats->set_minedges(lattice.getStats().getMinEdges());
     stats->set_satsolvertime(lattice.getStats().getSatSolverTime().count());
+  }
+
+  /**
+   * Serialize the bins (and the acdfgs of the format v2) one at a time
+   * into the sink
+   */
+  static void serialize_bins(const Lattice & lattice,
+                             int version,
+                             bool reducedRelations,
+                             map<AcdfgBin*, int> & acdfgBin2idMap,
+                             LatticeProtoSink & sink) {
+    AcdfgTable acdfgTable(sink);
+    vector<AcdfgBin*> subsumingAnomalous;
+
+    // 2. Populate the bins field
+    for (auto it = lattice.beginAllBins();
+         it != lattice.endAllBins(); ++it) {
+      AcdfgBin * a = *it;
+      int id = acdfgBin2idMap[a];
+
+      acdfg_protobuf::Lattice::AcdfgBin protoBin;
+      acdfg_protobuf::Lattice::AcdfgBin* proto_a = &protoBin;
+
+      proto_a->set_id(id);
+
+      Acdfg* reprAcdfg = (a->getRepresentative());
+      if (LATTICE_FORMAT_V1 == version) {
+        acdfg_protobuf::Acdfg* proto_repr = proto_a->mutable_acdfg_repr();
+        AcdfgSerializer serializer;
+        serializer.fill_proto_from_acdfg((const Acdfg&) *reprAcdfg, proto_repr);
+      } else {
+        proto_a->set_acdfg_repr_ref(acdfgTable.getRef(reprAcdfg));
+      }
+      if (! a->getRepresentativeName().empty())
+        proto_a->set_repr_name(a->getRepresentativeName());
+
+      const map<string, IsoRepr*> & names_to_iso = a->getAcdfgNameToIso();
+      for (auto it = names_to_iso.begin(); it != names_to_iso.end(); it++) {
+        acdfg_protobuf::Lattice::IsoPair* pair = proto_a->add_names_to_iso();
+        pair->set_method_name(it->first);
+        if (LATTICE_FORMAT_V1 == version) {
+          pair->set_allocated_iso(it->second->proto_from_iso());
+        } else {
+          acdfg_protobuf::Lattice::IsoRef* isoRef = pair->mutable_iso_ref();
+          isoRef->set_acdfg_1(acdfgTable.getRef(it->second->getAcdfg1Ptr()));
+          isoRef->set_acdfg_2(acdfgTable.getRef(it->second->getAcdfg2Ptr()));
+          fill_proto_from_rel(it->second->getNodesRel(),
+                              isoRef->mutable_nodesmap());
+          fill_proto_from_rel(it->second->getEdgesRel(),
+                              isoRef->mutable_edgesmap());
+        }
+      }
+
+      if (reducedRelations) {
+        for (AcdfgBin* subsuming : a->getImmediateSubsumingBins()) {
+          int id = acdfgBin2idMap[subsuming];
+          proto_a->add_subsuming_bins(id);
+        }
+      } else {
+        for (AcdfgBin* subsuming : a->getSubsumingBins()) {
+          int id = acdfgBin2idMap[subsuming];
+          proto_a->add_subsuming_bins(id);
+        }
+
+        for (AcdfgBin* incoming : a->getIncomingEdges()) {
+          int id = acdfgBin2idMap[incoming];
+          proto_a->add_incoming_edges(id);
+        }
+      }
+
+      if (a->isPopular()) {
+        if (lattice.hasSubsumingAnomalous())
+          subsumingAnomalous = a->getSubsumingAnomalous();
+        else
+          Lattice::computeSubsumingAnomalous(a, subsumingAnomalous);
+        for (AcdfgBin* anomalous : subsumingAnomalous)
+          proto_a->add_subsuming_anomalous(acdfgBin2idMap[anomalous]);
+      }
+
+      proto_a->set_subsuming(a->isSubsuming());
+      proto_a->set_anomalous(a->isAnomalous());
+      proto_a->set_popular(a->isPopular());
+      proto_a->set_isolated(a->isIsolated());
+      proto_a->set_cumulative_frequency(a->getCumulativeFrequency());
+
+      sink.addBin(protoBin);
+    }
+  }
+
+  /**
+   * Serialize a lattice structure in a protobuffer
+   */
+  acdfg_protobuf::Lattice* LatticeSerializer::proto_from_lattice(const Lattice & lattice) {
+    return proto_from_lattice(lattice, LATTICE_FORMAT_VERSION, false);
+  }
+
+  /**
+   * Serialize a lattice structure in a protobuffer using the given
+   * format version.
+   *
+   * If reducedRelations is true only the immediately subsuming bins are
+   * stored (supported only from the format v2, since a v1 reader would
+   * take them as the closed relation).
+   */
+  acdfg_protobuf::Lattice* LatticeSerializer::proto_from_lattice(const Lattice & lattice,
+                                                                 int version,
+                                                                 bool reducedRelations) {
+    acdfg_protobuf::Lattice* protoLattice = new acdfg_protobuf::Lattice();
+    MessageSink sink(protoLattice);
+
+    assert(LATTICE_FORMAT_V1 == version || LATTICE_FORMAT_V2 == version);
+    assert(LATTICE_FORMAT_V1 != version || ! reducedRelations);
+
+    // 1. Assign the IDs to the bins
+    map<AcdfgBin*, int> acdfgBin2idMap;
+    lattice.getAcdfgBin2id(acdfgBin2idMap);
+
+    fill_proto_header(lattice, version, reducedRelations, acdfgBin2idMap,
+                      protoLattice);
+    serialize_bins(lattice, version, reducedRelations, acdfgBin2idMap, sink);
 
     return protoLattice;
   }
 
+  /**
+   * Write the lattice as a Lattice message without building it in
+   * memory: the bins (and the acdfgs) are written as soon as they are
+   * serialized, after all the other fields.
+   *
+   * Return false on a write error.
+   */
+  bool LatticeSerializer::write_lattice(const Lattice & lattice,
+                                        int version,
+                                        bool reducedRelations,
+                                        google::protobuf::io::ZeroCopyOutputStream* output) {
+    assert(LATTICE_FORMAT_V1 == version || LATTICE_FORMAT_V2 == version);
+    assert(LATTICE_FORMAT_V1 != version || ! reducedRelations);
+
+    map<AcdfgBin*, int> acdfgBin2idMap;
+    lattice.getAcdfgBin2id(acdfgBin2idMap);
+
+    acdfg_protobuf::Lattice protoHeader;
+    fill_proto_header(lattice, version, reducedRelations, acdfgBin2idMap,
+                      &protoHeader);
+
+    CodedOutputStream codedOutput(output);
+    protoHeader.SerializeToCodedStream(&codedOutput);
+
+    StreamSink sink(&codedOutput);
+    serialize_bins(lattice, version, reducedRelations, acdfgBin2idMap, sink);
+
+    return ! codedOutput.HadError();
+  }
+
   acdfg_protobuf::Lattice* LatticeSerializer::read_protobuf(const char* file_name) {
     acdfg_protobuf::Lattice* lattice = new acdfg_protobuf::Lattice();
 
     std::fstream input_stream (file_name, std::ios::in | std::ios::binary);
     if (input_stream.is_open()) {
-      if (lattice->ParseFromIstream(&input_stream)) {
+      if (parseFromStream(input_stream, lattice)) {
         return lattice;
       } else {
         return NULL;
@@ -239,38 +799,72 @@ namespace fixrgraphiso {
   }
 
   Lattice* readLattice(string latticeFile) {
-    LatticeSerializer s;
-    Lattice * res = NULL;
-
-    acdfg_protobuf::Lattice * proto = s.read_protobuf(latticeFile.c_str());
-    if (NULL != proto) {
-      map<AcdfgBin*, int> acdfgBin2id;
-      res = s.lattice_from_proto(proto, acdfgBin2id);
-    }
-    delete(proto);
-    return res;
+    map<AcdfgBin*, int> acdfgBin2id;
+    return readLattice(latticeFile, acdfgBin2id);
   }
 
   Lattice* readLattice(string latticeFile,
                        map<AcdfgBin*, int> &acdfgBin2id) {
     LatticeSerializer s;
-    Lattice * res = NULL;
 
-    acdfg_protobuf::Lattice * proto = s.read_protobuf(latticeFile.c_str());
-    if (NULL != proto) {
-      res = s.lattice_from_proto(proto, acdfgBin2id);
+    std::ifstream input_stream(latticeFile.c_str(),
+                               std::ios::in | std::ios::binary);
+    if (! input_stream.is_open())
+      return NULL;
+
+    ProtoInputStream input(input_stream);
+    return s.read_lattice(input.get(), acdfgBin2id);
+  }
+
+  /**
+   * Read the whole lattice message in an arena and decode it with
+   * numThreads threads.
+   *
+   * Faster than readLattice on multiple cores, but it keeps all the
+   * serialized lattice in memory while decoding it.
+   */
+  Lattice* readLatticeParallel(string latticeFile,
+                               map<AcdfgBin*, int> &acdfgBin2id,
+                               int numThreads) {
+    LatticeSerializer s;
+
+    std::ifstream input_stream(latticeFile.c_str(),
+                               std::ios::in | std::ios::binary);
+    if (! input_stream.is_open())
+      return NULL;
+
+    google::protobuf::Arena arena;
+    acdfg_protobuf::Lattice* protoLattice =
+      google::protobuf::Arena::CreateMessage<acdfg_protobuf::Lattice>(&arena);
+    {
+      ProtoInputStream input(input_stream);
+      if (! protoLattice->ParseFromZeroCopyStream(input.get()))
+        return NULL;
     }
-    delete(proto);
-    return res;
+
+    return s.lattice_from_proto(protoLattice, acdfgBin2id, numThreads);
   }
 
   void writeLattice(const Lattice& lattice, string const& outFile) {
+    writeLattice(lattice, outFile, LATTICE_FORMAT_VERSION);
+  }
+
+  void writeLattice(const Lattice& lattice, string const& outFile,
+                    int version) {
+    writeLattice(lattice, outFile, version, false);
+  }
+
+  void writeLattice(const Lattice& lattice, string const& outFile,
+                    int version, bool reducedRelations) {
     LatticeSerializer s;
-    acdfg_protobuf::Lattice * protoWrite = s.proto_from_lattice(lattice);
 
     fstream myfile(outFile.c_str(), ios::out | ios::binary | ios::trunc);
-    protoWrite->SerializeToOstream(&myfile);
+    {
+      ProtoOutputStream output(myfile);
+      if (! (s.write_lattice(lattice, version, reducedRelations, output.get()) &&
+             output.close()))
+        std::cerr << "Cannot write the lattice in " << outFile << endl;
+    }
     myfile.close();
-    delete(protoWrite);
   }
 }
@@ -11,23 +11,51 @@
 
 #include "fixrgraphiso/acdfgBin.h"
 #include "fixrgraphiso/proto_acdfg_bin.pb.h"
+#include <google/protobuf/io/zero_copy_stream.h>
 
 namespace fixrgraphiso {
   namespace acdfg_protobuf = edu::colorado::plv::fixr::protobuf;
 
+  // Each bin and isomorphism embeds its acdfgs
+  const int LATTICE_FORMAT_V1 = 1;
+  // The acdfgs are stored once in a table and referenced by index
+  const int LATTICE_FORMAT_V2 = 2;
+  // Format used to write the lattices
+  const int LATTICE_FORMAT_VERSION = LATTICE_FORMAT_V2;
+
   class LatticeSerializer {
   public:
     Lattice* lattice_from_proto(acdfg_protobuf::Lattice* proto_lattice,
                                 std::map<AcdfgBin*, int> &acdfgBin2id);
+    Lattice* lattice_from_proto(acdfg_protobuf::Lattice* proto_lattice,
+                                std::map<AcdfgBin*, int> &acdfgBin2id,
+                                int numThreads);
     acdfg_protobuf::Lattice* proto_from_lattice(const Lattice & lattice);
+    acdfg_protobuf::Lattice* proto_from_lattice(const Lattice & lattice,
+                                                int version,
+                                                bool reducedRelations);
     acdfg_protobuf::Lattice* read_protobuf(const char* file_name);
+
+    /* Streaming read and write, one bin at a time */
+    Lattice* read_lattice(google::protobuf::io::ZeroCopyInputStream* input,
+                          std::map<AcdfgBin*, int> &acdfgBin2id);
+    bool write_lattice(const Lattice & lattice, int version,
+                       bool reducedRelations,
+                       google::protobuf::io::ZeroCopyOutputStream* output);
   private:
   };
 
   Lattice* readLattice(string latticeFile);
   Lattice* readLattice(string latticeFile,
                        std::map<AcdfgBin*, int> &acdfgBin2id);
+  Lattice* readLatticeParallel(string latticeFile,
+                               std::map<AcdfgBin*, int> &acdfgBin2id,
+                               int numThreads);
   void writeLattice(const Lattice& lattice, string const& outFile);
+  void writeLattice(const Lattice& lattice, string const& outFile,
+                    int version);
+  void writeLattice(const Lattice& lattice, string const& outFile,
+                    int version, bool reducedRelations);
 
 } // end fixrgraphiso namespace
 
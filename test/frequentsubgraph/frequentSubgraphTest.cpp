@@ -1,5 +1,9 @@
 #include <fstream>
 #include <iostream>
+#include <algorithm>
+#include <cstdio>
+#include <set>
+#include <unistd.h>
 #include "frequentSubgraphTest.h"
 #include "fixrgraphiso/isomorphismClass.h"
 #include "fixrgraphiso/serialization.h"
@@ -7,6 +11,8 @@
 #include "fixrgraphiso/acdfgBin.h"
 #include "fixrgraphiso/serializationLattice.h"
 #include "fixrgraphiso/searchLattice.h"
+#include "fixrgraphiso/parallel.h"
+#include "fixrgraphiso/compression.h"
 
 namespace frequentSubgraph {
   using namespace std;
@@ -80,6 +86,471 @@ namespace frequentSubgraph {
     }
   }
 
+  class ExposedMiner : public fixrgraphiso::FrequentSubgraphMiner {
+  public:
+    using FrequentSubgraphMiner::sliceAcdfgs;
+    using FrequentSubgraphMiner::binAndSubs;
+    using FrequentSubgraphMiner::binAndSubsBatch;
+    using FrequentSubgraphMiner::classifyBins;
+    using FrequentSubgraphMiner::classifyAllBins;
+    using FrequentSubgraphMiner::processCommandLine;
+  };
+
+  void readNames(const string & fileName, vector<string> & names,
+                 int maxNames) {
+    ifstream in(fileName.c_str());
+    string line;
+    while (names.size() < maxNames && std::getline(in, line)) {
+      if (! line.empty())
+        names.push_back(line);
+    }
+  }
+
+  void getSortedFrequencies(const Lattice & lattice, vector<int> & freqs) {
+    for (auto bin : lattice.getAllBins())
+      freqs.push_back(bin->getFrequency());
+    std::sort(freqs.begin(), freqs.end());
+  }
+
+  bool isClosed(const Lattice & lattice) {
+    for (auto bin : lattice.getAllBins()) {
+      for (auto upper : bin->getSubsumingBins()) {
+        if (upper->getIncomingEdges().count(bin) == 0)
+          return false;
+        for (auto upperUpper : upper->getSubsumingBins())
+          if (bin->getSubsumingBins().count(upperUpper) == 0)
+            return false;
+      }
+    }
+    return true;
+  }
+
+  TEST_F(FrequentSubgraphTest, BatchInsertion) {
+    vector<string> fileNames;
+    vector<string> methodNames;
+    readNames("../test_data/acdfg_list.txt", fileNames, 30);
+    readNames("../test_data/methods_521.txt", methodNames, 1000);
+
+    ExposedMiner miner;
+    Lattice single(methodNames);
+    Lattice batch(methodNames);
+    vector<Acdfg*> acdfgs;
+    miner.sliceAcdfgs(fileNames, methodNames, single, acdfgs);
+    ASSERT_TRUE(acdfgs.size() > 0);
+
+    for (Acdfg* a : acdfgs)
+      miner.binAndSubs(single, a);
+    ASSERT_TRUE(isClosed(single));
+
+    /* insert the acdfgs in batches of 8 */
+    for (int i = 0; i < acdfgs.size(); i += 8) {
+      int end = i + 8 < acdfgs.size() ? i + 8 : acdfgs.size();
+      vector<Acdfg*> current(acdfgs.begin() + i, acdfgs.begin() + end);
+      miner.binAndSubsBatch(batch, current);
+    }
+    ASSERT_TRUE(isClosed(batch));
+
+    ASSERT_EQ(single.getAllBins().size(), batch.getAllBins().size());
+    vector<int> singleFreqs;
+    vector<int> batchFreqs;
+    getSortedFrequencies(single, singleFreqs);
+    getSortedFrequencies(batch, batchFreqs);
+    ASSERT_TRUE(singleFreqs == batchFreqs) << "Different bins";
+    ASSERT_TRUE(batch.isValid());
+
+    for (Acdfg* a : acdfgs)
+      delete(a);
+  }
+
+  /**
+   * Remove the representative of the bin at binPos in the lattice
+   * read from latticeFile
+   */
+  void checkReprRemoval(const string & latticeFile, int binPos,
+                        const string & reprName) {
+    Lattice* lattice = fixrgraphiso::readLattice(latticeFile);
+    ASSERT_TRUE(NULL != lattice);
+    AcdfgBin* bin = lattice->getAllBins()[binPos];
+    const Acdfg* oldRepr = bin->getRepresentative();
+    int frequency = bin->getFrequency();
+
+    vector<string> toRemove(1, reprName);
+    ASSERT_EQ(1, lattice->removeAcdfgs(toRemove));
+    ASSERT_EQ(frequency - 1, bin->getFrequency());
+    ASSERT_NE(oldRepr, bin->getRepresentative());
+
+    const string & newReprName = bin->getRepresentativeName();
+    ASSERT_TRUE(bin->hasAcdfg(newReprName));
+    ASSERT_EQ(newReprName, bin->getRepresentative()->getName());
+    for (auto nameIso : bin->getAcdfgNameToIso()) {
+      ASSERT_EQ(bin->getRepresentative(), &(nameIso.second->getAcdfg2()));
+      // the promoted acdfg is a copy, not shared with the other members
+      if (nameIso.first != newReprName) {
+        ASSERT_NE(bin->getRepresentative(), nameIso.second->getAcdfg1Ptr());
+      }
+    }
+    delete lattice;
+  }
+
+  /* The members of each bin */
+  void getBinMembers(const Lattice & lattice,
+                     std::set<std::set<string>> & members) {
+    for (auto bin : lattice.getAllBins())
+      members.insert(std::set<string>(bin->getAcdfgNames().begin(),
+                                      bin->getAcdfgNames().end()));
+  }
+
+  TEST_F(FrequentSubgraphTest, InsertionOrders) {
+    vector<string> fileNames;
+    vector<string> methodNames;
+    readNames("../test_data/acdfg_list.txt", fileNames, 30);
+    readNames("../test_data/methods_521.txt", methodNames, 1000);
+
+    ExposedMiner miner;
+    Lattice reference(methodNames);
+    vector<Acdfg*> acdfgs;
+    miner.sliceAcdfgs(fileNames, methodNames, reference, acdfgs);
+    ASSERT_TRUE(acdfgs.size() > 0);
+    for (Acdfg* a : acdfgs)
+      miner.binAndSubs(reference, a);
+    std::set<std::set<string>> referenceMembers;
+    getBinMembers(reference, referenceMembers);
+    vector<int> referenceFreqs;
+    getSortedFrequencies(reference, referenceFreqs);
+
+    /* the bins do not depend on the insertion order */
+    vector<string> policies = {"size-asc", "size-desc", "methods",
+                               "duplicates", "random", "random:7"};
+    for (const string & policy : policies) {
+      ASSERT_TRUE(fixrgraphiso::isValidInsertionOrder(policy)) << policy;
+      vector<Acdfg*> sorted(acdfgs);
+      fixrgraphiso::sortByInsertionOrder(sorted, policy);
+      ASSERT_TRUE(std::is_permutation(sorted.begin(), sorted.end(),
+                                      acdfgs.begin())) << policy;
+
+      Lattice lattice(methodNames);
+      for (Acdfg* a : sorted)
+        miner.binAndSubs(lattice, a);
+      std::set<std::set<string>> members;
+      getBinMembers(lattice, members);
+      ASSERT_TRUE(referenceMembers == members) << "Different bins with " <<
+        policy;
+      vector<int> freqs;
+      getSortedFrequencies(lattice, freqs);
+      ASSERT_EQ(referenceFreqs, freqs) << policy;
+      ASSERT_TRUE(isClosed(lattice)) << policy;
+    }
+
+    /* an unknown policy is rejected */
+    ASSERT_FALSE(fixrgraphiso::isValidInsertionOrder("size"));
+    ASSERT_FALSE(fixrgraphiso::isValidInsertionOrder(""));
+    {
+      ExposedMiner other;
+      vector<string> otherFiles;
+      vector<string> otherMethods;
+      char program[] = "frequentsubgraphs";
+      char option[] = "-O";
+      char policy[] = "unknown";
+      char* argv[] = {program, option, policy, NULL};
+      optind = 1;
+      ASSERT_EQ(1, other.processCommandLine(3, argv, otherFiles,
+                                            otherMethods));
+    }
+
+    for (Acdfg* a : acdfgs)
+      delete(a);
+  }
+
+  TEST_F(FrequentSubgraphTest, LatticeRemoval) {
+    vector<string> fileNames;
+    vector<string> methodNames;
+    readNames("../test_data/acdfg_list.txt", fileNames, 30);
+    readNames("../test_data/methods_521.txt", methodNames, 1000);
+
+    ExposedMiner miner;
+    Lattice lattice(methodNames);
+    vector<Acdfg*> acdfgs;
+    miner.sliceAcdfgs(fileNames, methodNames, lattice, acdfgs);
+    for (Acdfg* a : acdfgs)
+      miner.binAndSubs(lattice, a);
+
+    int binsCount = lattice.getAllBins().size();
+    AcdfgBin* shared = NULL;
+    AcdfgBin* single = NULL;
+    for (auto bin : lattice.getAllBins()) {
+      if (NULL == shared && bin->getFrequency() > 1) shared = bin;
+      if (NULL == single && bin->getFrequency() == 1 &&
+          bin->getSubsumingBins().size() > 0) single = bin;
+    }
+    ASSERT_TRUE(NULL != shared && NULL != single);
+
+    /* remove the representative from the lattice read back, also when
+       the lattice does not store its name (older lattices) */
+    const string reprName = shared->getRepresentativeName();
+    ASSERT_TRUE(shared->hasAcdfg(reprName));
+    int sharedPos = std::find(lattice.getAllBins().begin(),
+                              lattice.getAllBins().end(), shared) -
+      lattice.getAllBins().begin();
+    string const& v1File = "/tmp/lattice_removal_v1.bin";
+    string const& v2File = "/tmp/lattice_removal_v2.bin";
+    vector<string> reprNames;
+    for (auto bin : lattice.getAllBins())
+      reprNames.push_back(bin->getRepresentativeName());
+    for (bool withNames : {true, false}) {
+      for (int i = 0; i < reprNames.size(); i++)
+        lattice.getAllBins()[i]->setRepresentativeName(withNames ?
+                                                       reprNames[i] : "");
+      fixrgraphiso::writeLattice(lattice, v1File,
+                                 fixrgraphiso::LATTICE_FORMAT_V1);
+      fixrgraphiso::writeLattice(lattice, v2File,
+                                 fixrgraphiso::LATTICE_FORMAT_V2);
+      checkReprRemoval(v1File, sharedPos, reprName);
+      checkReprRemoval(v2File, sharedPos, reprName);
+    }
+    for (int i = 0; i < reprNames.size(); i++)
+      lattice.getAllBins()[i]->setRepresentativeName(reprNames[i]);
+
+    /* remove the representative, another member is promoted */
+    int frequency = shared->getFrequency();
+    vector<string> toRemove;
+    toRemove.push_back(reprName);
+    ASSERT_EQ(1, lattice.removeAcdfgs(toRemove));
+    ASSERT_EQ(frequency - 1, shared->getFrequency());
+    ASSERT_TRUE(shared->hasAcdfg(shared->getRepresentativeName()));
+    for (auto nameIso : shared->getAcdfgNameToIso())
+      ASSERT_EQ(shared->getRepresentative(), &(nameIso.second->getAcdfg2()));
+
+    /* remove the only member, the bin is deleted */
+    toRemove.clear();
+    toRemove.push_back(single->getAcdfgNames().front());
+    ASSERT_EQ(1, lattice.removeAcdfgs(toRemove));
+    ASSERT_EQ(binsCount - 1, lattice.getAllBins().size());
+    for (auto bin : lattice.getAllBins()) {
+      ASSERT_EQ(0, bin->getSubsumingBins().count(single));
+      ASSERT_EQ(0, bin->getIncomingEdges().count(single));
+    }
+    ASSERT_TRUE(isClosed(lattice));
+
+    /* the bin ids are still dense */
+    std::set<int> ids;
+    for (auto bin : lattice.getAllBins())
+      ids.insert(bin->getId());
+    ASSERT_EQ(lattice.getAllBins().size(), ids.size());
+    ASSERT_EQ(0, *ids.begin());
+    ASSERT_EQ(lattice.getAllBins().size() - 1, *ids.rbegin());
+
+    for (Acdfg* a : acdfgs)
+      delete(a);
+  }
+
+  bool sameBins(const vector<AcdfgBin*> & a, const vector<AcdfgBin*> & b) {
+    std::set<AcdfgBin*> setA(a.begin(), a.end());
+    std::set<AcdfgBin*> setB(b.begin(), b.end());
+    return setA == setB;
+  }
+
+  TEST_F(FrequentSubgraphTest, ThresholdSweep) {
+    string const& inFile = "../test_data/subgraph_results/lattice.bin";
+    Lattice *lattice = fixrgraphiso::readLattice(inFile);
+    ASSERT_TRUE(NULL != lattice) << "Cannot read the lattice in " << inFile;
+
+    ExposedMiner miner;
+    vector<int> absCutoffs = {5, 20};
+    vector<double> relThresholds = {0.1};
+    vector<fixrgraphiso::ThresholdClassification> results;
+    miner.sweepThresholds(*lattice, absCutoffs, relThresholds, results);
+    ASSERT_EQ(3, results.size());
+    ASSERT_EQ(3, results[1].popular.size());
+    ASSERT_EQ(4, results[1].anomalous.size());
+    ASSERT_EQ(15, results[1].isolated.size());
+    ASSERT_TRUE(results[2].isRelative);
+
+    /* same result of the classification with the default cutoff (20) */
+    lattice->resetClassification();
+    lattice->sortByFrequency();
+    miner.classifyBins(*lattice);
+    ASSERT_TRUE(sameBins(lattice->getPopularBins(), results[1].popular));
+    ASSERT_TRUE(sameBins(lattice->getAnomalousBins(), results[1].anomalous));
+    ASSERT_TRUE(sameBins(lattice->getIsolatedBins(), results[1].isolated));
+
+    delete(lattice);
+  }
+
+  void getIds(const vector<AcdfgBin*> & bins, std::set<int> & ids) {
+    for (auto bin : bins)
+      ids.insert(bin->getId());
+  }
+
+  TEST_F(FrequentSubgraphTest, RelativeClassification) {
+    string const& inFile = "../test_data/subgraph_results/lattice.bin";
+    vector<double> thresholds = {0.05, 0.1, 0.2};
+    /* ids of the popular, anomalous and isolated bins for each threshold,
+       computed before the rewrite of computePopularity */
+    vector<vector<std::set<int>>> expected = {
+      {{0, 1, 2, 3, 4, 5, 6, 7, 9, 10, 16, 21, 43}, {22, 25, 26}, {}},
+      {{0, 1, 2, 3, 4, 5, 6, 7, 9, 16, 26}, {22, 25}, {}},
+      {{1, 3, 4, 9, 16}, {5, 6}, {2, 10, 13, 26, 30}}};
+
+    Lattice *sweepLattice = fixrgraphiso::readLattice(inFile);
+    ASSERT_TRUE(NULL != sweepLattice) << "Cannot read the lattice in " <<
+      inFile;
+    ExposedMiner sweepMiner;
+    vector<fixrgraphiso::ThresholdClassification> results;
+    sweepMiner.sweepThresholds(*sweepLattice, vector<int>(), thresholds,
+                               results);
+    ASSERT_EQ(thresholds.size(), results.size());
+
+    for (int k = 0; k < thresholds.size(); k++) {
+      Lattice *lattice = fixrgraphiso::readLattice(inFile);
+      ASSERT_TRUE(NULL != lattice) << "Cannot read the lattice in " << inFile;
+
+      /* classify with the relative popularity (-r) */
+      ExposedMiner miner;
+      vector<string> fileNames;
+      vector<string> methodNames;
+      char program[] = "frequentsubgraphs";
+      char classify[] = "-c";
+      char relative[] = "-r";
+      char threshold[32];
+      snprintf(threshold, sizeof(threshold), "%g", thresholds[k]);
+      char* argv[] = {program, classify, relative, threshold, NULL};
+      optind = 1;
+      ASSERT_EQ(0, miner.processCommandLine(4, argv, fileNames, methodNames));
+      lattice->sortByFrequency();
+      miner.classifyBins(*lattice);
+
+      std::set<int> ids;
+      getIds(lattice->getPopularBins(), ids);
+      ASSERT_TRUE(expected[k][0] == ids) << "Popular bins for " << threshold;
+      ids.clear();
+      getIds(lattice->getAnomalousBins(), ids);
+      ASSERT_TRUE(expected[k][1] == ids) << "Anomalous bins for " <<
+        threshold;
+      ids.clear();
+      getIds(lattice->getIsolatedBins(), ids);
+      ASSERT_TRUE(expected[k][2] == ids) << "Isolated bins for " << threshold;
+
+      /* same result of the sweep of the thresholds */
+      ASSERT_TRUE(results[k].isRelative);
+      ids.clear();
+      getIds(results[k].popular, ids);
+      ASSERT_TRUE(expected[k][0] == ids) << "Swept popular bins for " <<
+        threshold;
+      ids.clear();
+      getIds(results[k].anomalous, ids);
+      ASSERT_TRUE(expected[k][1] == ids) << "Swept anomalous bins for " <<
+        threshold;
+      ids.clear();
+      getIds(results[k].isolated, ids);
+      ASSERT_TRUE(expected[k][2] == ids) << "Swept isolated bins for " <<
+        threshold;
+
+      delete(lattice);
+    }
+
+    delete(sweepLattice);
+  }
+
+  void testSameClassification(const Lattice & a, const Lattice & b) {
+    std::set<int> idsA, idsB;
+    getIds(a.getPopularBins(), idsA);
+    getIds(b.getPopularBins(), idsB);
+    ASSERT_TRUE(idsA == idsB) << "Different popular bins";
+    idsA.clear(); idsB.clear();
+    getIds(a.getAnomalousBins(), idsA);
+    getIds(b.getAnomalousBins(), idsB);
+    ASSERT_TRUE(idsA == idsB) << "Different anomalous bins";
+    idsA.clear(); idsB.clear();
+    getIds(a.getIsolatedBins(), idsA);
+    getIds(b.getIsolatedBins(), idsB);
+    ASSERT_TRUE(idsA == idsB) << "Different isolated bins";
+  }
+
+  TEST_F(FrequentSubgraphTest, IncrementalClassification) {
+    string const& inFile = "../test_data/subgraph_results/lattice.bin";
+    Lattice *incremental = fixrgraphiso::readLattice(inFile);
+    Lattice *full = fixrgraphiso::readLattice(inFile);
+    ASSERT_TRUE(NULL != incremental && NULL != full);
+
+    ExposedMiner miner;
+    miner.classifyBins(*incremental);
+    ASSERT_TRUE(incremental->isClassified());
+    ASSERT_FALSE(incremental->hasChangedBins());
+
+    /* add new acdfgs (copies of existing ones) */
+    vector<string> fileNames;
+    readNames("../test_data/acdfg_list.txt", fileNames, 6);
+    vector<Acdfg*> acdfgs;
+    miner.sliceAcdfgs(fileNames, incremental->getMethodNames(),
+                      *incremental, acdfgs);
+    for (Acdfg* a : acdfgs) {
+      a->setName(a->getName() + ".copy");
+      miner.binAndSubs(*incremental, a);
+      miner.binAndSubs(*full, a);
+    }
+
+    /* remove some acdfgs */
+    vector<string> toRemove;
+    for (auto bin : incremental->getAllBins())
+      if (bin->getId() % 7 == 3)
+        toRemove.push_back(bin->getAcdfgNames().front());
+    incremental->removeAcdfgs(toRemove);
+    full->removeAcdfgs(toRemove);
+    ASSERT_TRUE(incremental->hasChangedBins());
+
+    incremental->sortByFrequency();
+    miner.classifyBins(*incremental);
+    full->resetClassification();
+    full->sortByFrequency();
+    miner.classifyAllBins(*full);
+
+    testSameClassification(*incremental, *full);
+    for (auto bin : full->getAllBins())
+      ASSERT_EQ(bin->getPopularity(), bin->getCumulativeFrequency());
+
+    delete(incremental);
+    delete(full);
+    for (Acdfg* a : acdfgs)
+      delete(a);
+  }
+
+  TEST_F(FrequentSubgraphTest, TopologicalLevels) {
+    string const& inFile = "../test_data/subgraph_results/lattice.bin";
+    Lattice *lattice = fixrgraphiso::readLattice(inFile);
+    ASSERT_TRUE(NULL != lattice);
+
+    vector<vector<AcdfgBin*>> levels;
+    lattice->computeTopologicalLevels(levels);
+
+    vector<int> binLevel(lattice->getAllBins().size(), -1);
+    for (int l = 0; l < levels.size(); l++) {
+      for (auto bin : levels[l]) {
+        ASSERT_EQ(-1, binLevel[bin->getId()]);
+        binLevel[bin->getId()] = l;
+      }
+    }
+
+    for (auto bin : lattice->getAllBins()) {
+      ASSERT_NE(-1, binLevel[bin->getId()]);
+      /* the bins above are in the previous levels */
+      for (auto upper : bin->getSubsumingBins())
+        ASSERT_LT(binLevel[upper->getId()], binLevel[bin->getId()]);
+      if (bin->getImmediateSubsumingBins().empty()) {
+        ASSERT_EQ(0, binLevel[bin->getId()]);
+      }
+    }
+
+    /* every index is visited once by the threads */
+    vector<int> visits(1000, 0);
+    fixrgraphiso::parallelFor(0, visits.size(), 4, [&](int i) {
+        visits[i] += 1;
+      });
+    for (int count : visits)
+      ASSERT_EQ(1, count);
+
+    delete(lattice);
+  }
+
   TEST_F(FrequentSubgraphTest, LatticeSerialization) {
     string const& inFile = "../test_data/subgraph_results/lattice.bin";
     LatticeSerializer s;
@@ -110,6 +581,291 @@ namespace frequentSubgraph {
     }
   }
 
+  long fileSize(const string & fileName) {
+    ifstream in(fileName.c_str(), std::ios::binary | std::ios::ate);
+    return in.tellg();
+  }
+
+  TEST_F(FrequentSubgraphTest, LatticeFormatVersions) {
+    string const& inFile = "../test_data/subgraph_results/lattice.bin";
+    string const& v1File = "../test_data/subgraph_results/lattice_v1.bin";
+    string const& v2File = "../test_data/subgraph_results/lattice_v2.bin";
+    Lattice *orig = fixrgraphiso::readLattice(inFile);
+    ASSERT_TRUE(NULL != orig);
+
+    fixrgraphiso::writeLattice(*orig, v1File, fixrgraphiso::LATTICE_FORMAT_V1);
+    fixrgraphiso::writeLattice(*orig, v2File, fixrgraphiso::LATTICE_FORMAT_V2);
+    ASSERT_LT(fileSize(v2File), fileSize(v1File));
+
+    Lattice *read = fixrgraphiso::readLattice(v2File);
+    ASSERT_TRUE(NULL != read);
+    ASSERT_EQ(orig->getAllBins().size(), read->getAllBins().size());
+
+    for (int i = 0; i < orig->getAllBins().size(); i++) {
+      AcdfgBin* origBin = orig->getAllBins()[i];
+      AcdfgBin* readBin = read->getAllBins()[i];
+
+      ASSERT_TRUE(origBin->getAcdfgNames() == readBin->getAcdfgNames());
+      ASSERT_EQ(origBin->getSubsumingBins().size(),
+                readBin->getSubsumingBins().size());
+      ASSERT_EQ(origBin->isPopular(), readBin->isPopular());
+      ASSERT_EQ(origBin->isAnomalous(), readBin->isAnomalous());
+      ASSERT_EQ(origBin->isIsolated(), readBin->isIsolated());
+
+      for (const string & name : origBin->getAcdfgNames()) {
+        IsoRepr* origIso = origBin->getAcdfgNameToIso().at(name);
+        IsoRepr* readIso = readBin->getAcdfgNameToIso().at(name);
+        ASSERT_TRUE(origIso->getNodesRel() == readIso->getNodesRel());
+        ASSERT_TRUE(origIso->getEdgesRel() == readIso->getEdgesRel());
+        /* the representative is shared by all the isomorphisms */
+        ASSERT_EQ(readBin->getRepresentative(), readIso->getAcdfg2Ptr());
+      }
+    }
+
+    delete(read);
+    delete(orig);
+  }
+
+  void getIds(const set<AcdfgBin*> & bins, std::set<int> & ids) {
+    for (auto bin : bins)
+      ids.insert(bin->getId());
+  }
+
+  TEST_F(FrequentSubgraphTest, LatticeReducedRelations) {
+    string const& inFile = "../test_data/subgraph_results/lattice.bin";
+    string const& closedFile = "../test_data/subgraph_results/lattice_closed.bin";
+    string const& reducedFile = "../test_data/subgraph_results/lattice_reduced.bin";
+    Lattice *orig = fixrgraphiso::readLattice(inFile);
+    ASSERT_TRUE(NULL != orig);
+
+    fixrgraphiso::writeLattice(*orig, closedFile,
+                               fixrgraphiso::LATTICE_FORMAT_V2, false);
+    fixrgraphiso::writeLattice(*orig, reducedFile,
+                               fixrgraphiso::LATTICE_FORMAT_V2, true);
+    ASSERT_LT(fileSize(reducedFile), fileSize(closedFile));
+
+    Lattice *read = fixrgraphiso::readLattice(reducedFile);
+    ASSERT_TRUE(NULL != read);
+    ASSERT_TRUE(isClosed(*read));
+    ASSERT_EQ(orig->getAllBins().size(), read->getAllBins().size());
+
+    for (int i = 0; i < orig->getAllBins().size(); i++) {
+      AcdfgBin* origBin = orig->getAllBins()[i];
+      AcdfgBin* readBin = read->getAllBins()[i];
+      std::set<int> origIds, readIds;
+
+      getIds(origBin->getSubsumingBins(), origIds);
+      getIds(readBin->getSubsumingBins(), readIds);
+      ASSERT_TRUE(origIds == readIds);
+
+      origIds.clear(); readIds.clear();
+      getIds(origBin->getIncomingEdges(), origIds);
+      getIds(readBin->getIncomingEdges(), readIds);
+      ASSERT_TRUE(origIds == readIds);
+
+      origIds.clear(); readIds.clear();
+      getIds(origBin->getImmediateSubsumingBins(), origIds);
+      getIds(readBin->getImmediateSubsumingBins(), readIds);
+      ASSERT_TRUE(origIds == readIds);
+    }
+
+    delete(read);
+    delete(orig);
+  }
+
+  TEST_F(FrequentSubgraphTest, LatticeStreaming) {
+    string const& inFile = "../test_data/subgraph_results/lattice.bin";
+    string const& streamFile = "../test_data/subgraph_results/lattice_stream.bin";
+    string const& messageFile = "../test_data/subgraph_results/lattice_message.bin";
+    Lattice *orig = fixrgraphiso::readLattice(inFile);
+    ASSERT_TRUE(NULL != orig);
+
+    for (int version : {fixrgraphiso::LATTICE_FORMAT_V1,
+          fixrgraphiso::LATTICE_FORMAT_V2}) {
+      LatticeSerializer serializer;
+      iso_protobuf::Lattice* protoLattice =
+        serializer.proto_from_lattice(*orig, version, false);
+
+      /* the streamed lattice is the same message */
+      fixrgraphiso::writeLattice(*orig, streamFile, version);
+      iso_protobuf::Lattice* protoStream =
+        serializer.read_protobuf(streamFile.c_str());
+      ASSERT_TRUE(NULL != protoStream);
+      ASSERT_EQ(protoLattice->SerializeAsString(),
+                protoStream->SerializeAsString());
+      delete(protoStream);
+
+      /* the bins come before the acdfgs when writing the whole message */
+      {
+        std::ofstream out(messageFile.c_str(),
+                          std::ios::out | std::ios::binary | std::ios::trunc);
+        protoLattice->SerializeToOstream(&out);
+      }
+      delete(protoLattice);
+
+      for (const string & file : {streamFile, messageFile}) {
+        Lattice *read = fixrgraphiso::readLattice(file);
+        ASSERT_TRUE(NULL != read);
+        ASSERT_EQ(orig->getAllBins().size(), read->getAllBins().size());
+        ASSERT_EQ(orig->getPopularBins().size(), read->getPopularBins().size());
+
+        for (int i = 0; i < orig->getAllBins().size(); i++) {
+          AcdfgBin* origBin = orig->getAllBins()[i];
+          AcdfgBin* readBin = read->getAllBins()[i];
+          std::set<int> origIds, readIds;
+
+          ASSERT_TRUE(origBin->getAcdfgNames() == readBin->getAcdfgNames());
+          getIds(origBin->getSubsumingBins(), origIds);
+          getIds(readBin->getSubsumingBins(), readIds);
+          ASSERT_TRUE(origIds == readIds);
+          ASSERT_EQ(origBin->isPopular(), readBin->isPopular());
+        }
+        delete(read);
+      }
+    }
+
+    delete(orig);
+  }
+
+  TEST_F(FrequentSubgraphTest, CompressedFiles) {
+    string const& inFile = "../test_data/subgraph_results/lattice.bin";
+    string const& plainFile = "../test_data/subgraph_results/lattice_plain.bin";
+    string const& gzipFile = "../test_data/subgraph_results/lattice_gzip.bin";
+    string const& acdfgFile = "../test_data/subgraph_results/repr_gzip.acdfg.bin";
+    Lattice *orig = fixrgraphiso::readLattice(inFile);
+    ASSERT_TRUE(NULL != orig);
+
+    fixrgraphiso::writeLattice(*orig, plainFile);
+    fixrgraphiso::setOutputCompression(fixrgraphiso::COMPRESSION_GZIP);
+    fixrgraphiso::writeLattice(*orig, gzipFile);
+    orig->getAllBins().front()->dumpToProtobuf(acdfgFile);
+    fixrgraphiso::setOutputCompression(fixrgraphiso::COMPRESSION_NONE);
+
+    ASSERT_LT(fileSize(gzipFile), fileSize(plainFile));
+    {
+      std::ifstream in(gzipFile.c_str(), std::ios::in | std::ios::binary);
+      ASSERT_TRUE(fixrgraphiso::isGzipStream(in));
+    }
+
+    /* the compression is detected when reading */
+    Lattice *read = fixrgraphiso::readLattice(gzipFile);
+    ASSERT_TRUE(NULL != read);
+    ASSERT_EQ(orig->getAllBins().size(), read->getAllBins().size());
+    for (int i = 0; i < orig->getAllBins().size(); i++) {
+      ASSERT_TRUE(orig->getAllBins()[i]->getAcdfgNames() ==
+                  read->getAllBins()[i]->getAcdfgNames());
+    }
+    delete(read);
+
+    LatticeSerializer serializer;
+    iso_protobuf::Lattice* protoPlain =
+      serializer.read_protobuf(plainFile.c_str());
+    iso_protobuf::Lattice* protoGzip =
+      serializer.read_protobuf(gzipFile.c_str());
+    ASSERT_TRUE(NULL != protoPlain && NULL != protoGzip);
+    ASSERT_EQ(protoPlain->bins_size(), protoGzip->bins_size());
+    delete(protoPlain);
+    delete(protoGzip);
+
+    Acdfg* acdfg = fixrgraphiso::readAcdfg(acdfgFile);
+    ASSERT_TRUE(NULL != acdfg);
+    ASSERT_EQ(orig->getAllBins().front()->getRepresentative()->node_count(),
+              acdfg->node_count());
+    delete(acdfg);
+
+    delete(orig);
+  }
+
+  TEST_F(FrequentSubgraphTest, LatticeParallelRead) {
+    string const& inFile = "../test_data/subgraph_results/lattice.bin";
+    string const& v1File = "../test_data/subgraph_results/lattice_par_v1.bin";
+    string const& v2File = "../test_data/subgraph_results/lattice_par_v2.bin";
+    Lattice *orig = fixrgraphiso::readLattice(inFile);
+    ASSERT_TRUE(NULL != orig);
+
+    fixrgraphiso::writeLattice(*orig, v1File, fixrgraphiso::LATTICE_FORMAT_V1);
+    fixrgraphiso::writeLattice(*orig, v2File, fixrgraphiso::LATTICE_FORMAT_V2);
+
+    for (const string & file : {v1File, v2File}) {
+      std::map<AcdfgBin*, int> acdfgBin2id;
+      Lattice *read = fixrgraphiso::readLatticeParallel(file, acdfgBin2id, 4);
+      ASSERT_TRUE(NULL != read);
+      ASSERT_EQ(orig->getAllBins().size(), read->getAllBins().size());
+      ASSERT_EQ(orig->getAllBins().size(), acdfgBin2id.size());
+
+      for (int i = 0; i < orig->getAllBins().size(); i++) {
+        AcdfgBin* origBin = orig->getAllBins()[i];
+        AcdfgBin* readBin = read->getAllBins()[i];
+        std::set<int> origIds, readIds;
+
+        ASSERT_EQ(i, readBin->getId());
+        ASSERT_TRUE(origBin->getAcdfgNames() == readBin->getAcdfgNames());
+        ASSERT_EQ(origBin->getRepresentative()->node_count(),
+                  readBin->getRepresentative()->node_count());
+        getIds(origBin->getSubsumingBins(), origIds);
+        getIds(readBin->getSubsumingBins(), readIds);
+        ASSERT_TRUE(origIds == readIds);
+        ASSERT_EQ(origBin->isPopular(), readBin->isPopular());
+        ASSERT_EQ(origBin->isAnomalous(), readBin->isAnomalous());
+      }
+      delete(read);
+    }
+
+    delete(orig);
+  }
+
+  int sumFrequencies(const Lattice & lattice) {
+    int sum = 0;
+    for (auto bin : lattice.getAllBins())
+      sum += bin->getFrequency();
+    return sum;
+  }
+
+  TEST_F(FrequentSubgraphTest, LatticeMerge) {
+    string const& inFile = "../test_data/subgraph_results/lattice.bin";
+    Lattice *orig = fixrgraphiso::readLattice(inFile);
+    Lattice *other = fixrgraphiso::readLattice(inFile);
+    ASSERT_TRUE(NULL != orig) << "Cannot read the lattice in " << inFile;
+    ASSERT_TRUE(NULL != other) << "Cannot read the lattice in " << inFile;
+
+    int binsCount = orig->getAllBins().size();
+    int frequencies = sumFrequencies(*orig);
+
+    /* merge in an empty lattice rebuilds the same bins */
+    Lattice merged(orig->getMethodNames());
+    vector<Lattice*> others;
+    others.push_back(orig);
+
+    fixrgraphiso::FrequentSubgraphMiner miner;
+    ASSERT_EQ(0, miner.merge(merged, others, 20,
+                             "../test_data/produced_res"));
+    ASSERT_EQ(binsCount, merged.getAllBins().size());
+    ASSERT_EQ(frequencies, sumFrequencies(merged));
+    ASSERT_TRUE(merged.isValid());
+
+    /* merge the same graphs again does not change the lattice */
+    others.clear();
+    others.push_back(other);
+    ASSERT_EQ(0, miner.merge(merged, others, 20,
+                             "../test_data/produced_res"));
+    ASSERT_EQ(binsCount, merged.getAllBins().size());
+    ASSERT_EQ(frequencies, sumFrequencies(merged));
+
+    /* a graph already in a different bin is not added again */
+    AcdfgBin* first = other->getAllBins()[0];
+    AcdfgBin* second = other->getAllBins()[1];
+    const string & movedName = first->getAcdfgNames().front();
+    second->insertEquivalentACDFG(movedName,
+                                  new IsoRepr(*second->getAcdfgNameToIso().begin()->second));
+    ASSERT_EQ(0, miner.merge(merged, others, 20,
+                             "../test_data/produced_res"));
+    ASSERT_EQ(binsCount, merged.getAllBins().size());
+    ASSERT_EQ(frequencies, sumFrequencies(merged));
+
+    delete(other);
+    delete(orig);
+  }
+
   TEST_F(FrequentSubgraphTest, LatticeSearch) {
     string const& inFile = "../test_data/subgraph_results/lattice.bin";
     Lattice *lattice;
@@ -1,6 +1,9 @@
 #include <fstream>
+#include <sstream>
 #include <iostream>
 #include <vector>
+#include <map>
+#include <algorithm>
 
 #include "searchTest.h"
 #include "fixrgraphiso/serialization.h"
@@ -8,12 +11,28 @@
 #include "fixrgraphiso/serializationLattice.h"
 #include "fixrgraphiso/searchLattice.h"
 #include "fixrgraphiso/findDuplicates.h"
+#include "fixrgraphiso/latticeIndex.h"
+#include "fixrgraphiso/searchServer.h"
+#include "fixrgraphiso/searchBatch.h"
+#include "fixrgraphiso/frozenLattice.h"
+#include "fixrgraphiso/latticeRouter.h"
+#include "fixrgraphiso/searchCache.h"
+#include <thread>
+#include <unistd.h>
+#include <google/protobuf/io/zero_copy_stream_impl.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#include <google/protobuf/util/delimited_message_util.h>
 
 namespace search {
   using namespace std;
   using namespace fixrgraphiso;
 
-  SearchTest::SearchTest()
+  SearchTest::SearchTest() :
+    latticeFileName("../search_data/lattice.bin"),
+    queryFileNames({
+        "../search_data/com.example.tomek.notepad.MainActivity_j.acdfg.bin",
+        "../search_data/app.varlorg.unote.RestoreDbActivity_onContextItemSelected.acdfg.bin",
+        "../search_data/org.cry.otp.Profiles_onCreateDialog.acdfg.bin"})
   {
   }
 
@@ -34,6 +53,27 @@ namespace search {
     cout << endl;
   }
 
+  /* The search of the query on the view, with the options */
+  SearchLattice* createSearch(const FrozenLattice* view, Acdfg* query,
+                              const SearchOptions & options) {
+#ifdef USE_GUROBI_SOLVER
+    SearchLattice* searchLattice = new SearchLattice(query, view, false, 30);
+#else
+    SearchLattice* searchLattice = new SearchLattice(query, view, false);
+#endif
+    searchLattice->setOptions(options);
+    return searchLattice;
+  }
+
+  /* Search the query on the view, returning the search for its statistics */
+  SearchLattice* searchQuery(const FrozenLattice* view, Acdfg* query,
+                             const SearchOptions & options,
+                             vector<SearchResult*> &results) {
+    SearchLattice* searchLattice = createSearch(view, query, options);
+    searchLattice->newSearch(results);
+    return searchLattice;
+  }
+
   void delRes(vector<SearchResult*> &results) {
     for (auto res : results) {
       delete res;
@@ -137,6 +177,886 @@ namespace search {
     SUCCEED();
   }
 
+  /* Type and reference bin (id in the lattice file) of the results */
+  void getResultIds(const vector<SearchResult*> &results,
+                    const map<AcdfgBin*, int> & acdfgBin2id,
+                    vector<pair<int,int>> & ids) {
+    for (auto res : results)
+      ids.push_back(std::make_pair(res->getType(),
+                                   acdfgBin2id.at(res->getReferencePattern())));
+    std::sort(ids.begin(), ids.end());
+  }
+
+  TEST_F(SearchTest, IndexSearch) {
+    string indexFileName = LatticeIndex::getIndexFileName(latticeFileName);
+
+    ASSERT_EQ(0, LatticeIndex::write(latticeFileName, indexFileName));
+
+    map<AcdfgBin*, int> acdfgBin2id;
+    Lattice* lattice = fixrgraphiso::readLattice(latticeFileName, acdfgBin2id);
+    ASSERT_TRUE(NULL != lattice);
+
+    LatticeIndex index;
+    ASSERT_EQ(0, index.open(latticeFileName, indexFileName));
+    Lattice* indexLattice = index.getLattice();
+    ASSERT_EQ(lattice->getAllBins().size(), indexLattice->getAllBins().size());
+    ASSERT_EQ(lattice->getPopularBins().size(),
+              indexLattice->getPopularBins().size());
+    ASSERT_EQ(lattice->getAnomalousBins().size(),
+              indexLattice->getAnomalousBins().size());
+    // Nothing is decoded when opening the index
+    ASSERT_EQ(0, index.getDecodedCount());
+
+    for (const string & queryFileName : queryFileNames) {
+      Acdfg* query = fixrgraphiso::readAcdfg(queryFileName);
+      ASSERT_TRUE(NULL != query);
+
+      vector<SearchResult*> results;
+      vector<pair<int,int>> ids;
+      vector<pair<int,int>> indexIds;
+
+      searchQuery(lattice, query, results);
+      getResultIds(results, acdfgBin2id, ids);
+      delRes(results);
+
+      searchQuery(indexLattice, query, results);
+      getResultIds(results, index.getAcdfgBin2id(), indexIds);
+      delRes(results);
+
+      ASSERT_EQ(ids, indexIds);
+      delete(query);
+    }
+    // The search only decodes the representatives it visits
+    ASSERT_LT(index.getDecodedCount(), indexLattice->getAllBins().size());
+
+    // The isos of the members are decoded on request
+    AcdfgBin* indexBin = indexLattice->getAllBins().front();
+    ASSERT_EQ(0, index.loadIsos(indexBin));
+    for (AcdfgBin* bin : lattice->getAllBins()) {
+      if (acdfgBin2id[bin] != index.getAcdfgBin2id().at(indexBin))
+        continue;
+      for (auto nameIso : bin->getAcdfgNameToIso()) {
+        IsoRepr* indexIso = indexBin->getAcdfgNameToIso().at(nameIso.first);
+        ASSERT_TRUE(NULL != indexIso);
+        ASSERT_EQ(nameIso.second->getNodesRel(), indexIso->getNodesRel());
+      }
+    }
+
+    delete(lattice);
+  }
+
+  /* Copy the file, replacing size bytes from offset with value */
+  void copyAndOverwrite(const string & from, const string & to,
+                        size_t offset, size_t size, char value) {
+    ifstream in(from.c_str(), ios::in | ios::binary);
+    string data((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    for (size_t i = offset; i < offset + size && i < data.size(); i++)
+      data[i] = value;
+    ofstream out(to.c_str(), ios::out | ios::binary | ios::trunc);
+    out.write(data.data(), data.size());
+  }
+
+  TEST_F(SearchTest, IndexValidation) {
+    string copyFileName = "index_validation_lattice.bin";
+    string indexFileName = LatticeIndex::getIndexFileName(copyFileName);
+
+    copyAndOverwrite(latticeFileName, copyFileName, 0, 0, 0);
+    ASSERT_EQ(0, LatticeIndex::write(copyFileName, indexFileName));
+    {
+      LatticeIndex index;
+      ASSERT_EQ(0, index.open(copyFileName, indexFileName));
+
+      // the hash of the lattice is the one of the file
+      string latticeHash;
+      ASSERT_EQ(0, SearchCache::hashLatticeFile(copyFileName, latticeHash));
+      ASSERT_EQ(latticeHash, SearchCache::hashLattice(index.getLatticeHash(),
+                                                      index.getLatticeSize()));
+    }
+
+    // the lattice changed without changing its size
+    {
+      ifstream in(copyFileName.c_str(), ios::in | ios::binary | ios::ate);
+      size_t size = in.tellg();
+      in.close();
+      copyAndOverwrite(latticeFileName, copyFileName, size / 2, 1, 0x7f);
+      LatticeIndex index;
+      ASSERT_NE(0, index.open(copyFileName, indexFileName));
+    }
+
+    // the arrays after the header refer outside the index
+    copyAndOverwrite(latticeFileName, copyFileName, 0, 0, 0);
+    copyAndOverwrite(indexFileName, indexFileName, 256, 1 << 20, 0xff);
+    {
+      LatticeIndex index;
+      ASSERT_NE(0, index.open(copyFileName, indexFileName));
+    }
+
+    unlink(indexFileName.c_str());
+    unlink(copyFileName.c_str());
+  }
+
+  TEST_F(SearchTest, SearchServer) {
+    using google::protobuf::io::FileInputStream;
+    using google::protobuf::io::FileOutputStream;
+    namespace fixr_protobuf = edu::colorado::plv::fixr::protobuf;
+
+    map<AcdfgBin*, int> acdfgBin2id;
+    Lattice* lattice = fixrgraphiso::readLattice(latticeFileName, acdfgBin2id);
+    ASSERT_TRUE(NULL != lattice);
+
+    fixrgraphiso::SearchServer server;
+    ASSERT_EQ(0, server.addLattice(latticeFileName, false));
+    ASSERT_NE(0, server.addLattice("../search_data/missing.bin", false));
+
+    int requests[2];
+    int answers[2];
+    ASSERT_EQ(0, pipe(requests));
+    ASSERT_EQ(0, pipe(answers));
+    int served = -1;
+    std::thread serverThread([&]() {
+        served = server.serve(requests[0], answers[1]);
+        close(answers[1]);
+      });
+
+    {
+      FileOutputStream requestStream(requests[1]);
+      FileInputStream answerStream(answers[0]);
+
+      for (int i = 0; i <= queryFileNames.size(); i++) {
+        fixr_protobuf::SearchRequest request;
+        if (i < queryFileNames.size()) {
+          request.set_query_file(queryFileNames[i]);
+          // the last query is sent inline to the (only) lattice
+          if (i + 1 == queryFileNames.size()) {
+            AcdfgSerializer s;
+            acdfg_protobuf::Acdfg* protoQuery =
+              s.read_protobuf_acdfg(queryFileNames[i].c_str());
+            ASSERT_TRUE(NULL != protoQuery);
+            request.clear_query_file();
+            request.set_allocated_query(protoQuery);
+            request.set_lattice(latticeFileName);
+          }
+        } else {
+          request.set_query_file(queryFileNames[0]);
+          request.set_lattice("unknown.bin");
+        }
+        ASSERT_TRUE(google::protobuf::util::SerializeDelimitedToZeroCopyStream(request, &requestStream));
+        ASSERT_TRUE(requestStream.Flush());
+
+        fixr_protobuf::SearchResults answer;
+        ASSERT_TRUE(google::protobuf::util::ParseDelimitedFromZeroCopyStream(&answer, &answerStream, NULL));
+        ASSERT_FALSE(answer.has_lattice());
+
+        if (i == queryFileNames.size()) {
+          ASSERT_TRUE(answer.has_error());
+          continue;
+        }
+        ASSERT_FALSE(answer.has_error());
+
+        Acdfg* query = fixrgraphiso::readAcdfg(queryFileNames[i]);
+        ASSERT_TRUE(NULL != query);
+        vector<SearchResult*> results;
+        vector<pair<int,int>> ids;
+        searchQuery(lattice, query, results);
+        getResultIds(results, acdfgBin2id, ids);
+        delRes(results);
+        delete(query);
+
+        vector<pair<int,int>> answerIds;
+        for (auto protoRes : answer.results())
+          answerIds.push_back(std::make_pair((int) protoRes.type(),
+                                             (int) protoRes.referencepatternid()));
+        std::sort(answerIds.begin(), answerIds.end());
+        ASSERT_EQ(ids, answerIds);
+      }
+    }
+
+    close(requests[1]);
+    serverThread.join();
+    close(requests[0]);
+    close(answers[0]);
+    ASSERT_EQ(0, served);
+
+    delete(lattice);
+  }
+
+  TEST_F(SearchTest, SearchServerStdout) {
+    using google::protobuf::io::ArrayInputStream;
+    using google::protobuf::io::FileOutputStream;
+    namespace fixr_protobuf = edu::colorado::plv::fixr::protobuf;
+
+    fixrgraphiso::SearchServer server;
+    ASSERT_EQ(0, server.addLattice(latticeFileName, false));
+
+    int requests[2];
+    int answers[2];
+    ASSERT_EQ(0, pipe(requests));
+    ASSERT_EQ(0, pipe(answers));
+    {
+      FileOutputStream requestStream(requests[1]);
+      for (const string & queryFileName : queryFileNames) {
+        fixr_protobuf::SearchRequest request;
+        request.set_query_file(queryFileName);
+        ASSERT_TRUE(google::protobuf::util::SerializeDelimitedToZeroCopyStream(request, &requestStream));
+      }
+      ASSERT_TRUE(requestStream.Flush());
+    }
+    close(requests[1]);
+
+    // serve on the stdout of the test
+    cout.flush();
+    fflush(stdout);
+    int testStdout = dup(STDOUT_FILENO);
+    ASSERT_LE(0, dup2(answers[1], STDOUT_FILENO));
+    close(answers[1]);
+    int outFd = SearchServer::takeStdout();
+
+    string output;
+    std::thread reader([&]() {
+        char buffer[4096];
+        ssize_t size;
+        while ((size = read(answers[0], buffer, sizeof(buffer))) > 0)
+          output.append(buffer, size);
+      });
+
+    // the messages printed on stdout do not go to the results
+    cout << "Printed on stdout" << endl;
+    printf("Printed on stdout\n");
+    fflush(stdout);
+    int served = server.serve(requests[0], outFd);
+    close(outFd);
+    reader.join();
+
+    cout.flush();
+    fflush(stdout);
+    dup2(testStdout, STDOUT_FILENO);
+    close(testStdout);
+    close(requests[0]);
+    close(answers[0]);
+    ASSERT_EQ(0, served);
+
+    // only the results are in the output
+    ArrayInputStream answerStream(output.data(), output.size());
+    for (int i = 0; i < queryFileNames.size(); i++) {
+      fixr_protobuf::SearchResults answer;
+      ASSERT_TRUE(google::protobuf::util::ParseDelimitedFromZeroCopyStream(&answer, &answerStream, NULL));
+      ASSERT_FALSE(answer.has_error());
+    }
+    fixr_protobuf::SearchResults answer;
+    bool cleanEof = false;
+    ASSERT_FALSE(google::protobuf::util::ParseDelimitedFromZeroCopyStream(&answer, &answerStream, &cleanEof));
+    ASSERT_TRUE(cleanEof);
+  }
+
+  TEST_F(SearchTest, BatchSearch) {
+    namespace fixr_protobuf = edu::colorado::plv::fixr::protobuf;
+    vector<string> batchFileNames(queryFileNames);
+    batchFileNames.push_back("../search_data/missing.acdfg.bin");
+
+    // expected results, searching the queries one by one
+    map<string, vector<pair<int,int>>> expected;
+    {
+      map<AcdfgBin*, int> acdfgBin2id;
+      Lattice* lattice = fixrgraphiso::readLattice(latticeFileName, acdfgBin2id);
+      ASSERT_TRUE(NULL != lattice);
+      for (int i = 0; i < queryFileNames.size(); i++) {
+        Acdfg* query = fixrgraphiso::readAcdfg(queryFileNames[i]);
+        ASSERT_TRUE(NULL != query);
+        vector<SearchResult*> results;
+        searchQuery(lattice, query, results);
+        getResultIds(results, acdfgBin2id, expected[queryFileNames[i]]);
+        delRes(results);
+        delete(query);
+      }
+      delete(lattice);
+    }
+
+    // each query several times, to have more queries than threads
+    vector<string> batch;
+    for (int i = 0; i < 4; i++)
+      batch.insert(batch.end(), batchFileNames.begin(), batchFileNames.end());
+
+    map<AcdfgBin*, int> acdfgBin2id;
+    Lattice* lattice = fixrgraphiso::readLattice(latticeFileName, acdfgBin2id);
+    ASSERT_TRUE(NULL != lattice);
+
+    string data;
+    {
+      google::protobuf::io::StringOutputStream output(&data);
+      ASSERT_EQ(4, fixrgraphiso::searchBatch(lattice, acdfgBin2id, batch,
+                                             4, fixrgraphiso::SearchOptions(), NULL,
+                                             &output));
+    }
+    delete(lattice);
+
+    google::protobuf::io::ArrayInputStream input(data.data(), data.size());
+    map<string, int> answers;
+    bool cleanEof = false;
+    while (true) {
+      fixr_protobuf::SearchResults answer;
+      if (! google::protobuf::util::ParseDelimitedFromZeroCopyStream(&answer, &input,
+                                                                     &cleanEof))
+        break;
+      answers[answer.query_file()] += 1;
+      ASSERT_TRUE(answer.has_search_time_us());
+      if (expected.find(answer.query_file()) == expected.end()) {
+        ASSERT_TRUE(answer.has_error());
+        continue;
+      }
+      ASSERT_FALSE(answer.has_error());
+
+      vector<pair<int,int>> answerIds;
+      for (auto protoRes : answer.results())
+        answerIds.push_back(std::make_pair((int) protoRes.type(),
+                                           (int) protoRes.referencepatternid()));
+      std::sort(answerIds.begin(), answerIds.end());
+      ASSERT_EQ(expected[answer.query_file()], answerIds);
+    }
+    ASSERT_TRUE(cleanEof);
+
+    ASSERT_EQ(batchFileNames.size(), answers.size());
+    for (auto answerCount : answers)
+      ASSERT_EQ(4, answerCount.second);
+  }
+
+  TEST_F(SearchTest, FrozenLatticeSearch) {
+    string indexFileName = LatticeIndex::getIndexFileName(latticeFileName);
+    const int threads = 6;
+
+    vector<Acdfg*> queries;
+    for (const string & queryFileName : queryFileNames) {
+      queries.push_back(fixrgraphiso::readAcdfg(queryFileName));
+      ASSERT_TRUE(NULL != queries.back());
+    }
+
+    // expected results, searching the queries one by one
+    vector<vector<pair<int,int>>> expected(queries.size());
+    {
+      map<AcdfgBin*, int> acdfgBin2id;
+      Lattice* lattice = fixrgraphiso::readLattice(latticeFileName, acdfgBin2id);
+      ASSERT_TRUE(NULL != lattice);
+      for (int i = 0; i < queries.size(); i++) {
+        vector<SearchResult*> results;
+        searchQuery(lattice, queries[i], results);
+        getResultIds(results, acdfgBin2id, expected[i]);
+        delRes(results);
+      }
+      delete(lattice);
+    }
+
+    // the view does not modify the lattice
+    {
+      Lattice* lattice = fixrgraphiso::readLattice(latticeFileName);
+      ASSERT_TRUE(NULL != lattice);
+      vector<AcdfgBin*> popular = lattice->getPopularBins();
+      vector<AcdfgBin*> anomalous = lattice->getAnomalousBins();
+      {
+        FrozenLattice view(lattice);
+        ASSERT_EQ(popular.size(), view.getPopularBins().size());
+        ASSERT_EQ(anomalous.size(), view.getAnomalousBins().size());
+        ASSERT_FALSE(view.getPopularRoots().empty());
+      }
+      ASSERT_EQ(popular, lattice->getPopularBins());
+      ASSERT_EQ(anomalous, lattice->getAnomalousBins());
+      delete(lattice);
+    }
+
+    // concurrent searches on the lattice of the index, that decode the
+    // representatives while searching
+    ASSERT_EQ(0, LatticeIndex::write(latticeFileName, indexFileName));
+    LatticeIndex index;
+    ASSERT_EQ(0, index.open(latticeFileName, indexFileName));
+    FrozenLattice view(index.getLattice());
+
+    vector<vector<vector<pair<int,int>>>> found(threads,
+        vector<vector<pair<int,int>>>(queries.size()));
+    vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+      workers.push_back(std::thread([&, t]() {
+            for (int j = 0; j < queries.size(); j++) {
+              // each thread starts from a different query
+              int i = (t + j) % queries.size();
+              vector<SearchResult*> results;
+              delete(searchQuery(&view, queries[i], SearchOptions(), results));
+              getResultIds(results, index.getAcdfgBin2id(), found[t][i]);
+              delRes(results);
+            }
+          }));
+    }
+    for (auto & worker : workers)
+      worker.join();
+
+    for (int t = 0; t < threads; t++)
+      ASSERT_EQ(expected, found[t]);
+
+    for (Acdfg* query : queries)
+      delete(query);
+  }
+
+  TEST_F(SearchTest, RoutingIndex) {
+    string latticeListFileName = "../search_data/lattice_list.txt";
+    string routingFileName = "../search_data/lattice_list.routing";
+    string queryFileName = "../search_data/org.cry.otp.Profiles_onCreateDialog.acdfg.bin";
+
+    {
+      LatticeRouter router;
+      ASSERT_EQ(0, router.addLatticeList(latticeListFileName));
+      // a lattice without methods in common with the query
+      Lattice unrelated(vector<string>({"java.lang.Object.wait"}));
+      router.addLattice("unrelated.bin", 3, unrelated);
+      ASSERT_EQ(3, router.size());
+      ASSERT_EQ(0, router.write(routingFileName));
+    }
+
+    LatticeRouter router;
+    ASSERT_EQ(0, router.read(routingFileName));
+    ASSERT_EQ(3, router.size());
+
+    Acdfg* query = fixrgraphiso::readAcdfg(queryFileName);
+    ASSERT_TRUE(NULL != query);
+
+    vector<LatticeRoute> routes;
+    router.route(*query, 1, 0, routes);
+    ASSERT_EQ(2, routes.size());
+    ASSERT_EQ(1, routes[0].latticeId);
+    ASSERT_EQ(2, routes[1].latticeId);
+    ASSERT_EQ("../search_data/lattice.bin", routes[0].latticeFile);
+    ASSERT_GT(routes[0].methodOverlap, 0);
+    ASSERT_GT(routes[0].popularCoverage, 0);
+
+    routes.clear();
+    router.route(*query, 1, 1, routes);
+    ASSERT_EQ(1, routes.size());
+
+    // the query has less than 100 methods in common with the lattices
+    routes.clear();
+    router.route(*query, 100, 0, routes);
+    ASSERT_EQ(0, routes.size());
+
+    delete(query);
+  }
+
+  /* Search with the options, returning the number of skipped ILPs */
+  int searchWithOptions(const FrozenLattice* view, Acdfg* query,
+                        const SearchOptions & options,
+                        const map<AcdfgBin*, int> & acdfgBin2id,
+                        vector<pair<int,int>> & ids) {
+    vector<SearchResult*> results;
+    SearchLattice* searchLattice = searchQuery(view, query, options, results);
+    getResultIds(results, acdfgBin2id, ids);
+
+    fixr_protobuf::SearchResults* protoRes =
+      searchLattice->toProto(results, acdfgBin2id);
+    int skipped = searchLattice->getSkippedIlps();
+    EXPECT_EQ(skipped, protoRes->skipped_ilps());
+    delete(protoRes);
+    delete(searchLattice);
+    delRes(results);
+    return skipped;
+  }
+
+  TEST_F(SearchTest, SimilarityPrefilter) {
+    map<AcdfgBin*, int> acdfgBin2id;
+    Lattice* lattice = fixrgraphiso::readLattice(latticeFileName, acdfgBin2id);
+    ASSERT_TRUE(NULL != lattice);
+    FrozenLattice view(lattice);
+    int popularCount = view.getPopularBins().size();
+    ASSERT_GT(popularCount, 1);
+    // the features of the popular bins are computed once by the view
+    const vector<SimilarityFeatures> & popularFeatures =
+      view.getPopularFeatures();
+    ASSERT_EQ(popularCount, popularFeatures.size());
+    ASSERT_EQ(&popularFeatures, &view.getPopularFeatures());
+    ASSERT_DOUBLE_EQ(1, popularFeatures[0].similarityScore(popularFeatures[0]));
+
+    for (const string & queryFileName : queryFileNames) {
+      Acdfg* query = fixrgraphiso::readAcdfg(queryFileName);
+      ASSERT_TRUE(NULL != query);
+
+      SimilarityFeatures queryFeatures(*query);
+      ASSERT_DOUBLE_EQ(1, queryFeatures.similarityScore(queryFeatures));
+
+      // the defaults, and a top k larger than the popular bins, solve
+      // all the ILPs
+      vector<pair<int,int>> allIds;
+      ASSERT_EQ(0, searchWithOptions(&view, query, SearchOptions(),
+                                     acdfgBin2id, allIds));
+      {
+        SearchOptions options;
+        options.similarTopK = popularCount;
+        vector<pair<int,int>> ids;
+        ASSERT_EQ(0, searchWithOptions(&view, query, options, acdfgBin2id, ids));
+        ASSERT_EQ(allIds, ids);
+      }
+
+      // the ILPs solved concurrently give the same results
+      {
+        SearchOptions options;
+        options.ilpThreads = 4;
+        vector<pair<int,int>> ids;
+        ASSERT_EQ(0, searchWithOptions(&view, query, options, acdfgBin2id, ids));
+        ASSERT_EQ(allIds, ids);
+      }
+
+      // only the best popular bin
+      {
+        SearchOptions options;
+        options.similarTopK = 1;
+        vector<pair<int,int>> ids;
+        ASSERT_EQ(popularCount - 1,
+                  searchWithOptions(&view, query, options, acdfgBin2id, ids));
+        ASSERT_TRUE(std::includes(allIds.begin(), allIds.end(),
+                                  ids.begin(), ids.end()));
+      }
+
+      // no popular bin has a score larger than 1
+      {
+        SearchOptions options;
+        options.similarMinScore = 1.1;
+        vector<pair<int,int>> ids;
+        ASSERT_EQ(popularCount,
+                  searchWithOptions(&view, query, options, acdfgBin2id, ids));
+      }
+
+      delete(query);
+    }
+    delete(lattice);
+  }
+
+  /* Search the query with the cache, return true if the results are cached */
+  bool searchCached(const FrozenLattice* view, Acdfg* query,
+                    const SearchOptions & options,
+                    const map<AcdfgBin*, int> & acdfgBin2id,
+                    SearchCache* cache, string & serializedResults) {
+    vector<SearchResult*> results;
+    SearchLattice* searchLattice = createSearch(view, query, options);
+    fixr_protobuf::SearchResults* protoRes =
+      searchWithCache(*searchLattice, acdfgBin2id, cache, results);
+    bool cached = protoRes->cached();
+    EXPECT_EQ(cached, results.empty());
+    protoRes->clear_cached();
+    serializedResults = protoRes->SerializeAsString();
+    delete(protoRes);
+    delete(searchLattice);
+    delRes(results);
+    return cached;
+  }
+
+  TEST_F(SearchTest, SearchCache) {
+    string cacheDir = "search_cache";
+
+    string latticeHash;
+    ASSERT_EQ(0, SearchCache::hashLatticeFile(latticeFileName, latticeHash));
+    {
+      std::ifstream latticeFile(latticeFileName.c_str(), ios::in | ios::binary);
+      std::ostringstream data;
+      data << latticeFile.rdbuf();
+      ASSERT_EQ(SearchCache::hashLatticeData(data.str().data(), data.str().size()),
+                latticeHash);
+    }
+
+    map<AcdfgBin*, int> acdfgBin2id;
+    Lattice* lattice = fixrgraphiso::readLattice(latticeFileName, acdfgBin2id);
+    ASSERT_TRUE(NULL != lattice);
+    FrozenLattice view(lattice);
+
+    vector<Acdfg*> queries;
+    for (const string & queryFileName : queryFileNames) {
+      queries.push_back(fixrgraphiso::readAcdfg(queryFileName));
+      ASSERT_TRUE(NULL != queries.back());
+    }
+
+    // remove the results of the previous runs
+    {
+      SearchCache other("another lattice", 2);
+      ASSERT_EQ(0, other.setLatticeSpillDirectory(cacheDir, latticeFileName));
+    }
+
+    vector<string> expected(queries.size());
+    {
+      SearchCache cache(latticeHash, 2);
+      ASSERT_EQ(0, cache.setLatticeSpillDirectory(cacheDir, latticeFileName));
+
+      for (size_t i = 0; i < queries.size(); i++)
+        ASSERT_FALSE(searchCached(&view, queries[i], SearchOptions(),
+                                  acdfgBin2id, &cache, expected[i]));
+      // the least recently used is evicted
+      ASSERT_EQ(2, cache.size());
+
+      for (size_t i = 0; i < queries.size(); i++) {
+        string serialized;
+        ASSERT_TRUE(searchCached(&view, queries[i], SearchOptions(),
+                                 acdfgBin2id, &cache, serialized));
+        ASSERT_EQ(expected[i], serialized);
+      }
+      ASSERT_EQ(3, cache.getHits());
+      ASSERT_EQ(3, cache.getMisses());
+
+      // the options are part of the key
+      SearchOptions options;
+      options.similarTopK = 1;
+      string serialized;
+      ASSERT_FALSE(searchCached(&view, queries[0], options,
+                                acdfgBin2id, &cache, serialized));
+
+      // the same query at other lines gets the results with its lines
+      Acdfg* moved = fixrgraphiso::readAcdfg(queryFileNames[0]);
+      ASSERT_TRUE(NULL != moved);
+      ASSERT_FALSE(moved->getNodeToLine().empty());
+      for (auto nodeLine : moved->getNodeToLine())
+        moved->addLine(nodeLine.first, nodeLine.second + 1000);
+      moved->source_info.method_line_number += 1000;
+
+      vector<SearchResult*> results;
+      SearchLattice* searchLattice = createSearch(&view, moved,
+                                                  SearchOptions());
+      fixr_protobuf::SearchResults* protoRes =
+        searchWithCache(*searchLattice, acdfgBin2id, &cache, results);
+      ASSERT_TRUE(protoRes->cached());
+      ASSERT_LT(0, protoRes->results_size());
+      const auto & movedLines = searchLattice->getSlicedQuery()->getNodeToLine();
+      for (auto & result : protoRes->results()) {
+        const auto & protoQuery = result.isotoreference().acdfg_1();
+        ASSERT_EQ(moved->source_info.method_line_number,
+                  protoQuery.source_info().method_line_number());
+        ASSERT_EQ(movedLines.size(), protoQuery.node_lines_size());
+        for (auto & nodeLine : protoQuery.node_lines())
+          ASSERT_EQ(movedLines.at(nodeLine.id()), nodeLine.line());
+      }
+      delete(protoRes);
+      delete(searchLattice);
+      delete(moved);
+    }
+
+    // the results on disk are found by a new cache of the same lattice
+    {
+      SearchCache cache(latticeHash, 2);
+      ASSERT_EQ(0, cache.setLatticeSpillDirectory(cacheDir, latticeFileName));
+      string serialized;
+      ASSERT_TRUE(searchCached(&view, queries[2], SearchOptions(),
+                               acdfgBin2id, &cache, serialized));
+      ASSERT_EQ(expected[2], serialized);
+    }
+
+    // and removed when the lattice changes
+    {
+      SearchCache cache("changed lattice", 2);
+      ASSERT_EQ(0, cache.setLatticeSpillDirectory(cacheDir, latticeFileName));
+      string serialized;
+      ASSERT_FALSE(searchCached(&view, queries[2], SearchOptions(),
+                                acdfgBin2id, &cache, serialized));
+      ASSERT_EQ(expected[2], serialized);
+    }
+
+    for (Acdfg* query : queries)
+      delete(query);
+    delete(lattice);
+  }
+
+  TEST_F(SearchTest, SearchTimeout) {
+    map<AcdfgBin*, int> acdfgBin2id;
+    Lattice* lattice = fixrgraphiso::readLattice(latticeFileName, acdfgBin2id);
+    ASSERT_TRUE(NULL != lattice);
+    FrozenLattice view(lattice);
+
+    for (const string & queryFileName : queryFileNames) {
+      Acdfg* query = fixrgraphiso::readAcdfg(queryFileName);
+      ASSERT_TRUE(NULL != query);
+
+      vector<pair<int,int>> allIds;
+      ASSERT_EQ(0, searchWithOptions(&view, query, SearchOptions(),
+                                     acdfgBin2id, allIds));
+
+      // a timeout not reached
+      {
+        SearchOptions options;
+        options.timeoutMs = 600000;
+        vector<SearchResult*> results;
+        vector<pair<int,int>> ids;
+        SearchLattice* searchLattice = searchQuery(&view, query, options,
+                                                   results);
+        bool partial = searchLattice->isPartial();
+        delete(searchLattice);
+        getResultIds(results, acdfgBin2id, ids);
+        delRes(results);
+        ASSERT_FALSE(partial);
+        ASSERT_EQ(allIds, ids);
+      }
+
+      // the search takes more than 1 ms
+      {
+        SearchOptions options;
+        options.timeoutMs = 1;
+        SearchCache cache("lattice", 10);
+        vector<SearchResult*> results;
+        vector<pair<int,int>> ids;
+        SearchLattice* searchLattice = createSearch(&view, query, options);
+        fixr_protobuf::SearchResults* protoRes =
+          searchWithCache(*searchLattice, acdfgBin2id, &cache, results);
+        bool partial = searchLattice->isPartial();
+        delete(searchLattice);
+        ASSERT_TRUE(partial);
+        ASSERT_TRUE(protoRes->partial());
+        // the partial results are not cached
+        ASSERT_EQ(0, cache.size());
+
+        // the CORRECT results first
+        bool correct = true;
+        for (SearchResult* res : results) {
+          if (res->getType() != CORRECT) {
+            correct = false;
+          } else {
+            ASSERT_TRUE(correct);
+          }
+        }
+
+        getResultIds(results, acdfgBin2id, ids);
+        ASSERT_TRUE(std::includes(allIds.begin(), allIds.end(),
+                                  ids.begin(), ids.end()));
+        delete(protoRes);
+        delRes(results);
+      }
+
+      delete(query);
+    }
+    delete(lattice);
+  }
+
+  TEST_F(SearchTest, SavedChecks) {
+    map<AcdfgBin*, int> acdfgBin2id;
+    Lattice* lattice = fixrgraphiso::readLattice(latticeFileName, acdfgBin2id);
+    ASSERT_TRUE(NULL != lattice);
+    FrozenLattice view(lattice);
+
+    int totSaved = 0;
+    for (const string & queryFileName : queryFileNames) {
+      Acdfg* query = fixrgraphiso::readAcdfg(queryFileName);
+      ASSERT_TRUE(NULL != query);
+
+      vector<SearchResult*> results;
+      SearchLattice* searchLattice = searchQuery(&view, query, SearchOptions(),
+                                                 results);
+      Acdfg* slicedQuery = (Acdfg*) searchLattice->getSlicedQuery();
+
+      // the results inferred from the lattice are the ones of the checks
+      Stats stats;
+      for (SearchResult* res : results) {
+        Acdfg* repr = res->getReferencePattern()->getRepresentative();
+        IsoSubsumption subsumed(repr, slicedQuery, &stats);
+        IsoSubsumption subsumes(slicedQuery, repr, &stats);
+        switch (res->getType()) {
+        case CORRECT:
+          ASSERT_TRUE(subsumed.check());
+          ASSERT_TRUE(subsumes.check());
+          break;
+        case ANOMALOUS_SUBSUMED:
+          ASSERT_TRUE(subsumed.check());
+          ASSERT_FALSE(subsumes.check());
+          break;
+        case CORRECT_SUBSUMED:
+          ASSERT_TRUE(subsumes.check());
+          break;
+        default:
+          break;
+        }
+      }
+
+      fixr_protobuf::SearchResults* protoRes =
+        searchLattice->toProto(results, acdfgBin2id);
+      ASSERT_EQ(searchLattice->getSavedChecks(), protoRes->saved_checks());
+      totSaved += searchLattice->getSavedChecks();
+      delete(protoRes);
+      delete(searchLattice);
+      delRes(results);
+      delete(query);
+    }
+    // some checks are inferred from the lattice
+    ASSERT_LT(0, totSaved);
+
+    delete(lattice);
+  }
+
+  /* Ids of the anomalous bins subsuming each popular bin */
+  void getSubsumingAnomalousIds(Lattice* lattice,
+                                const map<AcdfgBin*, int> & acdfgBin2id,
+                                map<int, vector<int>> & ids) {
+    for (AcdfgBin* popular : lattice->getPopularBins()) {
+      vector<int> & anomalousIds = ids[acdfgBin2id.at(popular)];
+      for (AcdfgBin* anomalous : popular->getSubsumingAnomalous())
+        anomalousIds.push_back(acdfgBin2id.at(anomalous));
+    }
+  }
+
+  TEST_F(SearchTest, SubsumingAnomalous) {
+    string copyFileName = "subsuming_anomalous_lattice.bin";
+
+    // the lattice file does not contain the lists
+    map<AcdfgBin*, int> acdfgBin2id;
+    Lattice* lattice = fixrgraphiso::readLattice(latticeFileName, acdfgBin2id);
+    ASSERT_TRUE(NULL != lattice);
+    ASSERT_TRUE(lattice->hasSubsumingAnomalous());
+
+    int totAnomalous = 0;
+    for (AcdfgBin* popular : lattice->getPopularBins()) {
+      const vector<AcdfgBin*> & anomalous = popular->getSubsumingAnomalous();
+      int expected = 0;
+      for (AcdfgBin* bin : popular->getSubsumingBins())
+        if (bin->isAnomalous())
+          expected++;
+      ASSERT_EQ(expected, anomalous.size());
+      totAnomalous += anomalous.size();
+
+      // a bin comes before the bins it subsumes
+      for (int i = 0; i < anomalous.size(); i++) {
+        ASSERT_TRUE(popular->hasSubsumingBin(anomalous[i]));
+        for (int j = i + 1; j < anomalous.size(); j++)
+          ASSERT_FALSE(anomalous[i]->hasSubsumingBin(anomalous[j]));
+      }
+    }
+    ASSERT_LT(0, totAnomalous);
+
+    map<int, vector<int>> ids;
+    getSubsumingAnomalousIds(lattice, acdfgBin2id, ids);
+
+    // the lists are stored in the lattice file
+    {
+      writeLattice(*lattice, copyFileName);
+      map<AcdfgBin*, int> copyBin2id;
+      Lattice* copy = fixrgraphiso::readLattice(copyFileName, copyBin2id);
+      ASSERT_TRUE(NULL != copy);
+      ASSERT_TRUE(copy->hasSubsumingAnomalous());
+      map<int, vector<int>> copyIds;
+      getSubsumingAnomalousIds(copy, copyBin2id, copyIds);
+      ASSERT_EQ(ids, copyIds);
+      delete(copy);
+    }
+
+    // and in the index
+    string indexFileName = LatticeIndex::getIndexFileName(copyFileName);
+    {
+      ASSERT_EQ(0, LatticeIndex::write(copyFileName, indexFileName));
+      LatticeIndex index;
+      ASSERT_EQ(0, index.open(copyFileName, indexFileName));
+      ASSERT_TRUE(index.getLattice()->hasSubsumingAnomalous());
+      map<int, vector<int>> indexIds;
+      getSubsumingAnomalousIds(index.getLattice(), index.getAcdfgBin2id(),
+                               indexIds);
+      ASSERT_EQ(ids, indexIds);
+    }
+    unlink(indexFileName.c_str());
+    unlink(copyFileName.c_str());
+
+    // changing the classification invalidates the lists
+    lattice->rebuildClassifiedBins(false);
+    ASSERT_FALSE(lattice->hasSubsumingAnomalous());
+    {
+      FrozenLattice view(lattice);
+      ASSERT_TRUE(lattice->hasSubsumingAnomalous());
+    }
+
+    delete(lattice);
+  }
+
   TEST_F(SearchTest, FindDuplicates) {
     string latticeFileName = "../search_data/lattice.bin";
     int popular_bins;
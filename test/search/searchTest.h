@@ -1,4 +1,6 @@
 #include <gtest/gtest.h>
+#include <string>
+#include <vector>
 
 namespace search {
   using std::string;
@@ -6,6 +8,10 @@ namespace search {
   class SearchTest : public ::testing::Test {
   protected:
     SearchTest();
+
+    /* The lattice and the queries searched by the tests */
+    const string latticeFileName;
+    const std::vector<string> queryFileNames;
   };
 }
 